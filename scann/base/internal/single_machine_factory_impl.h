@@ -77,6 +77,12 @@ class SingleMachineFactoryImplClass {
     typed_searcher->EnableReordering(std::move(reordering_helper),
                                      params.post_reordering_num_neighbors,
                                      params.post_reordering_epsilon);
+    if (config.has_exact_reordering() &&
+        (config.exact_reordering().storage_type() !=
+             ExactReordering::FLOAT32 ||
+         config.exact_reordering().has_out_of_core())) {
+      typed_searcher->MaybeReleaseDataset();
+    }
     if (config.has_compressed_reordering()) {
       DCHECK(!typed_searcher->needs_dataset());
       typed_searcher->ReleaseDatasetAndDocids();
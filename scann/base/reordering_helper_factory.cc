@@ -14,6 +14,8 @@
 
 #include "scann/base/reordering_helper_factory.h"
 
+#include <unistd.h>
+
 #include <memory>
 
 #include "scann/hashes/asymmetric_hashing2/training_model.h"
@@ -23,6 +25,7 @@
 #include "scann/proto/compressed_reordering.pb.h"
 #include "scann/proto/distance_measure.pb.h"
 #include "scann/proto/exact_reordering.pb.h"
+#include "scann/utils/file_backed_reordering_helper.h"
 #include "scann/utils/reordering_helper.h"
 #include "scann/utils/types.h"
 
@@ -112,11 +115,125 @@ StatusOrHelper<float> BuildFixedPointReorderingHelper<float>(
 }
 
 template <typename T>
-StatusOrHelper<T> ExactReorderingFactory(
+StatusOrHelper<T> BuildHalfPrecisionReorderingHelper(
+    const ExactReordering& config,
+    const shared_ptr<const DistanceMeasure>& reordering_dist,
+    const shared_ptr<TypedDataset<T>>& dataset) {
+  return InvalidArgumentError(
+      "Half-precision reordering is only supported for float types.");
+}
+
+template <>
+StatusOrHelper<float> BuildHalfPrecisionReorderingHelper<float>(
     const ExactReordering& config,
     const shared_ptr<const DistanceMeasure>& reordering_dist,
+    const shared_ptr<TypedDataset<float>>& dataset) {
+  if (!dataset || !dataset->IsDense()) {
+    return InvalidArgumentError(
+        "Half-precision reordering requires a dense dataset.");
+  }
+  const auto& distance_type = typeid(*reordering_dist);
+  if (distance_type != typeid(const DotProductDistance) &&
+      distance_type != typeid(const CosineDistance) &&
+      distance_type != typeid(const SquaredL2Distance)) {
+    return InvalidArgumentError(
+        "Half-precision reordering is supported only for dot product, cosine "
+        "and squared L2 distance.");
+  }
+  const HalfPrecisionFormat format =
+      config.storage_type() == ExactReordering::BFLOAT16 ? kBfloat16
+                                                         : kFloat16;
+  return {make_unique<HalfPrecisionFloatDenseReorderingHelper>(
+      reordering_dist, *down_cast<const DenseDataset<float>*>(dataset.get()),
+      format)};
+}
+
+template <typename T>
+StatusOrHelper<T> BuildFileBackedReorderingHelper(
+    const OutOfCoreStorage& config,
+    const shared_ptr<const DistanceMeasure>& reordering_dist,
     const shared_ptr<TypedDataset<T>>& dataset,
     SingleMachineFactoryOptions* opts) {
+  return InvalidArgumentError(
+      "Out-of-core reordering is only supported for float types.");
+}
+
+template <>
+StatusOrHelper<float> BuildFileBackedReorderingHelper<float>(
+    const OutOfCoreStorage& config,
+    const shared_ptr<const DistanceMeasure>& reordering_dist,
+    const shared_ptr<TypedDataset<float>>& dataset,
+    SingleMachineFactoryOptions* opts) {
+  if (config.filename().empty()) {
+    return InvalidArgumentError(
+        "exact_reordering.out_of_core.filename must be set.");
+  }
+  if (!dataset || dataset->dimensionality() == 0) {
+    return InvalidArgumentError(
+        "Out-of-core reordering requires the dataset dimensionality.");
+  }
+  if (config.cache_size_rows() < 0) {
+    return InvalidArgumentError(
+        "exact_reordering.out_of_core.cache_size_rows must be >= 0.");
+  }
+  // A searcher loaded from prebuilt artifacts reopens the file written when
+  // the index was built.  Only a fresh build, or a load that still has the
+  // dataset but lost the file, writes it.
+  const bool loading = opts->hashed_dataset || opts->ah_codebook ||
+                       opts->serialized_partitioner ||
+                       opts->pre_quantized_fixed_point;
+  const bool file_exists = access(config.filename().c_str(), F_OK) == 0;
+  if (!loading || (!file_exists && !dataset->empty())) {
+    if (dataset->empty() || !dataset->IsDense()) {
+      return InvalidArgumentError(
+          "Building out-of-core reordering requires a dense dataset.");
+    }
+    SCANN_RETURN_IF_ERROR(FileBackedFloatDenseReorderingHelper::WriteDataset(
+        *down_cast<const DenseDataset<float>*>(dataset.get()),
+        config.filename()));
+  }
+  TF_ASSIGN_OR_RETURN(
+      auto helper,
+      FileBackedFloatDenseReorderingHelper::Create(
+          reordering_dist, config.filename(), dataset->dimensionality(),
+          config.cache_size_rows(), opts->parallelization_pool));
+  const DatapointIndex expected_size =
+      dataset->empty() && opts->hashed_dataset ? opts->hashed_dataset->size()
+                                               : dataset->size();
+  if ((!dataset->empty() || opts->hashed_dataset) &&
+      helper->size() != expected_size) {
+    return FailedPreconditionError(
+        "Reordering file %s holds %d datapoints but the index has %d.",
+        config.filename(), helper->size(), expected_size);
+  }
+  return {std::move(helper)};
+}
+
+template <typename T>
+StatusOrHelper<T> BuildFinalReorderingStage(
+    const ExactReordering& config,
+    const shared_ptr<const DistanceMeasure>& reordering_dist,
+    const shared_ptr<TypedDataset<T>>& dataset,
+    SingleMachineFactoryOptions* opts) {
+  if (config.has_out_of_core()) {
+    if (config.fixed_point().enabled() ||
+        config.storage_type() != ExactReordering::FLOAT32) {
+      return InvalidArgumentError(
+          "exact_reordering.out_of_core may not be combined with fixed-point "
+          "or half-precision reordering.");
+    }
+    return BuildFileBackedReorderingHelper<T>(config.out_of_core(),
+                                              reordering_dist, dataset, opts);
+  }
+  if (config.storage_type() != ExactReordering::FLOAT32) {
+    if (config.fixed_point().enabled()) {
+      return InvalidArgumentError(
+          "exact_reordering.storage_type may not be combined with fixed-point "
+          "reordering.");
+    }
+    return BuildHalfPrecisionReorderingHelper<T>(config, reordering_dist,
+                                                 dataset);
+  }
   if (config.fixed_point().enabled() || config.use_fixed_point_if_possible()) {
     auto statusor = BuildFixedPointReorderingHelper<T>(
         config.fixed_point(), reordering_dist, dataset, opts);
@@ -130,6 +247,49 @@ StatusOrHelper<T> ExactReorderingFactory(
   return {make_unique<ExactReorderingHelper<T>>(reordering_dist, dataset)};
 }
 
+template <typename T>
+StatusOrHelper<T> ExactReorderingFactory(
+    const ExactReordering& config,
+    const shared_ptr<const DistanceMeasure>& reordering_dist,
+    const shared_ptr<TypedDataset<T>>& dataset,
+    SingleMachineFactoryOptions* opts) {
+  TF_ASSIGN_OR_RETURN(auto final_stage,
+                      BuildFinalReorderingStage<T>(config, reordering_dist,
+                                                   dataset, opts));
+  if (config.tiered_stages().empty()) return {std::move(final_stage)};
+
+  std::vector<typename TieredReorderingHelper<T>::Stage> stages;
+  for (const TieredReorderingStage& stage_config : config.tiered_stages()) {
+    if (stage_config.num_neighbors() <= 0) {
+      return InvalidArgumentError(
+          "exact_reordering.tiered_stages.num_neighbors must be > 0.");
+    }
+    unique_ptr<ReorderingInterface<T>> stage_helper;
+    if (stage_config.fixed_point().enabled()) {
+      if (config.fixed_point().enabled()) {
+        return InvalidArgumentError(
+            "Fixed-point reordering stages may not be combined with a "
+            "fixed-point final reordering stage.");
+      }
+      TF_ASSIGN_OR_RETURN(
+          stage_helper,
+          BuildFixedPointReorderingHelper<T>(stage_config.fixed_point(),
+                                             reordering_dist, dataset, opts));
+      if (!stage_helper) {
+        return InvalidArgumentError(
+            "Fixed-point reordering stages require a dense dataset.");
+      }
+    } else {
+      stage_helper =
+          make_unique<ExactReorderingHelper<T>>(reordering_dist, dataset);
+    }
+    stages.push_back({std::move(stage_helper),
+                      static_cast<DatapointIndex>(stage_config.num_neighbors())});
+  }
+  return {make_unique<TieredReorderingHelper<T>>(std::move(stages),
+                                                 std::move(final_stage))};
+}
+
 }  // namespace
 
 template <typename T>
@@ -70,6 +70,13 @@ class RestrictAllowlist {
     return IsWhitelisted(dp_index);
   }
 
+  void set(DatapointIndex dp_index, bool is_whitelisted) {
+    DCHECK_LT(dp_index, num_points_);
+    const size_t mask = kOne << (dp_index % kBitsPerWord);
+    size_t& word = whitelist_array_[dp_index / kBitsPerWord];
+    word = is_whitelisted ? (word | mask) : (word & ~mask);
+  }
+
   DatapointIndex NumPointsWhitelisted() const;
 
   DatapointIndex num_points() const { return num_points_; }
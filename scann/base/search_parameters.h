@@ -92,18 +92,35 @@ class SearchParameters {
            per_crowding_attribute_post_reordering_num_neighbors_;
   }
 
-  bool restricts_enabled() const { return false; }
+  bool restricts_enabled() const { return restrict_whitelist_ != nullptr; }
 
-  const RestrictAllowlist* restrict_whitelist() const { return nullptr; }
+  const RestrictAllowlist* restrict_whitelist() const {
+    return restrict_whitelist_.get();
+  }
+
+  shared_ptr<RestrictAllowlist> shared_restrict_whitelist() const {
+    return restrict_whitelist_;
+  }
+
+  bool IsWhitelisted(DatapointIndex dp_index) const {
+    return !restricts_enabled() ||
+           restrict_whitelist_->IsWhitelistedWithDefault(dp_index, false);
+  }
 
-  bool IsWhitelisted(DatapointIndex dp_index) const { return false; }
+  RestrictAllowlist* mutable_restrict_whitelist() {
+    return restrict_whitelist_.get();
+  }
 
-  RestrictAllowlist* mutable_restrict_whitelist() { return nullptr; }
+  void set_restrict_whitelist(shared_ptr<RestrictAllowlist> whitelist) {
+    restrict_whitelist_ = std::move(whitelist);
+  }
 
   void EnableRestricts(DatapointIndex database_size, bool default_whitelisted) {
+    restrict_whitelist_ =
+        make_shared<RestrictAllowlist>(database_size, default_whitelisted);
   }
 
-  void DisableRestricts() {}
+  void DisableRestricts() { restrict_whitelist_.reset(); }
 
   const SearcherSpecificOptionalParameters*
   searcher_specific_optional_parameters() const {
@@ -147,6 +164,8 @@ class SearchParameters {
   shared_ptr<const SearcherSpecificOptionalParameters>
       searcher_specific_optional_parameters_;
 
+  shared_ptr<RestrictAllowlist> restrict_whitelist_;
+
   unique_ptr<UnlockedQueryPreprocessingResults>
       unlocked_query_preprocessing_results_;
 };
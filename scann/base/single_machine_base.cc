@@ -18,6 +18,7 @@
 
 #include <typeinfo>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/flags/flag.h"
 #include "scann/base/search_parameters.h"
 #include "tensorflow/core/platform/cpu_info.h"
@@ -281,7 +282,7 @@ Status SingleMachineSearcherBase<T>::FindNeighbors(
   SCANN_RETURN_IF_ERROR(
       FindNeighborsNoSortNoExactReorder(query, params, result));
 
-  if (reordering_helper_) {
+  if (reordering_helper_ && !ResultsAreReordered(query, params)) {
     SCANN_RETURN_IF_ERROR(ReorderResults(query, params, result));
   }
 
@@ -334,8 +335,16 @@ Status SingleMachineSearcherBase<T>::FindNeighborsBatched(
       FindNeighborsBatchedNoSortNoExactReorder(queries, params, results));
 
   if (reordering_helper_) {
-    for (DatapointIndex i = 0; i < queries.size(); ++i) {
-      SCANN_RETURN_IF_ERROR(ReorderResults(queries[i], params[i], &results[i]));
+    vector<pair<DatapointIndex, NNResultsVector>> already_reordered;
+    for (DatapointIndex i = 0; i < results.size(); ++i) {
+      if (ResultsAreReordered(queries[i], params[i])) {
+        already_reordered.emplace_back(i, std::move(results[i]));
+        results[i].clear();
+      }
+    }
+    SCANN_RETURN_IF_ERROR(ReorderResultsBatched(queries, params, results));
+    for (auto& reordered : already_reordered) {
+      results[reordered.first] = std::move(reordered.second);
     }
   }
 
@@ -483,6 +492,33 @@ Status SingleMachineSearcherBase<T>::ReorderResults(
   return OkStatus();
 }
 
+template <typename T>
+Status SingleMachineSearcherBase<T>::ReorderResultsBatched(
+    const TypedDataset<T>& queries, ConstSpan<SearchParameters> params,
+    MutableSpan<NNResultsVector> results) const {
+  SCANN_RETURN_IF_ERROR(
+      reordering_helper_->ComputeDistancesForReorderingBatched(queries,
+                                                               results));
+  DistanceComparatorBranchOptimized comparator;
+  for (DatapointIndex i = 0; i < results.size(); ++i) {
+    if (params[i].post_reordering_num_neighbors() != 1) continue;
+    NNResultsVector* result = &results[i];
+    pair<DatapointIndex, float> top1 = {kInvalidDatapointIndex,
+                                        numeric_limits<float>::max()};
+    for (const auto& neighbor : *result) {
+      if (comparator(neighbor, top1)) top1 = neighbor;
+    }
+    if (!result->empty() && top1.second < params[i].post_reordering_epsilon() &&
+        top1.first != kInvalidDatapointIndex) {
+      result->resize(1);
+      result->at(0) = top1;
+    } else {
+      result->resize(0);
+    }
+  }
+  return OkStatus();
+}
+
 template <typename T>
 Status SingleMachineSearcherBase<T>::SortAndDropResults(
     NNResultsVector* result, const SearchParameters& params) const {
@@ -502,7 +538,29 @@ Status SingleMachineSearcherBase<T>::SortAndDropResults(
     }
 
     if (params.post_reordering_crowding_enabled()) {
-      return FailedPreconditionError("Crowding is not supported.");
+      ConstSpan<int64_t> crowding_attributes =
+          datapoint_index_to_crowding_attribute();
+      if (crowding_attributes.empty()) {
+        return FailedPreconditionError(
+            "Crowding is enabled in the search parameters but not on the "
+            "searcher.");
+      }
+      ZipSortBranchOptimized(DistanceComparatorBranchOptimized(),
+                             result->begin(), result->end());
+      absl::flat_hash_map<int64_t, int32_t> attribute_counts;
+      size_t num_kept = 0;
+      for (const auto& neighbor : *result) {
+        if (num_kept == params.post_reordering_num_neighbors()) break;
+        DCHECK_LT(neighbor.first, crowding_attributes.size());
+        int32_t& count = attribute_counts[crowding_attributes[neighbor.first]];
+        if (count >=
+            params.per_crowding_attribute_post_reordering_num_neighbors()) {
+          continue;
+        }
+        ++count;
+        (*result)[num_kept++] = neighbor;
+      }
+      result->resize(num_kept);
     } else {
       RemoveNeighborsPastLimit(params.post_reordering_num_neighbors(), result);
     }
@@ -708,21 +766,106 @@ bool SingleMachineSearcherBase<T>::fixed_point_reordering_enabled() const {
 }
 
 template <typename T>
-bool SingleMachineSearcherBase<T>::AddDatasetWithIds(const TypedDataset<T>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config) {
+bool SingleMachineSearcherBase<T>::AddDatasetWithIds(const TypedDataset<T>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config, const AddDatasetAttributes& attributes) {
+  // 叶子搜索器只追加哈希数据, 原始数据集为空
+  const DatapointIndex num_added =
+      dataset.empty() ? hashed_dataset.size() : dataset.size();
+  if (crowding_enabled() &&
+      attributes.crowding_attributes.size() != num_added) {
+    LOG(ERROR) << "crowding is enabled but "
+               << attributes.crowding_attributes.size()
+               << " crowding attributes were given for " << num_added
+               << " datapoints";
+    return false;
+  }
+  const Status check_status =
+      CheckDatasetToAdd(dataset, hashed_dataset, ids, attributes);
+  if (!check_status.ok()) {
+    LOG(ERROR) << "add dataset check error: " << check_status;
+    return false;
+  }
+  // 先取重排 mutator, 失败时数据集尚未修改
+  typename ReorderingInterface<T>::Mutator* reordering_mutator = nullptr;
+  if (reordering_enabled() &&
+      reordering_helper_->owns_mutation_data_structures()) {
+    auto mutator_or = reordering_helper_->GetMutator();
+    if (!mutator_or.ok()) {
+      LOG(ERROR) << "reordering get mutator error: " << mutator_or.status();
+      return false;
+    }
+    reordering_mutator = mutator_or.ValueOrDie();
+  }
+
+  // 叶子步骤依赖已追加的行, 失败时截断本次追加的行, 不留下半更新的索引
   auto mutable_dataset_ptr = mutable_dataset();
+  auto mutable_hash = mutable_hashed_dataset();
+  const DatapointIndex old_dataset_size =
+      mutable_dataset_ptr ? mutable_dataset_ptr->size() : 0;
+  const DatapointIndex old_hashed_size =
+      mutable_hash ? mutable_hash->size() : 0;
+  std::vector<DatapointIndex> reordering_added;
+  auto roll_back = [&] {
+    if (mutable_dataset_ptr) {
+      auto* dense = dynamic_cast<DenseDataset<T>*>(mutable_dataset_ptr);
+      const Status status =
+          dense ? dense->Truncate(old_dataset_size)
+                : UnimplementedError("Only dense datasets can be rolled back.");
+      if (!status.ok()) LOG(ERROR) << "dataset roll back error: " << status;
+    }
+    if (mutable_hash) {
+      const Status status = mutable_hash->Truncate(old_hashed_size);
+      if (!status.ok()) {
+        LOG(ERROR) << "hashed dataset roll back error: " << status;
+      }
+    }
+    // 逆序删除, 每次删除的都是末行
+    for (auto it = reordering_added.rbegin(); it != reordering_added.rend();
+         ++it) {
+      const auto status_or_index = reordering_mutator->RemoveDatapoint(*it);
+      if (!status_or_index.ok()) {
+        LOG(ERROR) << "reordering roll back error: "
+                   << status_or_index.status();
+        break;
+      }
+    }
+  };
+
   if (mutable_dataset_ptr) {
     for (auto i = 0; i < dataset.size(); i++) {
       mutable_dataset_ptr->AppendOrDie(dataset[i]);
     }
   }
 
-  auto mutable_hash = mutable_hashed_dataset();
   if (mutable_hash) {
     for (auto i = 0; i < hashed_dataset.size(); i++) {
       mutable_hash->AppendOrDie(hashed_dataset[i]);
     }
   }
-  return AddDatasetWithIdsInternel(dataset, hashed_dataset, ids, config);
+
+  if (reordering_mutator) {
+    for (DatapointIndex i = 0; i < dataset.size(); ++i) {
+      auto status_or_index = reordering_mutator->AddDatapoint(dataset[i]);
+      if (!status_or_index.ok()) {
+        LOG(ERROR) << "reordering add datapoint error: "
+                   << status_or_index.status();
+        roll_back();
+        return false;
+      }
+      reordering_added.push_back(status_or_index.ValueOrDie());
+    }
+  }
+  if (!AddDatasetWithIdsInternel(dataset, hashed_dataset, ids, config,
+                                 attributes)) {
+    roll_back();
+    return false;
+  }
+  if (crowding_enabled()) {
+    datapoint_index_to_crowding_attribute_->insert(
+        datapoint_index_to_crowding_attribute_->end(),
+        attributes.crowding_attributes.begin(),
+        attributes.crowding_attributes.end());
+  }
+  return true;
 }
 
 SCANN_INSTANTIATE_TYPED_CLASS(, SingleMachineSearcherBase);
@@ -35,6 +35,16 @@
 namespace tensorflow {
 namespace scann_ops {
 
+// Optional per-datapoint attributes of a batch given to AddDatasetWithIds,
+// indexed like the batch.  An empty span means the attribute was not given.
+struct AddDatasetAttributes {
+  ConstSpan<int64_t> crowding_attributes;
+
+  // Disjoint restrict token of every added datapoint, for searchers that
+  // support restrict tokens.
+  ConstSpan<uint64_t> restrict_tokens;
+};
+
 template <typename T>
 class SingleMachineSearcherBase;
 
@@ -373,9 +383,23 @@ class SingleMachineSearcherBase : public UntypedSingleMachineSearcherBase {
   const ReorderingInterface<T>& reordering_helper() const {
     return *reordering_helper_;
   }
-  virtual bool AddDatasetWithIds(const TypedDataset<T>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config);
+  // Rejects a batch that AddDatasetWithIds could only apply partially.  Runs
+  // before anything is modified.
+  virtual Status CheckDatasetToAdd(
+      const TypedDataset<T>& dataset,
+      const TypedDataset<uint8_t>& hashed_dataset,
+      const std::vector<std::string>& ids,
+      const AddDatasetAttributes& attributes) const {
+    return OkStatus();
+  }
 
-  virtual bool AddDatasetWithIdsInternel(const TypedDataset<T>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config) {
+  // With crowding enabled, attributes.crowding_attributes must hold the
+  // crowding attribute of every added datapoint.  Rows appended before a
+  // failing step are truncated again.  Not synchronized: adds must not
+  // overlap searches.
+  virtual bool AddDatasetWithIds(const TypedDataset<T>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config, const AddDatasetAttributes& attributes = {});
+
+  virtual bool AddDatasetWithIdsInternel(const TypedDataset<T>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config, const AddDatasetAttributes& attributes) {
     LOG(INFO) << "base search dont need add internal";
     return true;
   }
@@ -503,9 +527,12 @@ class SingleMachineSearcherBase : public UntypedSingleMachineSearcherBase {
       const TypedDataset<T>& queries, ConstSpan<SearchParameters> params,
       MutableSpan<NNResultsVector> results) const;
 
- private:
-  Status PopulateDefaultParameters(const ScannConfig& config);
-  Status BaseInitImpl();
+  // Returns true if FindNeighborsImpl already scores `query` with the
+  // reordering distance, in which case the exact reordering pass is skipped.
+  virtual bool ResultsAreReordered(const DatapointPtr<T>& query,
+                                   const SearchParameters& params) const {
+    return false;
+  }
 
   Status ReorderResults(const DatapointPtr<T>& query,
                         const SearchParameters& params,
@@ -514,6 +541,14 @@ class SingleMachineSearcherBase : public UntypedSingleMachineSearcherBase {
   Status SortAndDropResults(NNResultsVector* result,
                             const SearchParameters& params) const;
 
+ private:
+  Status PopulateDefaultParameters(const ScannConfig& config);
+  Status BaseInitImpl();
+
+  Status ReorderResultsBatched(const TypedDataset<T>& queries,
+                               ConstSpan<SearchParameters> params,
+                               MutableSpan<NNResultsVector> results) const;
+
   shared_ptr<const TypedDataset<T>> dataset_ = nullptr;
 
   shared_ptr<const ReorderingInterface<T>> reordering_helper_ = nullptr;
@@ -28,6 +28,7 @@
 #include "scann/brute_force/scalar_quantized_brute_force.h"
 #include "scann/data_format/dataset.h"
 #include "scann/distance_measures/distance_measure_factory.h"
+#include "scann/hashes/internal/asymmetric_hashing_impl.h"
 #include "scann/oss_wrappers/scann_random.h"
 #include "scann/partitioning/kmeans_tree_like_partitioner.h"
 #include "scann/partitioning/partitioner_factory.h"
@@ -243,14 +244,17 @@ StatusOrSearcherUntyped TreeAhHybridResidualFactory<float>(
         auto quantization_distance,
         GetDistanceMeasure(
             config.hash().asymmetric_hash().quantization_distance()));
+    const auto& ah_config = config.hash().asymmetric_hash();
+    // 只为训练采样点计算残差, 避免物化整个残差数据集
+    const vector<DatapointIndex> sample =
+        asymmetric_hashing_internal::SampleTrainingIndices(ah_config,
+                                                           dense->size());
     TF_ASSIGN_OR_RETURN(
-        // 为dataset 中每个点计算残差
         auto residuals,
-        TreeAHHybridResidual::ComputeResiduals(
-            *dense, kmeans_tree_partitioner.get(), datapoints_by_token,
-            config.hash()
-                .asymmetric_hash()
-                .use_normalized_residual_quantization()));
+        TreeAHHybridResidual::ComputeResidualsForSample(
+            *dense, kmeans_tree_partitioner.get(), datapoints_by_token, sample,
+            ah_config.use_normalized_residual_quantization(),
+            opts->parallelization_pool.get()));
     if (residuals.size() == 0) {
 	    return InvalidArgumentError(
 			    "residuals empty "
@@ -258,7 +262,11 @@ StatusOrSearcherUntyped TreeAhHybridResidualFactory<float>(
     }
     // training_opts -> train projector
     asymmetric_hashing2::TrainingOptions<float> training_opts(
-        config.hash().asymmetric_hash(), quantization_distance, residuals);
+        ah_config, quantization_distance, residuals);
+    // 残差已按配置采样, 训练时不再二次采样
+    training_opts.mutable_config()->clear_expected_sample_size();
+    training_opts.mutable_config()->clear_max_sample_size();
+    training_opts.mutable_config()->set_sampling_fraction(1.0);
     TF_ASSIGN_OR_RETURN(
         ah_model, asymmetric_hashing2::TrainSingleMachine(
                       residuals, training_opts, opts->parallelization_pool));
@@ -276,6 +284,7 @@ StatusOrSearcherUntyped TreeAhHybridResidualFactory<float>(
   result->set_database_tokenizer(
       absl::WrapUnique(down_cast<KMeansTreeLikePartitioner<float>*>(
           kmeans_tree_partitioner->Clone().release())));
+  result->set_parallelization_pool(opts->parallelization_pool);
   SCANN_RETURN_IF_ERROR(result->BuildLeafSearchers(
       config.hash().asymmetric_hash(), std::move(kmeans_tree_partitioner),
       std::move(ah_model), std::move(datapoints_by_token),
@@ -551,19 +560,23 @@ StatusOrSearcherUntyped TreeXHybridFactory(
 template <typename T>
 StatusOrSearcherUntyped BruteForceFactory(
     const BruteForceConfig& config, const shared_ptr<TypedDataset<T>>& dataset,
-    const GenericSearchParameters& params) {
+    const GenericSearchParameters& params,
+    shared_ptr<thread::ThreadPool> pool) {
   if (config.fixed_point().enabled()) {
     return InvalidArgumentError(
         "Scalar-quantized brute force only works with float data.");
   }
-  return {make_unique<BruteForceSearcher<T>>(
+  auto result = make_unique<BruteForceSearcher<T>>(
       params.pre_reordering_dist, dataset, params.pre_reordering_num_neighbors,
-      params.pre_reordering_epsilon)};
+      params.pre_reordering_epsilon);
+  result->set_thread_pool(std::move(pool));
+  return {std::move(result)};
 }
 
 StatusOrSearcherUntyped BruteForceFactory(const BruteForceConfig& config,
                                           const GenericSearchParameters& params,
-                                          PreQuantizedFixedPoint* fixed_point) {
+                                          PreQuantizedFixedPoint* fixed_point,
+                                          shared_ptr<thread::ThreadPool> pool) {
   auto fixed_point_dataset = std::move(*(fixed_point->fixed_point_dataset));
 
   std::vector<float> inverse_multipliers = InverseMultiplier(fixed_point);
@@ -574,10 +587,12 @@ StatusOrSearcherUntyped BruteForceFactory(const BruteForceConfig& config,
   if (distance_type == typeid(const DotProductDistance) ||
       distance_type == typeid(const CosineDistance) ||
       distance_type == typeid(const SquaredL2Distance)) {
-    return {make_unique<ScalarQuantizedBruteForceSearcher>(
+    auto result = make_unique<ScalarQuantizedBruteForceSearcher>(
         params.reordering_dist, std::move(squared_l2_norm_by_datapoint),
         std::move(fixed_point_dataset), std::move(inverse_multipliers),
-        params.pre_reordering_num_neighbors, params.pre_reordering_epsilon)};
+        params.pre_reordering_num_neighbors, params.pre_reordering_epsilon);
+    result->set_thread_pool(std::move(pool));
+    return {std::move(result)};
   } else {
     return InvalidArgumentError(
         "Scalar bruteforce is supported only for dot product, cosine "
@@ -589,7 +604,8 @@ template <>
 StatusOrSearcherUntyped BruteForceFactory<float>(
     const BruteForceConfig& config,
     const shared_ptr<TypedDataset<float>>& dataset,
-    const GenericSearchParameters& params) {
+    const GenericSearchParameters& params,
+    shared_ptr<thread::ThreadPool> pool) {
   if (config.fixed_point().enabled()) {
     const auto tag =
         params.pre_reordering_dist->specially_optimized_distance_tag();
@@ -614,13 +630,17 @@ StatusOrSearcherUntyped BruteForceFactory<float>(
         config.fixed_point().fixed_point_multiplier_quantile();
     opts.noise_shaping_threshold =
         config.scalar_quantization_noise_shaping_threshold();
-    return {make_unique<ScalarQuantizedBruteForceSearcher>(
+    auto result = make_unique<ScalarQuantizedBruteForceSearcher>(
         params.pre_reordering_dist, dense, params.pre_reordering_num_neighbors,
-        params.pre_reordering_epsilon, opts)};
+        params.pre_reordering_epsilon, opts);
+    result->set_thread_pool(std::move(pool));
+    return {std::move(result)};
   } else {
-    return {make_unique<BruteForceSearcher<float>>(
+    auto result = make_unique<BruteForceSearcher<float>>(
         params.pre_reordering_dist, dataset,
-        params.pre_reordering_num_neighbors, params.pre_reordering_epsilon)};
+        params.pre_reordering_num_neighbors, params.pre_reordering_epsilon);
+    result->set_thread_pool(std::move(pool));
+    return {std::move(result)};
   }
 }
 
@@ -644,9 +664,11 @@ class NoSparseLeafSearcher {
           config.brute_force().fixed_point().enabled() &&
           opts->pre_quantized_fixed_point) {
         return BruteForceFactory(config.brute_force(), params,
-                                 opts->pre_quantized_fixed_point.get());
+                                 opts->pre_quantized_fixed_point.get(),
+                                 opts->parallelization_pool);
       } else {
-        return BruteForceFactory(config.brute_force(), dataset, params);
+        return BruteForceFactory(config.brute_force(), dataset, params,
+                                 opts->parallelization_pool);
       }
     } else if (config.has_hash()) {
       return HashFactory<T>(dataset, config, opts, params);
@@ -28,6 +28,7 @@
 #include "absl/synchronization/mutex.h"
 #include "scann/utils/fast_top_neighbors.h"
 #include "scann/utils/intrinsics/sse4.h"
+#include "scann/utils/parallel_for.h"
 #include "scann/utils/top_n_amortized_constant.h"
 #include "scann/utils/types.h"
 
@@ -219,6 +220,101 @@ BruteForceSearcher<T>::FinishBatchedSearch(
                 "float/double types.  This codepath should be impossible.";
 }
 
+template <typename T>
+template <typename Float, typename Callback>
+void BruteForceSearcher<T>::ComputeManyToMany(
+    const DenseDataset<Float>& db, const DenseDataset<Float>& queries,
+    Callback callback) const {
+  if (squared_db_norms_.empty()) {
+    DCHECK(typeid(*distance_) != typeid(SquaredL2Distance));
+    DenseDistanceManyToMany<Float>(*distance_, queries, db, pool_.get(),
+                                   callback);
+  } else {
+    vector<Float> squared_query_norms;
+    squared_query_norms.reserve(queries.size());
+    for (auto dptr : queries) {
+      squared_query_norms.push_back(SquaredL2Norm(dptr));
+    }
+    DenseSquaredL2DistanceManyToMany<Float, Float, Float>(
+        queries, db, squared_query_norms, squared_db_norms_, pool_.get(),
+        callback);
+  }
+}
+
+template <typename T>
+template <typename Float>
+void BruteForceSearcher<T>::FinishBatchedSearchThreadLocal(
+    const DenseDataset<Float>& db, const DenseDataset<Float>& queries,
+    ConstSpan<SearchParameters> params,
+    MutableSpan<NNResultsVector> results) const {
+  struct ThreadLocalTopN {
+    FastTopNeighbors<Float> top_n;
+    FastTopNeighborsMutator<Float> mutator;
+    bool initialized = false;
+  };
+
+  constexpr size_t kQueriesPerChunk = 256;
+  const size_t dimensionality = queries.dimensionality();
+  const size_t num_slots = pool_->NumThreads() + 1;
+  for (size_t chunk_begin = 0; chunk_begin < queries.size();
+       chunk_begin += kQueriesPerChunk) {
+    const size_t chunk_size =
+        std::min(kQueriesPerChunk, queries.size() - chunk_begin);
+    DenseDataset<Float> chunk_storage;
+    if (chunk_size != queries.size()) {
+      const Float* chunk_ptr = queries[chunk_begin].values();
+      chunk_storage = DenseDataset<Float>(
+          vector<Float>(chunk_ptr, chunk_ptr + chunk_size * dimensionality),
+          chunk_size);
+    }
+    const DenseDataset<Float>& chunk =
+        (chunk_size == queries.size()) ? queries : chunk_storage;
+
+    vector<ThreadLocalTopN> partial(num_slots * chunk_size);
+    auto write_to_thread_local_top_n = [&](MutableSpan<Float> result_block,
+                                           DatapointIndex base_dp_idx,
+                                           DatapointIndex query_idx) {
+      const size_t slot = pool_->CurrentThreadId() + 1;
+      ThreadLocalTopN& local = partial[slot * chunk_size + query_idx];
+      if (!local.initialized) {
+        const SearchParameters& p = params[chunk_begin + query_idx];
+        local.top_n.Init(p.pre_reordering_num_neighbors(),
+                         p.pre_reordering_epsilon());
+        local.top_n.AcquireMutator(&local.mutator);
+        local.initialized = true;
+      }
+      local.mutator.PushDistanceBlock(result_block, base_dp_idx);
+    };
+    ComputeManyToMany(db, chunk, write_to_thread_local_top_n);
+
+    ParallelFor<1>(Seq(chunk_size), pool_.get(), [&](size_t query_idx) {
+      const SearchParameters& p = params[chunk_begin + query_idx];
+      FastTopNeighbors<Float> merged(p.pre_reordering_num_neighbors(),
+                                     p.pre_reordering_epsilon());
+      NNResultsVector partial_results;
+      {
+        FastTopNeighborsMutator<Float> mutator;
+        merged.AcquireMutator(&mutator);
+        Float eps = mutator.epsilon();
+        for (size_t slot : Seq(num_slots)) {
+          ThreadLocalTopN& local = partial[slot * chunk_size + query_idx];
+          if (!local.initialized) continue;
+          local.mutator.Release();
+          local.top_n.FinishUnsorted(&partial_results);
+          for (const auto& neighbor : partial_results) {
+            if (neighbor.second > eps) continue;
+            if (mutator.Push(neighbor.first, neighbor.second)) {
+              mutator.GarbageCollect();
+              eps = mutator.epsilon();
+            }
+          }
+        }
+      }
+      merged.FinishUnsorted(&results[chunk_begin + query_idx]);
+    });
+  }
+}
+
 template <typename T>
 template <typename Float>
 enable_if_t<IsSameAny<Float, float, double>(), void>
@@ -226,6 +322,12 @@ BruteForceSearcher<T>::FinishBatchedSearch(
     const DenseDataset<Float>& db, const DenseDataset<Float>& queries,
     ConstSpan<SearchParameters> params,
     MutableSpan<NNResultsVector> results) const {
+  if constexpr (IsSame<Float, float>()) {
+    if (pool_ && pool_->NumThreads() > 1) {
+      return FinishBatchedSearchThreadLocal(db, queries, params, results);
+    }
+  }
+
   vector<unique_ptr<TopNWrapperInterface<Float>>> top_ns(queries.size());
   for (size_t i : IndicesOf(params)) {
     if (params[i].pre_reordering_crowding_enabled()) {
@@ -241,20 +343,7 @@ BruteForceSearcher<T>::FinishBatchedSearch(
     top_n->PushBatch(result_block, base_dp_idx);
   };
 
-  if (squared_db_norms_.empty()) {
-    DCHECK(typeid(*distance_) != typeid(SquaredL2Distance));
-    DenseDistanceManyToMany<Float>(*distance_, queries, db, pool_.get(),
-                                   write_to_top_n);
-  } else {
-    vector<Float> squared_query_norms;
-    squared_query_norms.reserve(queries.size());
-    for (auto dptr : queries) {
-      squared_query_norms.push_back(SquaredL2Norm(dptr));
-    }
-    DenseSquaredL2DistanceManyToMany<Float, Float, Float>(
-        queries, db, squared_query_norms, squared_db_norms_, pool_.get(),
-        write_to_top_n);
-  }
+  ComputeManyToMany(db, queries, write_to_top_n);
   for (size_t i : IndicesOf(top_ns)) {
     results[i] = top_ns[i]->TakeUnsorted();
   }
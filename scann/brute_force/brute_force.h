@@ -81,6 +81,17 @@ class BruteForceSearcher final : public SingleMachineSearcherBase<T> {
       ConstSpan<SearchParameters> params,
       MutableSpan<NNResultsVector> results) const;
 
+  template <typename Float>
+  void FinishBatchedSearchThreadLocal(const DenseDataset<Float>& db,
+                                      const DenseDataset<Float>& queries,
+                                      ConstSpan<SearchParameters> params,
+                                      MutableSpan<NNResultsVector> results) const;
+
+  template <typename Float, typename Callback>
+  void ComputeManyToMany(const DenseDataset<Float>& db,
+                         const DenseDataset<Float>& queries,
+                         Callback callback) const;
+
   template <typename Float>
   enable_if_t<!IsSameAny<Float, float, double>(), void> FinishBatchedSearch(
       const DenseDataset<Float>& db, const DenseDataset<Float>& queries,
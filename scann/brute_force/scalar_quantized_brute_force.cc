@@ -18,10 +18,14 @@
 #include "scann/base/search_parameters.h"
 #include "scann/base/single_machine_base.h"
 #include "scann/data_format/dataset.h"
+#include "scann/distance_measures/many_to_many/many_to_many.h"
 #include "scann/distance_measures/one_to_many/one_to_many.h"
 
 #include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
 #include "scann/oss_wrappers/scann_status_builder.h"
+#include "scann/utils/fast_top_neighbors.h"
+#include "scann/utils/parallel_for.h"
 #include "scann/utils/scalar_quantization_helpers.h"
 #include "scann/utils/top_n_amortized_constant.h"
 #include "scann/utils/types.h"
@@ -232,6 +236,109 @@ Status ScalarQuantizedBruteForceSearcher::FindNeighborsImpl(
   }
 }
 
+shared_ptr<const FP8SimdBlockTransposedDatabase>
+ScalarQuantizedBruteForceSearcher::GetTransposedDatabase() const {
+  absl::MutexLock lock(&transposed_database_mutex_);
+  const int8_t* source = quantized_dataset_.data().data();
+  if (!transposed_database_ || transposed_database_source_ != source ||
+      transposed_database_size_ != quantized_dataset_.size()) {
+    transposed_database_ = make_shared<FP8SimdBlockTransposedDatabase>(
+        quantized_dataset_, inverse_multiplier_by_dimension_);
+    transposed_database_source_ = source;
+    transposed_database_size_ = quantized_dataset_.size();
+  }
+  return transposed_database_;
+}
+
+Status ScalarQuantizedBruteForceSearcher::FindNeighborsBatchedImpl(
+    const TypedDataset<float>& queries, ConstSpan<SearchParameters> params,
+    MutableSpan<NNResultsVector> results) const {
+  bool supports_batching = queries.IsDense() && queries.size() > 1 &&
+                           !quantized_dataset_.empty() &&
+                           !inverse_multiplier_by_dimension_.empty();
+  for (const SearchParameters& p : params) {
+    supports_batching &= !p.restricts_enabled() &&
+                         !p.pre_reordering_crowding_enabled() &&
+                         !p.searcher_specific_optional_parameters();
+  }
+  if (!supports_batching) {
+    return SingleMachineSearcherBase<float>::FindNeighborsBatchedImpl(
+        queries, params, results);
+  }
+
+  const auto distance_tag = distance_->specially_optimized_distance_tag();
+  const auto& dense_queries = *down_cast<const DenseDataset<float>*>(&queries);
+  vector<float> squared_query_norms;
+  if (distance_tag == DistanceMeasure::SQUARED_L2) {
+    squared_query_norms.reserve(queries.size());
+    for (auto dptr : dense_queries) {
+      squared_query_norms.push_back(SquaredL2Norm(dptr));
+    }
+  }
+
+  // Blocks of one query arrive from several pool threads, so each thread
+  // keeps its own top-N per query and they are merged at the end.
+  struct ThreadLocalTopN {
+    FastTopNeighbors<float> top_n;
+    FastTopNeighbors<float>::Mutator mutator;
+    bool initialized = false;
+  };
+  const size_t num_slots = (pool_ ? pool_->NumThreads() : 0) + 1;
+  vector<ThreadLocalTopN> partial(num_slots * queries.size());
+
+  auto push_block = [&](MutableSpan<float> dot_products,
+                        DatapointIndex base_dp_idx, DatapointIndex query_idx) {
+    if (distance_tag == DistanceMeasure::COSINE) {
+      for (float& d : dot_products) d += 1.0f;
+    } else if (distance_tag == DistanceMeasure::SQUARED_L2) {
+      const float query_norm = squared_query_norms[query_idx];
+      const float* db_norms = squared_l2_norms_.data() + base_dp_idx;
+      for (size_t i : IndicesOf(dot_products)) {
+        dot_products[i] = query_norm + db_norms[i] + 2.0f * dot_products[i];
+      }
+    }
+    const size_t slot = pool_ ? pool_->CurrentThreadId() + 1 : 0;
+    ThreadLocalTopN& local = partial[slot * queries.size() + query_idx];
+    if (!local.initialized) {
+      local.top_n.Init(params[query_idx].pre_reordering_num_neighbors(),
+                       params[query_idx].pre_reordering_epsilon());
+      local.top_n.AcquireMutator(&local.mutator);
+      local.initialized = true;
+    }
+    local.mutator.PushDistanceBlock(dot_products, base_dp_idx);
+  };
+  SCANN_RETURN_IF_ERROR(DenseDistanceManyToManyFP8Pretransposed(
+      DotProductDistance(), dense_queries, *GetTransposedDatabase(),
+      pool_.get(), push_block));
+
+  ParallelFor<1>(Seq(queries.size()), pool_.get(), [&](size_t query_idx) {
+    const SearchParameters& p = params[query_idx];
+    FastTopNeighbors<float> merged(p.pre_reordering_num_neighbors(),
+                                   p.pre_reordering_epsilon());
+    NNResultsVector partial_results;
+    {
+      FastTopNeighbors<float>::Mutator mutator;
+      merged.AcquireMutator(&mutator);
+      float eps = mutator.epsilon();
+      for (size_t slot : Seq(num_slots)) {
+        ThreadLocalTopN& local = partial[slot * queries.size() + query_idx];
+        if (!local.initialized) continue;
+        local.mutator.Release();
+        local.top_n.FinishUnsorted(&partial_results);
+        for (const auto& neighbor : partial_results) {
+          if (neighbor.second > eps) continue;
+          if (mutator.Push(neighbor.first, neighbor.second)) {
+            mutator.GarbageCollect();
+            eps = mutator.epsilon();
+          }
+        }
+      }
+    }
+    merged.FinishUnsorted(&results[query_idx]);
+  });
+  return OkStatus();
+}
+
 template <typename ResultElem>
 Status ScalarQuantizedBruteForceSearcher::PostprocessDistances(
     const DatapointPtr<float>& query, const SearchParameters& params,
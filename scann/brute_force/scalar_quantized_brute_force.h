@@ -19,15 +19,18 @@
 
 #include <utility>
 
+#include "absl/synchronization/mutex.h"
 #include "scann/base/search_parameters.h"
 #include "scann/base/single_machine_base.h"
 #include "scann/data_format/datapoint.h"
 #include "scann/data_format/dataset.h"
 #include "scann/distance_measures/distance_measure_base.h"
+#include "scann/distance_measures/many_to_many/fp8_transposed.h"
 #include "scann/oss_wrappers/scann_status.h"
 #include "scann/tree_x_hybrid/leaf_searcher_optional_parameter_creator.h"
 #include "scann/utils/types.h"
 #include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/threadpool.h"
 
 namespace tensorflow {
 namespace scann_ops {
@@ -60,6 +63,10 @@ class ScalarQuantizedBruteForceSearcher final
 
   bool supports_crowding() const final { return true; }
 
+  void set_thread_pool(std::shared_ptr<thread::ThreadPool> p) {
+    pool_ = std::move(p);
+  }
+
   ScalarQuantizedBruteForceSearcher(
       shared_ptr<const DistanceMeasure> distance,
       vector<float> squared_l2_norms, DenseDataset<int8_t> quantized_dataset,
@@ -88,6 +95,10 @@ class ScalarQuantizedBruteForceSearcher final
                            const SearchParameters& params,
                            NNResultsVector* result) const final;
 
+  Status FindNeighborsBatchedImpl(
+      const TypedDataset<float>& queries, ConstSpan<SearchParameters> params,
+      MutableSpan<NNResultsVector> results) const final;
+
   Status EnableCrowdingImpl(
       ConstSpan<int64_t> datapoint_index_to_crowding_attribute) final;
 
@@ -118,6 +129,12 @@ class ScalarQuantizedBruteForceSearcher final
       ConstSpan<pair<DatapointIndex, float>> dot_products,
       DistanceFunctor distance_functor, TopN* top_n_ptr) const;
 
+  // Rebuilt whenever quantized_dataset_ has been resized or reallocated since
+  // the last build.  A search holds on to the copy it started with.  The
+  // searcher has no mutator, so rows are never updated in place.
+  shared_ptr<const FP8SimdBlockTransposedDatabase> GetTransposedDatabase()
+      const;
+
   bool impl_needs_dataset() const override { return false; }
 
   shared_ptr<const DistanceMeasure> distance_;
@@ -131,6 +148,19 @@ class ScalarQuantizedBruteForceSearcher final
   vector<float> inverse_multiplier_by_dimension_;
 
   mutable unique_ptr<Mutator> mutator_ = nullptr;
+
+  std::shared_ptr<thread::ThreadPool> pool_;
+
+  mutable absl::Mutex transposed_database_mutex_;
+
+  mutable shared_ptr<const FP8SimdBlockTransposedDatabase> transposed_database_
+      ABSL_GUARDED_BY(transposed_database_mutex_);
+
+  mutable const int8_t* transposed_database_source_
+      ABSL_GUARDED_BY(transposed_database_mutex_) = nullptr;
+
+  mutable DatapointIndex transposed_database_size_
+      ABSL_GUARDED_BY(transposed_database_mutex_) = 0;
 };
 
 class TreeScalarQuantizationPreprocessedQuery final
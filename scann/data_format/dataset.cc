@@ -335,10 +335,23 @@ DimensionIndex DenseDataset<T>::NumActiveDimensions() const {
   return this->dimensionality();
 }
 
+template <typename T>
+DenseDataset<T>& DenseDataset<T>::operator=(DenseDataset<T>&& other) {
+  UnadviseLargeAllocation();
+  TypedDataset<T>::operator=(std::move(other));
+  data_ = std::move(other.data_);
+  stride_ = other.stride_;
+  mutator_ = std::move(other.mutator_);
+  return *this;
+}
+
 template <typename T>
 void DenseDataset<T>::ShrinkToFit() {
   this->docids()->ShrinkToFit();
+  if (data_.capacity() == data_.size()) return;
+  UnadviseLargeAllocation();
   data_.shrink_to_fit();
+  AdviseLargeAllocation();
 }
 
 template <typename T>
@@ -422,8 +435,13 @@ Status DenseDataset<T>::Append(const DatapointPtr<T>& dptr, string_view docid) {
     to_insert = storage.ToPtr();
   }
   SCANN_RETURN_IF_ERROR(this->AppendDocid(docid));
+  if (data_.size() + to_insert.values_slice().size() > data_.capacity()) {
+    UnadviseLargeAllocation();
+  }
+  const T* old_data = data_.data();
   data_.insert(data_.end(), to_insert.values_slice().begin(),
                to_insert.values_slice().end());
+  if (data_.data() != old_data) AdviseLargeAllocation();
   return OkStatus();
 }
 
@@ -449,6 +467,7 @@ DenseDataset<T>::DenseDataset(vector<T> datapoint_vec,
     this->set_dimensionality_no_checks(stride_);
   }
   DCHECK_EQ(this->docids()->size() * stride_, data_.size());
+  AdviseLargeAllocation();
 }
 
 template <typename T>
@@ -469,7 +488,10 @@ void DenseDataset<T>::Reserve(size_t n) {
 
 template <typename T>
 void DenseDataset<T>::ReserveImpl(size_t n) {
+  if (n * stride_ > data_.capacity()) UnadviseLargeAllocation();
+  const T* old_data = data_.data();
   data_.reserve(n * stride_);
+  if (data_.data() != old_data) AdviseLargeAllocation();
 }
 
 template <typename T>
@@ -482,6 +504,21 @@ void DenseDataset<T>::clear() {
   mutator_ = nullptr;
 }
 
+template <typename T>
+Status DenseDataset<T>::Truncate(DatapointIndex new_size) {
+  if (new_size > this->size()) {
+    return OutOfRangeError("Cannot truncate a dataset of size %d to %d.",
+                           this->size(), new_size);
+  }
+  if (new_size == this->size()) return OkStatus();
+  TF_ASSIGN_OR_RETURN(auto* docid_mutator, this->docids()->GetMutator());
+  for (DatapointIndex i = this->size(); i > new_size; --i) {
+    SCANN_RETURN_IF_ERROR(docid_mutator->RemoveDatapoint(i - 1));
+  }
+  data_.resize(static_cast<size_t>(new_size) * stride_);
+  return OkStatus();
+}
+
 template <typename T>
 shared_ptr<DocidCollectionInterface> DenseDataset<T>::ReleaseDocids() {
   auto result = Dataset::ReleaseDocids();
@@ -27,6 +27,7 @@
 #include "scann/data_format/features.pb.h"
 #include "scann/data_format/sparse_low_level.h"
 #include "scann/distance_measures/distance_measure_base.h"
+#include "scann/oss_wrappers/scann_aligned_malloc.h"
 #include "scann/proto/hashed.pb.h"
 #include "scann/utils/common.h"
 #include "scann/utils/iterators.h"
@@ -245,7 +246,13 @@ class TypedDataset<T>::Mutator : public VirtualDestructor {
 template <typename T>
 class DenseDataset final : public TypedDataset<T> {
  public:
-  SCANN_DECLARE_MOVE_ONLY_CLASS(DenseDataset);
+  SCANN_DECLARE_MOVE_ONLY_CLASS_CUSTOM_IMPL(DenseDataset);
+
+  DenseDataset(DenseDataset&&) = default;
+
+  DenseDataset& operator=(DenseDataset&& other);
+
+  ~DenseDataset() override { UnadviseLargeAllocation(); }
 
   DenseDataset() {}
 
@@ -290,6 +297,8 @@ class DenseDataset final : public TypedDataset<T> {
   }
 
   void clear() final;
+  // Drops every datapoint at index new_size and above.  Capacity is kept.
+  Status Truncate(DatapointIndex new_size);
   DimensionIndex NumActiveDimensions() const final;
   void ShrinkToFit() final;
   size_t MemoryUsageExcludingDocids() const final;
@@ -319,6 +328,17 @@ class DenseDataset final : public TypedDataset<T> {
  private:
   void SetStride();
 
+  void AdviseLargeAllocation() const {
+    ::tensorflow::scann_ops::AdviseLargeAllocation(
+        data_.data(), data_.size() * sizeof(T), data_.capacity() * sizeof(T));
+  }
+
+  // Called before data_ frees or reallocates its buffer.
+  void UnadviseLargeAllocation() const {
+    ::tensorflow::scann_ops::UnadviseLargeAllocation(
+        data_.data(), data_.capacity() * sizeof(T));
+  }
+
   std::vector<T> data_;
 
   DimensionIndex stride_ = 0;
@@ -524,7 +544,9 @@ void DenseDataset<T>::ConvertType(DenseDataset<Real>* target) const {
   target->set_dimensionality_no_checks(this->dimensionality());
   target->stride_ = stride_;
   target->set_docids_no_checks(this->docids()->Copy());
+  target->UnadviseLargeAllocation();
   target->data_.insert(target->data_.begin(), data_.begin(), data_.end());
+  target->AdviseLargeAllocation();
 }
 
 template <typename T>
@@ -16,6 +16,7 @@
 
 #include "scann/utils/internal/avx2_funcs.h"
 #include "scann/utils/internal/avx_funcs.h"
+#include "scann/utils/intrinsics/attributes.h"
 #include "scann/utils/intrinsics/flags.h"
 
 namespace tensorflow {
@@ -42,6 +43,10 @@ using AvxFuncs = ::tensorflow::scann_ops::AvxFunctionsAvx2Fma;
 #undef SCANN_SIMD_ATTRIBUTE
 }  // namespace avx2
 
+namespace avx512_vnni {
+#include "scann/distance_measures/one_to_many/one_to_many_vnni_impl.inc"
+}  // namespace avx512_vnni
+
 #endif
 
 using one_to_many_low_level::SetDistanceFunctor;
@@ -58,7 +63,12 @@ SCANN_INLINE void DenseDotProductDistanceOneToManyInt8FloatDispatch(
   constexpr size_t kUnrollFactor = 3;
   using DatasetView = DefaultDenseDatasetView<int8_t>;
   auto view = DatasetView(database);
-  if (RuntimeSupportsAvx2()) {
+  if (RuntimeSupportsAvx512Vnni() &&
+      database.dimensionality() <= avx512_vnni::kMaxDimensionality) {
+    avx512_vnni::DenseDotProductDistanceOneToManyInt8Float<kHasIndices>(
+        query.values(), &view, indices, result, &callback);
+    j = result.size();
+  } else if (RuntimeSupportsAvx2()) {
     avx2::DenseDotProductDistanceOneToManyInt8Float<DatasetView, kHasIndices>(
         query.values(), &view, indices, result, &callback);
     j = result.size() / kUnrollFactor * kUnrollFactor;
@@ -17,6 +17,7 @@
 #ifndef SCANN__DISTANCE_MEASURES_ONE_TO_MANY_ONE_TO_MANY_H_
 #define SCANN__DISTANCE_MEASURES_ONE_TO_MANY_ONE_TO_MANY_H_
 
+#include <algorithm>
 #include <atomic>
 #include <cmath>
 #include <limits>
@@ -66,6 +67,13 @@ std::pair<DatapointIndex, U> DenseDistanceOneToManyTop1(
     const DenseDataset<T>& database, MutableSpan<ResultElem> result,
     thread::ThreadPool* pool = nullptr);
 
+template <typename T, typename ResultElem>
+void DenseDistanceOneToManyGather(const DistanceMeasure& dist,
+                                  const DatapointPtr<T>& query,
+                                  const DenseDataset<T>& database,
+                                  MutableSpan<ResultElem> result,
+                                  bool sort_by_datapoint_index = false);
+
 template <typename T, typename ResultElem, typename DatasetView>
 void DenseDistanceOneToMany(const DistanceMeasure& dist,
                             const DatapointPtr<T>& query,
@@ -748,6 +756,103 @@ DenseAccumulatingDistanceMeasureOneToManyInternalAvx2(
   }
 }
 
+template <typename T, typename DatasetView, typename Lambdas,
+          typename ResultElem, bool kShouldPrefetch, typename CallbackFunctor>
+enable_if_t<std::is_same<T, float>::value, void> SCANN_AVX512_OUTLINE
+DenseAccumulatingDistanceMeasureOneToManyInternalAvx512(
+    const DatapointPtr<T>& query, const DatasetView* __restrict__ database,
+    const Lambdas& lambdas, MutableSpan<ResultElem> result,
+    CallbackFunctor* __restrict__ callback, thread::ThreadPool* pool) {
+  if (result.empty()) return;
+  DCHECK(!pool || !kShouldPrefetch);
+  const size_t dims = query.dimensionality();
+  DCHECK_GE(dims, 16);
+
+  Lambdas lambdas_vec[3] = {lambdas, lambdas, lambdas};
+  const size_t num_outer_iters = result.size() / 3;
+  const size_t parallel_end = num_outer_iters * 3;
+
+  constexpr size_t kMinPrefetchAheadDims =
+      (IsFloatingType<ResultElem>()) ? 512 : 256;
+  size_t num_prefetch_datapoints;
+  if (kShouldPrefetch) {
+    num_prefetch_datapoints = std::max<size_t>(1, kMinPrefetchAheadDims / dims);
+  }
+
+  auto get_db_ptr = [&database, result, callback](size_t i)
+                        SCANN_INLINE_LAMBDA -> const float* {
+    auto idx = GetDatapointIndex(result, i);
+    callback->prefetch(idx);
+    return database->GetPtr(idx);
+  };
+
+  const __mmask16 tail_mask = (1u << (dims % 16)) - 1;
+
+  ParallelFor<8>(
+      Seq(num_outer_iters), pool, [&](size_t i) SCANN_AVX512_ATTRIBUTE {
+        const float* f0 = get_db_ptr(i);
+        const float* f1 = get_db_ptr(i + num_outer_iters);
+        const float* f2 = get_db_ptr(i + 2 * num_outer_iters);
+        const float *p0 = nullptr, *p1 = nullptr, *p2 = nullptr;
+
+        if (kShouldPrefetch && i + num_prefetch_datapoints < num_outer_iters) {
+          p0 = get_db_ptr(i + num_prefetch_datapoints);
+          p1 = get_db_ptr(i + num_outer_iters + num_prefetch_datapoints);
+          p2 = get_db_ptr(i + 2 * num_outer_iters + num_prefetch_datapoints);
+        }
+
+        __m512 a0 = _mm512_setzero_ps();
+        __m512 a1 = _mm512_setzero_ps();
+        __m512 a2 = _mm512_setzero_ps();
+        size_t j = 0;
+
+        for (; j + 16 <= dims; j += 16) {
+          __m512 q = _mm512_loadu_ps(query.values() + j);
+          __m512 v0 = _mm512_loadu_ps(f0 + j);
+          __m512 v1 = _mm512_loadu_ps(f1 + j);
+          __m512 v2 = _mm512_loadu_ps(f2 + j);
+
+          if (kShouldPrefetch) {
+            ::tensorflow::port::prefetch<::tensorflow::port::PREFETCH_HINT_T0>(
+                p0 + j);
+            ::tensorflow::port::prefetch<::tensorflow::port::PREFETCH_HINT_T0>(
+                p1 + j);
+            ::tensorflow::port::prefetch<::tensorflow::port::PREFETCH_HINT_T0>(
+                p2 + j);
+          }
+
+          a0 = lambdas_vec[0].FmaTerm(a0, q, v0);
+          a1 = lambdas_vec[1].FmaTerm(a1, q, v1);
+          a2 = lambdas_vec[2].FmaTerm(a2, q, v2);
+        }
+
+        if (j < dims) {
+          __m512 q = _mm512_maskz_loadu_ps(tail_mask, query.values() + j);
+          __m512 v0 = _mm512_maskz_loadu_ps(tail_mask, f0 + j);
+          __m512 v1 = _mm512_maskz_loadu_ps(tail_mask, f1 + j);
+          __m512 v2 = _mm512_maskz_loadu_ps(tail_mask, f2 + j);
+          a0 = lambdas_vec[0].FmaTerm(a0, q, v0);
+          a1 = lambdas_vec[1].FmaTerm(a1, q, v1);
+          a2 = lambdas_vec[2].FmaTerm(a2, q, v2);
+        }
+
+        callback->invoke(
+            i, lambdas_vec[0].Postprocess(_mm512_reduce_add_ps(a0)));
+        callback->invoke(i + num_outer_iters, lambdas_vec[1].Postprocess(
+                                                  _mm512_reduce_add_ps(a1)));
+        callback->invoke(
+            i + 2 * num_outer_iters,
+            lambdas_vec[2].Postprocess(_mm512_reduce_add_ps(a2)));
+      });
+
+  size_t i = parallel_end;
+  for (; i < result.size(); ++i) {
+    const DatapointPtr<float> f0 =
+        MakeDatapointPtr(database->GetPtr(GetDatapointIndex(result, i)), dims);
+    callback->invoke(i, lambdas.VectorVector(query, f0));
+  }
+}
+
 template <typename T, typename DatasetView, typename Lambdas,
           typename ResultElem, typename CallbackFunctor>
 enable_if_t<std::is_same<T, float>::value, void>
@@ -803,6 +908,18 @@ DenseAccumulatingDistanceMeasureOneToMany(
         query, database, lambdas, result, callback, pool);
   }
 
+  if (dims >= 16 && RuntimeSupportsAvx512()) {
+    if (!pool && database->dimensionality() <= kMaxPrefetchAheadDims) {
+      return DenseAccumulatingDistanceMeasureOneToManyInternalAvx512<
+          T, DatasetView, Lambdas, ResultElem, true>(
+          query, database, lambdas, result, callback, nullptr);
+    } else {
+      return DenseAccumulatingDistanceMeasureOneToManyInternalAvx512<
+          T, DatasetView, Lambdas, ResultElem, false>(
+          query, database, lambdas, result, callback, pool);
+    }
+  }
+
   if (!pool && database->dimensionality() <= kMaxPrefetchAheadDims &&
       database->dimensionality() >= kMinPrefetchAheadDims) {
     return DenseAccumulatingDistanceMeasureOneToManyInternalAvx2<
@@ -1078,6 +1195,10 @@ class DotProductDistanceLambdas {
     return _mm_fmadd_ps(a, b, acc);
   }
 
+  static SCANN_AVX512_INLINE __m512 FmaTerm(__m512 acc, __m512 a, __m512 b) {
+    return _mm512_fmadd_ps(a, b, acc);
+  }
+
   static __m128d GetTerm(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
 #endif
 
@@ -1145,6 +1266,11 @@ void DenseAbsDotProductDistanceOneToMany(
       return _mm_fmadd_ps(a, b, acc);
     }
 
+    static SCANN_AVX512_INLINE __m512 FmaTerm(__m512 acc, __m512 a,
+                                              __m512 b) {
+      return _mm512_fmadd_ps(a, b, acc);
+    }
+
     static __m128d GetTerm(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
 #endif
 
@@ -1203,6 +1329,11 @@ void DenseCosineDistanceOneToMany(const DatapointPtr<T>& query,
       return _mm_fmadd_ps(a, b, acc);
     }
 
+    static SCANN_AVX512_INLINE __m512 FmaTerm(__m512 acc, __m512 a,
+                                              __m512 b) {
+      return _mm512_fmadd_ps(a, b, acc);
+    }
+
     static __m128d GetTerm(__m128d a, __m128d b) { return _mm_mul_pd(a, b); }
 #endif
 
@@ -1267,6 +1398,12 @@ void DenseSquaredL2DistanceOneToMany(const DatapointPtr<T>& query,
       return _mm_fmadd_ps(tmp, tmp, acc);
     }
 
+    static SCANN_AVX512_INLINE __m512 FmaTerm(__m512 acc, __m512 a,
+                                              __m512 b) {
+      __m512 tmp = _mm512_sub_ps(a, b);
+      return _mm512_fmadd_ps(tmp, tmp, acc);
+    }
+
     static __m128d GetTerm(__m128d a, __m128d b) {
       __m128d tmp = _mm_sub_pd(a, b);
       return _mm_mul_pd(tmp, tmp);
@@ -1342,6 +1479,12 @@ void DenseL2DistanceOneToMany(const DatapointPtr<T>& query,
       return _mm_fmadd_ps(tmp, tmp, acc);
     }
 
+    static SCANN_AVX512_INLINE __m512 FmaTerm(__m512 acc, __m512 a,
+                                              __m512 b) {
+      __m512 tmp = _mm512_sub_ps(a, b);
+      return _mm512_fmadd_ps(tmp, tmp, acc);
+    }
+
     static __m128d GetTerm(__m128d a, __m128d b) {
       __m128d tmp = _mm_sub_pd(a, b);
       return _mm_mul_pd(tmp, tmp);
@@ -1663,6 +1806,66 @@ std::pair<DatapointIndex, U> DenseDistanceOneToManyTop1(
   return set_top1_functor.Top1Pair(result);
 }
 
+namespace one_to_many_low_level {
+
+inline size_t GatherPrefetchBlockSize(size_t datapoint_bytes) {
+  constexpr size_t kGatherBytesInFlight = 8192;
+  constexpr size_t kMaxGatherBlockSize = 96;
+  const size_t block_size =
+      kGatherBytesInFlight / std::max<size_t>(datapoint_bytes, 1);
+  return std::max<size_t>(3, std::min(block_size, kMaxGatherBlockSize) / 3 * 3);
+}
+
+template <typename T, typename ResultElem>
+SCANN_INLINE void PrefetchGatheredDatapoints(const DenseDataset<T>& database,
+                                             ConstSpan<ResultElem> candidates) {
+  constexpr size_t kCacheLineBytes = 64;
+  const size_t datapoint_bytes = database.dimensionality() * sizeof(T);
+  for (const auto& elem : candidates) {
+    const char* ptr =
+        reinterpret_cast<const char*>(database[elem.first].values());
+    for (size_t offset = 0; offset < datapoint_bytes;
+         offset += kCacheLineBytes) {
+      ::tensorflow::port::prefetch<::tensorflow::port::PREFETCH_HINT_T0>(
+          ptr + offset);
+    }
+  }
+}
+
+}  // namespace one_to_many_low_level
+
+template <typename T, typename ResultElem>
+void DenseDistanceOneToManyGather(const DistanceMeasure& dist,
+                                  const DatapointPtr<T>& query,
+                                  const DenseDataset<T>& database,
+                                  MutableSpan<ResultElem> result,
+                                  bool sort_by_datapoint_index) {
+  static_assert(!IsFloatingType<ResultElem>(),
+                "DenseDistanceOneToManyGather requires indexed results.");
+  if (sort_by_datapoint_index) {
+    std::sort(result.begin(), result.end(),
+              [](const ResultElem& a, const ResultElem& b) {
+                return a.first < b.first;
+              });
+  }
+
+  const size_t block_size = one_to_many_low_level::GatherPrefetchBlockSize(
+      database.dimensionality() * sizeof(T));
+  if (result.size() <= block_size) {
+    return DenseDistanceOneToMany<T, ResultElem>(dist, query, database, result);
+  }
+
+  one_to_many_low_level::PrefetchGatheredDatapoints<T, ResultElem>(
+      database, result.subspan(0, block_size));
+  for (size_t begin = 0; begin < result.size(); begin += block_size) {
+    const size_t end = std::min(begin + block_size, result.size());
+    one_to_many_low_level::PrefetchGatheredDatapoints<T, ResultElem>(
+        database, result.subspan(end, block_size));
+    DenseDistanceOneToMany<T, ResultElem>(dist, query, database,
+                                          result.subspan(begin, end - begin));
+  }
+}
+
 template <typename T, typename ResultElem, typename DatasetView,
           typename CallbackFunctor>
 void DenseDistanceOneToMany(const DistanceMeasure& dist,
@@ -20,6 +20,8 @@
 #include "scann/distance_measures/one_to_one/common.h"
 #include "scann/distance_measures/one_to_one/dot_product_avx1.h"
 #include "scann/distance_measures/one_to_one/dot_product_avx2.h"
+#include "scann/distance_measures/one_to_one/dot_product_avx512.h"
+#include "scann/distance_measures/one_to_one/dot_product_avx512_vnni.h"
 #include "scann/distance_measures/one_to_one/dot_product_sse4.h"
 #include "scann/utils/intrinsics/flags.h"
 #include "scann/utils/reduction.h"
@@ -182,7 +184,9 @@ inline double DenseDotProduct<uint8_t, uint8_t>(
 template <>
 inline double DenseDotProduct<int8_t, int8_t>(const DatapointPtr<int8_t>& a,
                                               const DatapointPtr<int8_t>& b) {
-  if (RuntimeSupportsSse4()) {
+  if (RuntimeSupportsAvx512Vnni()) {
+    return dp_internal::DenseDotProductAvx512Vnni(a, b);
+  } else if (RuntimeSupportsSse4()) {
     return dp_internal::DenseDotProductSse4(a, b);
   } else {
     return DenseDotProductFallback(a, b);
@@ -192,7 +196,9 @@ inline double DenseDotProduct<int8_t, int8_t>(const DatapointPtr<int8_t>& a,
 template <>
 inline double DenseDotProduct<float, float>(const DatapointPtr<float>& a,
                                             const DatapointPtr<float>& b) {
-  if (RuntimeSupportsSse4()) {
+  if (RuntimeSupportsAvx512()) {
+    return dp_internal::DenseDotProductAvx512(a, b);
+  } else if (RuntimeSupportsSse4()) {
     return dp_internal::DenseDotProductSse4(a, b);
   } else {
     return DenseDotProductFallback(a, b);
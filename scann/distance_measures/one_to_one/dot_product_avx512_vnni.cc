@@ -0,0 +1,87 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "scann/distance_measures/one_to_one/dot_product_avx512_vnni.h"
+#ifdef __x86_64__
+
+#include <x86intrin.h>
+
+#include "scann/data_format/datapoint.h"
+
+namespace tensorflow {
+namespace scann_ops {
+namespace dp_internal {
+namespace {
+
+SCANN_AVX512_VNNI_INLINE int64_t ReduceAddEpi32ToEpi64(__m512i v) {
+  return _mm512_reduce_add_epi64(
+      _mm512_add_epi64(_mm512_cvtepi32_epi64(_mm512_castsi512_si256(v)),
+                       _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(v, 1))));
+}
+
+// Each int32 lane gains at most 4 * 255 * 128 per 64 dimensions, which stays
+// below 2^31 for 2^20 dimensions.  The lanes are flushed into int64 sums at
+// that interval, so there is no dimensionality limit.
+constexpr size_t kDimsPerFlush = size_t{1} << 20;
+
+}  // namespace
+
+SCANN_AVX512_VNNI_OUTLINE double DenseDotProductAvx512Vnni(
+    const DatapointPtr<int8_t>& a, const DatapointPtr<int8_t>& b) {
+  DCHECK_EQ(a.nonzero_entries(), b.nonzero_entries());
+  DCHECK(a.IsDense());
+  DCHECK(b.IsDense());
+  const int8_t* aptr = a.values();
+  const int8_t* bptr = b.values();
+  const size_t dims = a.nonzero_entries();
+
+  const __m512i sign_flip = _mm512_set1_epi8(static_cast<char>(0x80));
+  const __m512i ones = _mm512_set1_epi8(1);
+  __m512i products = _mm512_setzero_si512();
+  __m512i b_sums = _mm512_setzero_si512();
+  auto accumulate = [&](__m512i avals, __m512i bvals)
+                        SCANN_AVX512_VNNI_INLINE_LAMBDA {
+    products = _mm512_dpbusd_epi32(
+        products, _mm512_xor_si512(avals, sign_flip), bvals);
+    b_sums = _mm512_dpbusd_epi32(b_sums, ones, bvals);
+  };
+
+  int64_t product_sum = 0;
+  int64_t b_sum = 0;
+  auto flush = [&]() SCANN_AVX512_VNNI_INLINE_LAMBDA {
+    product_sum += ReduceAddEpi32ToEpi64(products);
+    b_sum += ReduceAddEpi32ToEpi64(b_sums);
+    products = _mm512_setzero_si512();
+    b_sums = _mm512_setzero_si512();
+  };
+
+  size_t j = 0;
+  for (; j + 64 <= dims; j += 64) {
+    accumulate(_mm512_loadu_si512(aptr + j), _mm512_loadu_si512(bptr + j));
+    if ((j + 64) % kDimsPerFlush == 0) flush();
+  }
+  if (j < dims) {
+    const __mmask64 mask = (uint64_t{1} << (dims - j)) - 1;
+    accumulate(_mm512_maskz_loadu_epi8(mask, aptr + j),
+               _mm512_maskz_loadu_epi8(mask, bptr + j));
+  }
+  flush();
+  return static_cast<double>(product_sum - 128 * b_sum);
+}
+
+}  // namespace dp_internal
+}  // namespace scann_ops
+}  // namespace tensorflow
+
+#endif
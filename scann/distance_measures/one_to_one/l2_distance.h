@@ -18,6 +18,7 @@
 #include "scann/distance_measures/distance_measure_base.h"
 #include "scann/distance_measures/one_to_one/common.h"
 #include "scann/distance_measures/one_to_one/l2_distance_avx1.h"
+#include "scann/distance_measures/one_to_one/l2_distance_avx512.h"
 #include "scann/distance_measures/one_to_one/l2_distance_sse4.h"
 #include "scann/utils/intrinsics/flags.h"
 #include "scann/utils/reduction.h"
@@ -205,7 +206,9 @@ inline double DenseSquaredL2Distance<int8_t, int8_t>(
 template <>
 inline double DenseSquaredL2Distance<float, float>(
     const DatapointPtr<float>& a, const DatapointPtr<float>& b) {
-  if (RuntimeSupportsSse4()) {
+  if (RuntimeSupportsAvx512()) {
+    return l2_internal::DenseSquaredL2DistanceAvx512(a, b);
+  } else if (RuntimeSupportsSse4()) {
     return l2_internal::DenseSquaredL2DistanceSse4(a, b);
   } else {
     return DenseSquaredL2DistanceFallback(a, b);
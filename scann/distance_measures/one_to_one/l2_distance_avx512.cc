@@ -0,0 +1,67 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "scann/distance_measures/one_to_one/l2_distance_avx512.h"
+#ifdef __x86_64__
+
+#include "scann/data_format/datapoint.h"
+#include "scann/utils/intrinsics/avx512.h"
+
+namespace tensorflow {
+namespace scann_ops {
+namespace l2_internal {
+
+SCANN_AVX512_OUTLINE double DenseSquaredL2DistanceAvx512(
+    const DatapointPtr<float>& a, const DatapointPtr<float>& b) {
+  DCHECK_EQ(a.nonzero_entries(), b.nonzero_entries());
+  DCHECK(a.IsDense());
+  DCHECK(b.IsDense());
+  const float* aptr = a.values();
+  const float* bptr = b.values();
+  const size_t dims = a.nonzero_entries();
+
+  auto accumulate = [](__m512 acc, __m512 avals,
+                       __m512 bvals) SCANN_AVX512_INLINE_LAMBDA {
+    const __m512 diff = _mm512_sub_ps(avals, bvals);
+    return _mm512_fmadd_ps(diff, diff, acc);
+  };
+  __m512 accumulator0 = _mm512_setzero_ps();
+  __m512 accumulator1 = _mm512_setzero_ps();
+  size_t j = 0;
+  for (; j + 32 <= dims; j += 32) {
+    accumulator0 = accumulate(accumulator0, _mm512_loadu_ps(aptr + j),
+                              _mm512_loadu_ps(bptr + j));
+    accumulator1 = accumulate(accumulator1, _mm512_loadu_ps(aptr + j + 16),
+                              _mm512_loadu_ps(bptr + j + 16));
+  }
+  if (j + 16 <= dims) {
+    accumulator0 = accumulate(accumulator0, _mm512_loadu_ps(aptr + j),
+                              _mm512_loadu_ps(bptr + j));
+    j += 16;
+  }
+  if (j < dims) {
+    const __mmask16 mask = (1u << (dims - j)) - 1;
+    accumulator1 =
+        accumulate(accumulator1, _mm512_maskz_loadu_ps(mask, aptr + j),
+                   _mm512_maskz_loadu_ps(mask, bptr + j));
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(accumulator0, accumulator1));
+}
+
+}  // namespace l2_internal
+}  // namespace scann_ops
+}  // namespace tensorflow
+
+#endif
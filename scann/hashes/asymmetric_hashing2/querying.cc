@@ -14,6 +14,7 @@
 
 #include "scann/hashes/asymmetric_hashing2/querying.h"
 
+#include "scann/oss_wrappers/scann_aligned_malloc.h"
 #include "scann/utils/common.h"
 #include "scann/utils/intrinsics/flags.h"
 
@@ -31,6 +32,9 @@ PackedDataset CreatePackedDataset(
   result.num_datapoints = hashed_database.size();
   result.num_blocks =
       (hashed_database.size() > 0) ? (hashed_database[0].nonzero_entries()) : 0;
+  AdviseLargeAllocation(result.bit_packed_data.data(),
+                        result.bit_packed_data.size(),
+                        result.bit_packed_data.capacity());
   return result;
 }
 
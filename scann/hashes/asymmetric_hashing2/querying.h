@@ -36,6 +36,7 @@
 #include "scann/hashes/internal/asymmetric_hashing_postprocess.h"
 #include "scann/projection/chunking_projection.h"
 #include "scann/proto/hash.pb.h"
+#include "scann/utils/fast_top_neighbors_crowding.h"
 #include "scann/utils/top_n_amortized_constant.h"
 #include "scann/utils/types.h"
 #include "scann/utils/util_functions.h"
@@ -398,6 +399,7 @@ Status FindApproxNeighborsFastTopNeighbors(
   array<FastTopNeighbors<int16_t>*, kNumQueries> ftn_ptrs;
   array<const uint8_t*, kNumQueries> raw_luts;
   array<RestrictAllowlistConstView, kNumQueries> restricts;
+  bool any_restricts_enabled = false;
   for (size_t batch_idx : Seq(kNumQueries)) {
     int32_t fixed_point_max_distance =
         ai::ComputePossiblyFixedPointMaxDistance<int8_t>(
@@ -415,6 +417,7 @@ Status FindApproxNeighborsFastTopNeighbors(
     if (params[batch_idx]->restricts_enabled()) {
       restricts[batch_idx] =
           RestrictAllowlistConstView(*params[batch_idx]->restrict_whitelist());
+      any_restricts_enabled = true;
     } else {
       restricts[batch_idx] = RestrictAllowlistConstView();
     }
@@ -427,7 +430,7 @@ Status FindApproxNeighborsFastTopNeighbors(
   args.first_dp_index = 0;
   args.num_datapoints = packed_dataset.num_datapoints;
   args.fast_topns = {ftn_ptrs.data(), kNumQueries};
-  args.restrict_whitelists = restricts;
+  if (any_restricts_enabled) args.restrict_whitelists = restricts;
   asymmetric_hashing_internal::LUT16Interface::GetTopDistances(std::move(args));
 
   for (size_t batch_idx : Seq(kNumQueries)) {
@@ -450,6 +453,95 @@ Status FindApproxNeighborsFastTopNeighbors(
   return OkStatus();
 }
 
+// Crowded top-N over a LUT16 packed dataset.  crowding_attributes is indexed
+// by the same datapoint indices as packed_dataset.  Results are returned
+// unsorted and already converted back from fixed point.
+inline Status FindApproxNeighborsFastTopNeighborsWithCrowding(
+    const LookupTable& lookup_table, const SearchParameters& params,
+    const PackedDataset& packed_dataset,
+    ConstSpan<int64_t> crowding_attributes, NNResultsVector* result) {
+  if (crowding_attributes.size() != packed_dataset.num_datapoints) {
+    return InvalidArgumentError(
+        "Crowding attributes size (%d) does not match the number of "
+        "datapoints (%d).",
+        crowding_attributes.size(), packed_dataset.num_datapoints);
+  }
+  const size_t max_results = params.pre_reordering_num_neighbors();
+  const size_t per_crowding_attribute_max_results =
+      params.per_crowding_attribute_pre_reordering_num_neighbors();
+  const int32_t fixed_point_max_distance =
+      ai::ComputePossiblyFixedPointMaxDistance<int8_t>(
+          params.pre_reordering_epsilon(), lookup_table.fixed_point_multiplier);
+  const uint8_t* raw_lut = lookup_table.int8_lookup_table.data();
+  const size_t num_32dp_simd_iters =
+      DivRoundUp(packed_dataset.num_datapoints, 32);
+  const float inv_fixed_point_multiplier =
+      1.0f / lookup_table.fixed_point_multiplier;
+
+  auto finish = [&](auto* topn) {
+    ConstSpan<DatapointIndex> ii;
+    ConstSpan<decltype(topn->epsilon())> vv;
+    std::tie(ii, vv) = topn->FinishUnsorted();
+    result->resize(ii.size());
+    for (size_t j : Seq(ii.size())) {
+      (*result)[j] = {ii[j], vv[j] * inv_fixed_point_multiplier};
+    }
+  };
+
+  if (lookup_table.can_use_int16_accumulator) {
+    FastTopNeighborsWithCrowding<int16_t> topn(
+        max_results,
+        std::min<int32_t>(fixed_point_max_distance,
+                          numeric_limits<int16_t>::max() - 1) +
+            1,
+        per_crowding_attribute_max_results, crowding_attributes);
+    FastTopNeighborsWithCrowding<int16_t>* topn_ptr = &topn;
+    RestrictAllowlistConstView restrict;
+    if (params.restricts_enabled()) {
+      restrict = RestrictAllowlistConstView(*params.restrict_whitelist());
+    }
+    ai::LUT16ArgsTopNWithCrowding args;
+    args.packed_dataset = packed_dataset.bit_packed_data.data();
+    args.num_32dp_simd_iters = num_32dp_simd_iters;
+    args.num_blocks = packed_dataset.num_blocks;
+    args.lookups = {&raw_lut, 1};
+    args.first_dp_index = 0;
+    args.num_datapoints = packed_dataset.num_datapoints;
+    args.fast_topns = {&topn_ptr, 1};
+    if (params.restricts_enabled()) args.restrict_whitelists = {&restrict, 1};
+    ai::LUT16Interface::GetTopDistances(std::move(args));
+    finish(&topn);
+    return OkStatus();
+  }
+
+  std::vector<int32_t> distances(num_32dp_simd_iters * 32);
+  int32_t* distances_ptr = distances.data();
+  ai::LUT16Args<int32_t> args;
+  args.packed_dataset = packed_dataset.bit_packed_data.data();
+  args.num_32dp_simd_iters = num_32dp_simd_iters;
+  args.num_blocks = packed_dataset.num_blocks;
+  args.lookups = {&raw_lut, 1};
+  args.distances = {&distances_ptr, 1};
+  ai::LUT16Interface::GetDistances(std::move(args));
+
+  FastTopNeighborsWithCrowding<int32_t> topn(
+      max_results,
+      fixed_point_max_distance == numeric_limits<int32_t>::max()
+          ? fixed_point_max_distance
+          : fixed_point_max_distance + 1,
+      per_crowding_attribute_max_results, crowding_attributes);
+  FastTopNeighborsWithCrowding<int32_t>::Mutator mutator;
+  topn.AcquireMutator(&mutator);
+  for (DatapointIndex dp_idx : Seq(packed_dataset.num_datapoints)) {
+    if (distances[dp_idx] >= mutator.epsilon()) continue;
+    if (params.restricts_enabled() && !params.IsWhitelisted(dp_idx)) continue;
+    if (mutator.Push(dp_idx, distances[dp_idx])) mutator.GarbageCollect();
+  }
+  mutator.Release();
+  finish(&topn);
+  return OkStatus();
+}
+
 }  // namespace asymmetric_hashing2_internal
 
 template <typename T>
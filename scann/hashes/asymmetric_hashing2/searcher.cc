@@ -19,6 +19,7 @@
 #include <math.h>
 
 #include <memory>
+#include <type_traits>
 #include <typeinfo>
 
 #include "scann/base/search_parameters.h"
@@ -28,6 +29,7 @@
 #include "scann/hashes/asymmetric_hashing2/querying.h"
 #include "scann/hashes/asymmetric_hashing2/serialization.h"
 #include "scann/hashes/internal/asymmetric_hashing_postprocess.h"
+#include "scann/oss_wrappers/scann_aligned_malloc.h"
 #include "tensorflow/core/platform/cpu_info.h"
 
 #include "scann/oss_wrappers/scann_serialize.h"
@@ -149,7 +151,10 @@ Searcher<T>::Searcher(shared_ptr<TypedDataset<T>> dataset,
 }
 
 template <typename T>
-Searcher<T>::~Searcher() {}
+Searcher<T>::~Searcher() {
+  UnadviseLargeAllocation(packed_dataset_.bit_packed_data.data(),
+                          packed_dataset_.bit_packed_data.capacity());
+}
 
 template <typename T>
 Status Searcher<T>::FindNeighborsImpl(const DatapointPtr<T>& query,
@@ -231,7 +236,26 @@ Status Searcher<T>::FindNeighborsTopNDispatcher(
     const DatapointPtr<T>& query, const SearchParameters& params,
     PostprocessFunctor postprocessing_functor, NNResultsVector* result) const {
   if (params.pre_reordering_crowding_enabled()) {
-    return FailedPreconditionError("Crowding is not supported.");
+    if (!lut16_ || opts_.symmetric_queryer_ ||
+        !std::is_same_v<PostprocessFunctor,
+                        asymmetric_hashing_internal::
+                            IdentityPostprocessFunctor>) {
+      return FailedPreconditionError(
+          "Crowding is only supported with LUT16 asymmetric hashing and no "
+          "distance postprocessing.");
+    }
+    LookupTable lookup_table_storage;
+    TF_ASSIGN_OR_RETURN(
+        const LookupTable* lookup_table,
+        GetOrCreateLookupTable(query, params, &lookup_table_storage));
+    if (lookup_table->int8_lookup_table.empty()) {
+      return FailedPreconditionError(
+          "Crowding requires an INT8 asymmetric lookup table.");
+    }
+    return asymmetric_hashing2_internal::
+        FindApproxNeighborsFastTopNeighborsWithCrowding(
+            *lookup_table, params, packed_dataset_,
+            this->datapoint_index_to_crowding_attribute(), result);
   } else {
     TopNeighbors<float> top_n(params.pre_reordering_num_neighbors());
     SCANN_RETURN_IF_ERROR(FindNeighborsQueryerDispatcher(
@@ -412,10 +436,8 @@ Searcher<T>::ExtractSingleMachineFactoryOptions() {
       auto opts,
       UntypedSingleMachineSearcherBase::ExtractSingleMachineFactoryOptions());
   if (opts_.asymmetric_queryer_) {
-    auto centers = opts_.asymmetric_queryer_->model()->centers();
-    opts.ah_codebook = std::make_shared<CentersForAllSubspaces>();
-    *opts.ah_codebook =
-        DatasetSpanToCentersProto(centers, opts_.quantization_scheme());
+    opts.ah_codebook = std::make_shared<CentersForAllSubspaces>(
+        opts_.asymmetric_queryer_->model()->ToProto());
     if (opts_.asymmetric_lookup_type_ == AsymmetricHasherConfig::INT8_LUT16)
       opts.hashed_dataset =
           make_shared<DenseDataset<uint8_t>>(UnpackDataset(packed_dataset_));
@@ -423,6 +445,17 @@ Searcher<T>::ExtractSingleMachineFactoryOptions() {
   return opts;
 }
 
+template <typename T>
+void Searcher<T>::ReallocatePackedDataset() {
+  std::vector<uint8_t> reallocated(packed_dataset_.bit_packed_data);
+  UnadviseLargeAllocation(packed_dataset_.bit_packed_data.data(),
+                          packed_dataset_.bit_packed_data.capacity());
+  packed_dataset_.bit_packed_data = std::move(reallocated);
+  AdviseLargeAllocation(packed_dataset_.bit_packed_data.data(),
+                        packed_dataset_.bit_packed_data.size(),
+                        packed_dataset_.bit_packed_data.capacity());
+}
+
 template Status Searcher<float>::FindNeighborsBatchedInternal<
     asymmetric_hashing_internal::IdentityPostprocessFunctor>(
     std::function<DatapointPtr<float>(DatapointIndex)> get_query,
@@ -432,8 +465,10 @@ template Status Searcher<float>::FindNeighborsBatchedInternal<
     MutableSpan<NNResultsVector> results) const;
 
 template <typename T>
-bool Searcher<T>::AddDatasetWithIdsInternel(const TypedDataset<T>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config) {
+bool Searcher<T>::AddDatasetWithIdsInternel(const TypedDataset<T>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config, const AddDatasetAttributes& attributes) {
   if (lut16_) {
+    UnadviseLargeAllocation(packed_dataset_.bit_packed_data.data(),
+                            packed_dataset_.bit_packed_data.capacity());
     packed_dataset_ =
       ::tensorflow::scann_ops::asymmetric_hashing2::CreatePackedDataset(
           *this->hashed_dataset());
@@ -132,12 +132,16 @@ class Searcher final : public SingleMachineSearcherBase<T> {
     return opts_.indexer_;
   }
 
+  // Copies the LUT16 codes into memory first touched by the calling thread,
+  // i.e. onto the calling thread's NUMA node.
+  void ReallocatePackedDataset();
+
   using MutationMetadata = UntypedSingleMachineSearcherBase::MutationMetadata;
 
   StatusOr<SingleMachineFactoryOptions> ExtractSingleMachineFactoryOptions()
       override;
 
-  bool AddDatasetWithIdsInternel(const TypedDataset<T>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config) override; 
+  bool AddDatasetWithIdsInternel(const TypedDataset<T>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config, const AddDatasetAttributes& attributes) override; 
 
  protected:
   Status FindNeighborsImpl(const DatapointPtr<T>& query,
@@ -36,6 +36,25 @@ template <typename T>
 StatusOr<unique_ptr<Model<T>>> TrainSingleMachine(
     const TypedDataset<T>& dataset, const TrainingOptions<T>& params,
     shared_ptr<thread::ThreadPool> pool = nullptr) {
+  if (params.config().projection().projection_type() == ProjectionConfig::OPQ) {
+    if (params.config().quantization_scheme() !=
+        AsymmetricHasherConfig::PRODUCT) {
+      return InvalidArgumentError(
+          "Projection type OPQ is only supported with the PRODUCT "
+          "quantization scheme.");
+    }
+    shared_ptr<DenseDataset<float>> rotation;
+    TF_ASSIGN_OR_RETURN(
+        auto centers,
+        ::tensorflow::scann_ops::asymmetric_hashing_internal::
+            TrainOptimizedProductQuantization(dataset, params, pool,
+                                              &rotation));
+    auto converted = asymmetric_hashing_internal::ConvertCentersIfNecessary<T>(
+        std::move(centers));
+    return Model<T>::FromCenters(std::move(converted),
+                                 params.config().quantization_scheme(),
+                                 std::move(rotation));
+  }
   if (params.config().quantization_scheme() ==
       AsymmetricHasherConfig::STACKED) {
     if (!dataset.IsDense())
@@ -15,6 +15,8 @@
 #include "scann/hashes/asymmetric_hashing2/training_model.h"
 
 #include "scann/data_format/datapoint.h"
+#include "scann/projection/learned_rotation_projection.h"
+#include "scann/projection/projection_factory.h"
 #include "scann/proto/hash.pb.h"
 #include "scann/utils/types.h"
 
@@ -27,7 +29,8 @@ using QuantizationScheme = AsymmetricHasherConfig::QuantizationScheme;
 template <typename T>
 StatusOrPtr<Model<T>> Model<T>::FromCenters(
     vector<DenseDataset<FloatT>> centers,
-    QuantizationScheme quantization_scheme) {
+    QuantizationScheme quantization_scheme,
+    shared_ptr<const DenseDataset<float>> projection_rotation) {
   if (centers.empty()) {
     return InvalidArgumentError("Cannot construct a Model from empty centers.");
   } else if (centers[0].size() < 1 || centers[0].size() > 256) {
@@ -46,8 +49,15 @@ StatusOrPtr<Model<T>> Model<T>::FromCenters(
     }
   }
 
-  return unique_ptr<Model<T>>(
-      new Model<T>(std::move(centers), quantization_scheme));
+  if (projection_rotation &&
+      projection_rotation->size() != projection_rotation->dimensionality()) {
+    return InvalidArgumentError(absl::StrCat(
+        "Projection rotation must be square, got ", projection_rotation->size(),
+        " x ", projection_rotation->dimensionality(), "."));
+  }
+
+  return unique_ptr<Model<T>>(new Model<T>(
+      std::move(centers), quantization_scheme, std::move(projection_rotation)));
 }
 
 template <typename T>
@@ -73,7 +83,20 @@ StatusOr<unique_ptr<Model<T>>> Model<T>::FromProto(
     all_centers[i].ShrinkToFit();
   }
 
-  return FromCenters(std::move(all_centers), proto.quantization_scheme());
+  shared_ptr<DenseDataset<float>> projection_rotation;
+  if (proto.projection_rotation_size() > 0) {
+    projection_rotation = std::make_shared<DenseDataset<float>>();
+    Datapoint<float> row;
+    for (const auto& gfv : proto.projection_rotation()) {
+      row.clear();
+      SCANN_RETURN_IF_ERROR(row.FromGfv(gfv));
+      SCANN_RETURN_IF_ERROR(projection_rotation->Append(row.ToPtr(), ""));
+    }
+    projection_rotation->ShrinkToFit();
+  }
+
+  return FromCenters(std::move(all_centers), proto.quantization_scheme(),
+                     std::move(projection_rotation));
 }
 
 template <typename T>
@@ -90,15 +113,38 @@ CentersForAllSubspaces Model<T>::ToProto() const {
 
   result.set_quantization_scheme(quantization_scheme_);
 
+  if (projection_rotation_) {
+    for (auto row : *projection_rotation_) {
+      *result.add_projection_rotation() = row.ToGfv();
+    }
+  }
+
   return result;
 }
 
+template <typename T>
+StatusOr<unique_ptr<ChunkingProjection<T>>> Model<T>::BuildProjection(
+    const ProjectionConfig& config) const {
+  TF_ASSIGN_OR_RETURN(auto projection, ChunkingProjectionFactory<T>(config));
+  if (projection_rotation_) {
+    projection->set_initial_projection(
+        make_unique<LearnedRotationProjection<T>>(projection_rotation_));
+  } else if (config.projection_type() == ProjectionConfig::OPQ) {
+    return FailedPreconditionError(
+        "Projection type OPQ requires an AH model trained with a learned "
+        "rotation.");
+  }
+  return {std::move(projection)};
+}
+
 template <typename T>
 Model<T>::Model(vector<DenseDataset<FloatT>> centers,
-                QuantizationScheme quantization_scheme)
+                QuantizationScheme quantization_scheme,
+                shared_ptr<const DenseDataset<float>> projection_rotation)
     : centers_(std::move(centers)),
       num_clusters_per_block_(centers_[0].size()),
-      quantization_scheme_(quantization_scheme) {}
+      quantization_scheme_(quantization_scheme),
+      projection_rotation_(std::move(projection_rotation)) {}
 
 template <typename T>
 bool Model<T>::CentersEqual(const Model& rhs) const {
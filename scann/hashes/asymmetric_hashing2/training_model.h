@@ -16,6 +16,7 @@
 #define SCANN__HASHES_ASYMMETRIC_HASHING2_TRAINING_MODEL_H_
 
 #include "scann/data_format/dataset.h"
+#include "scann/projection/chunking_projection.h"
 #include "scann/proto/centers.pb.h"
 #include "scann/proto/hash.pb.h"
 #include "scann/utils/types.h"
@@ -32,7 +33,8 @@ class Model {
   static StatusOr<unique_ptr<Model<T>>> FromCenters(
       std::vector<DenseDataset<FloatT>> centers,
       AsymmetricHasherConfig::QuantizationScheme quantization_scheme =
-          AsymmetricHasherConfig::PRODUCT);
+          AsymmetricHasherConfig::PRODUCT,
+      shared_ptr<const DenseDataset<float>> projection_rotation = nullptr);
 
   static StatusOr<unique_ptr<Model<T>>> FromProto(
       const CentersForAllSubspaces& proto);
@@ -49,12 +51,19 @@ class Model {
     return quantization_scheme_;
   }
 
+  const shared_ptr<const DenseDataset<float>>& projection_rotation() const {
+    return projection_rotation_;
+  }
+
+  StatusOr<unique_ptr<ChunkingProjection<T>>> BuildProjection(
+      const ProjectionConfig& config) const;
+
   bool CentersEqual(const Model& rhs) const;
 
  private:
-  explicit Model(
-      std::vector<DenseDataset<FloatT>> centers,
-      AsymmetricHasherConfig::QuantizationScheme quantization_scheme);
+  Model(std::vector<DenseDataset<FloatT>> centers,
+        AsymmetricHasherConfig::QuantizationScheme quantization_scheme,
+        shared_ptr<const DenseDataset<float>> projection_rotation);
 
   std::vector<DenseDataset<FloatT>> centers_ = {};
 
@@ -63,6 +72,8 @@ class Model {
   AsymmetricHasherConfig::QuantizationScheme quantization_scheme_ =
       AsymmetricHasherConfig::PRODUCT;
 
+  shared_ptr<const DenseDataset<float>> projection_rotation_;
+
   TF_DISALLOW_COPY_AND_ASSIGN(Model);
 };
 
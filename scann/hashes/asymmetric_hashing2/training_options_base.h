@@ -72,6 +72,7 @@ class TrainingOptionsTyped : public TrainingOptionsBase {
     return projector_;
   }
 
+  // Called concurrently from the training pool threads; must be thread-safe.
   using PreprocessingFunction =
       std::function<StatusOr<Datapoint<T>>(const DatapointPtr<T>&)>;
   void set_preprocessing_function(PreprocessingFunction fn) {
@@ -16,6 +16,8 @@
 
 #include <numeric>
 
+#include "Eigen/Dense"
+#include "Eigen/SVD"
 #include "absl/random/distributions.h"
 #include "scann/data_format/datapoint.h"
 #include "scann/distance_measures/one_to_many/one_to_many.h"
@@ -26,6 +28,7 @@
 #include "scann/utils/common.h"
 #include "scann/utils/gmm_utils.h"
 #include "scann/utils/noise_shaping_utils.h"
+#include "scann/utils/parallel_for.h"
 #include "scann/utils/top_n_amortized_constant.h"
 #include "scann/utils/types.h"
 
@@ -97,8 +100,38 @@ double ComputeNormBiasCorrection(const DenseDataset<double>& db,
   return (center_norm == 0.0) ? 1.0 : (mean_norm / center_norm);
 }
 
+Status AnisotropicRefineCodebooks(
+    ConstSpan<DenseDataset<double>> chunked_dataset, double threshold,
+    int num_iterations, thread::ThreadPool* pool,
+    MutableSpan<DenseDataset<double>> centers,
+    MutableSpan<vector<uint32_t>> cluster_sizes);
+
 }  // namespace
 
+vector<DatapointIndex> SampleTrainingIndices(
+    const AsymmetricHasherConfig& config, DatapointIndex dataset_size) {
+  const float sampling_fraction =
+      config.has_expected_sample_size()
+          ? std::min(1.0, static_cast<double>(config.expected_sample_size()) /
+                              static_cast<double>(dataset_size))
+          : config.sampling_fraction();
+
+  MTRandom rng(kDeterministicSeed * (config.sampling_seed() + 1));
+  vector<DatapointIndex> sample;
+  for (DatapointIndex i = 0; i < dataset_size; ++i) {
+    if (absl::Uniform<double>(rng, 0, 1.0) < sampling_fraction) {
+      sample.push_back(i);
+    }
+  }
+
+  if (sample.size() > config.max_sample_size()) {
+    std::shuffle(sample.begin(), sample.end(), rng);
+    sample.resize(config.max_sample_size());
+    std::sort(sample.begin(), sample.end());
+  }
+  return sample;
+}
+
 template <typename T>
 StatusOr<vector<DenseDataset<double>>> AhImpl<T>::TrainAsymmetricHashing(
     const TypedDataset<T>& dataset, const TrainingOptionsT& opts,
@@ -121,34 +154,8 @@ StatusOr<vector<DenseDataset<double>>> AhImpl<T>::TrainAsymmetricHashing(
   int32_t num_blocks = chunked_vec.size();
   vector<DenseDataset<double>> chunked_dataset(num_blocks);
 
-  const float sampling_fraction =
-      opts.config().has_expected_sample_size()
-          ? std::min(1.0,
-                     static_cast<double>(opts.config().expected_sample_size()) /
-                         static_cast<double>(dataset.size()))
-          : opts.config().sampling_fraction();
-
-  if (sampling_fraction == 1.0) {
-    for (int32_t i = 0; i < num_blocks; ++i) {
-      DenseDataset<double>& ds = chunked_dataset[i];
-      ds.set_dimensionality(chunked_vec[i].dimensionality());
-      ds.Reserve(dataset.size());
-    }
-  }
-
-  MTRandom rng(kDeterministicSeed * (opts.config().sampling_seed() + 1));
-  vector<DatapointIndex> sample;
-  for (DatapointIndex i = 0; i < dataset.size(); ++i) {
-    if (absl::Uniform<double>(rng, 0, 1.0) < sampling_fraction) {
-      sample.push_back(i);
-    }
-  }
-
-  if (sample.size() > opts.config().max_sample_size()) {
-    std::shuffle(sample.begin(), sample.end(), rng);
-    sample.resize(opts.config().max_sample_size());
-    std::sort(sample.begin(), sample.end());
-  }
+  const vector<DatapointIndex> sample =
+      SampleTrainingIndices(opts.config(), dataset.size());
 
   if (sample.size() < opts.config().num_clusters_per_block()) {
     return InvalidArgumentError(absl::StrCat(
@@ -158,34 +165,50 @@ StatusOr<vector<DenseDataset<double>>> AhImpl<T>::TrainAsymmetricHashing(
         sample.size(), ")."));
   }
 
-  auto append_chunked_blocks = [&] {
-    for (size_t j = 0; j < num_blocks; ++j) {
-      chunked_dataset[j].AppendOrDie(chunked_vec[j], "");
-    }
-  };
-
-  if (opts.preprocessing_function()) {
-    for (DatapointIndex i : sample) {
-      TF_ASSIGN_OR_RETURN(Datapoint<T> preprocessed,
-                          opts.preprocessing_function()(dataset[i]));
-      SCANN_RETURN_IF_ERROR(
-          opts.projector()->ProjectInput(preprocessed.ToPtr(), &chunked_vec));
-      append_chunked_blocks();
-    }
-  } else {
-    for (DatapointIndex i : sample) {
-      SCANN_RETURN_IF_ERROR(
-          opts.projector()->ProjectInput(dataset[i], &chunked_vec));
-      append_chunked_blocks();
-    }
+  for (int32_t i = 0; i < num_blocks; ++i) {
+    vector<double> storage(sample.size() * chunked_vec[i].dimensionality());
+    chunked_dataset[i] = DenseDataset<double>(std::move(storage), sample.size());
   }
 
+  // preprocessing_function runs concurrently on the pool threads.
+  SCANN_RETURN_IF_ERROR(ParallelForWithStatus<128>(
+      IndicesOf(sample), pool.get(), [&](size_t sample_idx) -> Status {
+        ChunkedDatapoint<double> chunked;
+        const DatapointIndex dp_idx = sample[sample_idx];
+        if (opts.preprocessing_function()) {
+          TF_ASSIGN_OR_RETURN(Datapoint<T> preprocessed,
+                              opts.preprocessing_function()(dataset[dp_idx]));
+          SCANN_RETURN_IF_ERROR(
+              opts.projector()->ProjectInput(preprocessed.ToPtr(), &chunked));
+        } else {
+          SCANN_RETURN_IF_ERROR(
+              opts.projector()->ProjectInput(dataset[dp_idx], &chunked));
+        }
+        for (size_t j = 0; j < num_blocks; ++j) {
+          ConstSpan<double> block = chunked[j].values_slice();
+          MutableSpan<double> dst = chunked_dataset[j].mutable_data(sample_idx);
+          DCHECK_EQ(block.size(), dst.size());
+          std::copy(block.begin(), block.end(), dst.begin());
+        }
+        return OkStatus();
+      }));
+
+  const bool train_blocks_in_parallel =
+      opts.config().train_blocks_in_parallel() && pool && num_blocks > 1;
+  const bool use_anisotropic_training =
+      opts.config().use_anisotropic_codebook_training();
+  if (use_anisotropic_training &&
+      std::isnan(opts.config().noise_shaping_threshold())) {
+    return InvalidArgumentError(
+        "use_anisotropic_codebook_training requires noise_shaping_threshold "
+        "to be set.");
+  }
   auto quantization_distance = opts.quantization_distance();
   GmmUtils::Options gmm_opts;
   gmm_opts.seed = opts.config().clustering_seed();
   gmm_opts.max_iterations = opts.config().max_clustering_iterations();
   gmm_opts.epsilon = opts.config().clustering_convergence_tolerance();
-  gmm_opts.parallelization_pool = std::move(pool);
+  if (!train_blocks_in_parallel) gmm_opts.parallelization_pool = pool;
   if (!std::isnan(opts.config().noise_shaping_threshold()) &&
       opts.config().use_noise_shaped_training()) {
     gmm_opts.parallel_cost_multiplier = ComputeParallelCostMultiplier(
@@ -194,13 +217,13 @@ StatusOr<vector<DenseDataset<double>>> AhImpl<T>::TrainAsymmetricHashing(
     d->set_parallel_cost_multiplier(gmm_opts.parallel_cost_multiplier);
     quantization_distance = d;
   }
-  GmmUtils gmm(quantization_distance, gmm_opts);
 
-  vector<DenseDataset<double>> all_centers(num_blocks);
-  for (size_t i : Seq(num_blocks)) {
-    DenseDataset<double> centers;
+  vector<DenseDataset<double>> block_centers(num_blocks);
+  vector<vector<uint32_t>> cluster_sizes(num_blocks);
+  auto train_block = [&](size_t i, GmmUtils* gmm) -> Status {
+    DenseDataset<double>& centers = block_centers[i];
     vector<vector<DatapointIndex>> subpartitions;
-    SCANN_RETURN_IF_ERROR(gmm.GenericKmeans(
+    SCANN_RETURN_IF_ERROR(gmm->GenericKmeans(
         chunked_dataset[i], opts.config().num_clusters_per_block(), &centers,
         &subpartitions));
 
@@ -214,15 +237,53 @@ StatusOr<vector<DenseDataset<double>>> AhImpl<T>::TrainAsymmetricHashing(
       }
     }
 
-    chunked_dataset[i].clear();
-    chunked_dataset[i].ShrinkToFit();
+    cluster_sizes[i].resize(subpartitions.size());
+    for (size_t center_idx : IndicesOf(subpartitions)) {
+      cluster_sizes[i][center_idx] = subpartitions[center_idx].size();
+    }
+    if (!use_anisotropic_training) {
+      chunked_dataset[i].clear();
+      chunked_dataset[i].ShrinkToFit();
+    }
+    return OkStatus();
+  };
 
+  if (train_blocks_in_parallel) {
+    VLOG(1) << "Training " << num_blocks << " AH blocks concurrently on "
+            << pool->NumThreads() + 1 << " thread(s).";
+    SCANN_RETURN_IF_ERROR(
+        ParallelForWithStatus<1>(Seq(num_blocks), pool.get(), [&](size_t i) {
+          GmmUtils::Options block_gmm_opts = gmm_opts;
+          block_gmm_opts.seed = gmm_opts.seed + i;
+          GmmUtils gmm(quantization_distance, block_gmm_opts);
+          return train_block(i, &gmm);
+        }));
+  } else {
+    GmmUtils gmm(quantization_distance, gmm_opts);
+    for (size_t i : Seq(num_blocks)) {
+      SCANN_RETURN_IF_ERROR(train_block(i, &gmm));
+    }
+  }
+
+  if (use_anisotropic_training) {
+    SCANN_RETURN_IF_ERROR(AnisotropicRefineCodebooks(
+        chunked_dataset, opts.config().noise_shaping_threshold(),
+        opts.config().anisotropic_training_iterations(), pool.get(),
+        MakeMutableSpan(block_centers), MakeMutableSpan(cluster_sizes)));
+    for (size_t i : Seq(num_blocks)) {
+      chunked_dataset[i].clear();
+      chunked_dataset[i].ShrinkToFit();
+    }
+  }
+
+  vector<DenseDataset<double>> all_centers(num_blocks);
+  for (size_t i : Seq(num_blocks)) {
+    const DenseDataset<double>& centers = block_centers[i];
+    ConstSpan<uint32_t> sizes = cluster_sizes[i];
     vector<uint32_t> centers_permutation(centers.size());
     std::iota(centers_permutation.begin(), centers_permutation.end(), 0U);
     std::sort(centers_permutation.begin(), centers_permutation.end(),
-              [&subpartitions](uint32_t a, uint32_t b) {
-                return subpartitions[a].size() > subpartitions[b].size();
-              });
+              [sizes](uint32_t a, uint32_t b) { return sizes[a] > sizes[b]; });
 
     constexpr size_t kAssumedCacheLineSize = 64;
     constexpr size_t kFloatsPerCacheLine =
@@ -247,6 +308,108 @@ StatusOr<vector<DenseDataset<double>>> AhImpl<T>::TrainAsymmetricHashing(
   return std::move(all_centers);
 }
 
+template <typename T>
+StatusOr<vector<DenseDataset<double>>>
+AhImpl<T>::TrainOptimizedProductQuantization(
+    const TypedDataset<T>& dataset, const TrainingOptionsT& opts,
+    shared_ptr<thread::ThreadPool> pool,
+    shared_ptr<DenseDataset<float>>* rotation) {
+  SCANN_RET_CHECK(rotation != nullptr);
+  if (!std::is_floating_point<T>::value) {
+    return InvalidArgumentError(
+        "Projection type OPQ requires floating-point training data.");
+  }
+  if (!dataset.IsDense()) {
+    return InvalidArgumentError(
+        "Projection type OPQ can only be trained on dense datasets.");
+  }
+  if (opts.preprocessing_function()) {
+    return UnimplementedError(
+        "Projection type OPQ does not support preprocessing functions.");
+  }
+  if (dataset.empty()) {
+    return InvalidArgumentError("Cannot train AH on an empty dataset.");
+  }
+
+  const DimensionIndex dims = dataset.dimensionality();
+  const vector<DatapointIndex> sample =
+      SampleTrainingIndices(opts.config(), dataset.size());
+  const size_t num_samples = sample.size();
+  Eigen::MatrixXd x(dims, num_samples);
+  ParallelFor<128>(Seq(num_samples), pool.get(), [&](size_t j) {
+    const DatapointPtr<T> dptr = dataset[sample[j]];
+    for (size_t d : Seq(dims)) {
+      x(d, j) = static_cast<double>(dptr.values()[d]);
+    }
+  });
+
+  TrainingOptionsT rotated_opts = opts;
+  rotated_opts.mutable_config()->clear_expected_sample_size();
+  rotated_opts.mutable_config()->clear_max_sample_size();
+  rotated_opts.mutable_config()->set_sampling_fraction(1.0);
+
+  Eigen::MatrixXd r = Eigen::MatrixXd::Identity(dims, dims);
+  Eigen::MatrixXd y(dims, num_samples);
+  vector<DenseDataset<double>> centers;
+  const int num_iterations = opts.config().projection().opq_iterations();
+  for (int iteration = 0;; ++iteration) {
+    y.noalias() = r * x;
+    vector<T> rotated_storage(y.size());
+    std::transform(y.data(), y.data() + y.size(), rotated_storage.begin(),
+                   [](double v) { return static_cast<T>(v); });
+    DenseDataset<T> rotated(std::move(rotated_storage), num_samples);
+    TF_ASSIGN_OR_RETURN(centers,
+                        TrainAsymmetricHashing(rotated, rotated_opts, pool));
+    if (iteration >= num_iterations) break;
+
+    Eigen::MatrixXd reconstructed = Eigen::MatrixXd::Zero(dims, num_samples);
+    ParallelFor<64>(Seq(num_samples), pool.get(), [&](size_t j) {
+      size_t offset = 0;
+      for (const DenseDataset<double>& block_centers : centers) {
+        const size_t block_dims = block_centers.dimensionality();
+        double best_distance = numeric_limits<double>::infinity();
+        size_t best_center = 0;
+        for (size_t c : IndicesOf(block_centers)) {
+          const double* center = block_centers[c].values();
+          double distance = 0.0;
+          for (size_t d : Seq(block_dims)) {
+            const double v = offset + d < dims ? y(offset + d, j) : 0.0;
+            distance += Square(v - center[d]);
+          }
+          if (distance < best_distance) {
+            best_distance = distance;
+            best_center = c;
+          }
+        }
+        const double* center = block_centers[best_center].values();
+        for (size_t d = 0; d < block_dims && offset + d < dims; ++d) {
+          reconstructed(offset + d, j) = center[d];
+        }
+        offset += block_dims;
+      }
+    });
+    VLOG(1) << "OPQ iteration " << iteration << ": mean distortion = "
+            << (y - reconstructed).squaredNorm() / num_samples;
+
+    Eigen::BDCSVD<Eigen::MatrixXd> svd(
+        reconstructed * x.transpose(), Eigen::ComputeFullU | Eigen::ComputeFullV);
+    r = svd.matrixU() * svd.matrixV().transpose();
+  }
+
+  auto result_rotation = std::make_shared<DenseDataset<float>>();
+  result_rotation->set_dimensionality(dims);
+  result_rotation->Reserve(dims);
+  vector<float> row(dims);
+  for (size_t i : Seq(dims)) {
+    for (size_t d : Seq(dims)) {
+      row[d] = static_cast<float>(r(i, d));
+    }
+    SCANN_RETURN_IF_ERROR(result_rotation->Append(MakeDatapointPtr(row), ""));
+  }
+  *rotation = std::move(result_rotation);
+  return std::move(centers);
+}
+
 template <typename T>
 Status AhImpl<T>::IndexDatapoint(const DatapointPtr<T>& input,
                                  const ChunkingProjection<T>& projection,
@@ -538,6 +701,132 @@ Status CoordinateDescentAHQuantize(
   return OkStatus();
 }
 
+Status AnisotropicRefineCodebooks(
+    ConstSpan<DenseDataset<double>> chunked_dataset, double threshold,
+    int num_iterations, thread::ThreadPool* pool,
+    MutableSpan<DenseDataset<double>> centers,
+    MutableSpan<vector<uint32_t>> cluster_sizes) {
+  const size_t num_blocks = chunked_dataset.size();
+  SCANN_RET_CHECK_GE(num_blocks, 1);
+  SCANN_RET_CHECK_EQ(centers.size(), num_blocks);
+  SCANN_RET_CHECK_EQ(cluster_sizes.size(), num_blocks);
+  const size_t num_datapoints = chunked_dataset[0].size();
+  const size_t num_centers = centers[0].size();
+  SCANN_RET_CHECK_LE(num_centers, 256);
+  DimensionIndex dimensionality = 0;
+  for (const auto& block : chunked_dataset) {
+    SCANN_RET_CHECK_EQ(block.size(), num_datapoints);
+    dimensionality += block.dimensionality();
+  }
+
+  vector<double> inv_norms(num_datapoints);
+  vector<double> parallel_cost_multipliers(num_datapoints);
+  ParallelFor<256>(Seq(num_datapoints), pool, [&](size_t dp_idx) {
+    double squared_norm = 0.0;
+    for (const auto& block : chunked_dataset) {
+      squared_norm += SquaredL2Norm(block[dp_idx]);
+    }
+    inv_norms[dp_idx] = squared_norm > 0.0 ? 1.0 / std::sqrt(squared_norm) : 0.0;
+    const double multiplier =
+        ComputeParallelCostMultiplier(threshold, squared_norm, dimensionality);
+    parallel_cost_multipliers[dp_idx] =
+        (std::isfinite(multiplier) && multiplier > 0.0) ? multiplier : 1.0;
+  });
+
+  vector<uint8_t> codes(num_datapoints * num_blocks);
+  vector<double> parallel_residuals(num_datapoints);
+  vector<double> losses(num_datapoints);
+  for (int iteration : Seq(num_iterations)) {
+    ParallelFor<16>(Seq(num_datapoints), pool, [&](size_t dp_idx) {
+      vector<std::vector<SubspaceResidualStats>> residual_stats(num_blocks);
+      for (size_t block_idx : Seq(num_blocks)) {
+        ConstSpan<double> x = chunked_dataset[block_idx][dp_idx].values_slice();
+        residual_stats[block_idx].resize(num_centers);
+        for (size_t center_idx : Seq(num_centers)) {
+          residual_stats[block_idx][center_idx] =
+              ComputeResidualStatsForCluster<double>(
+                  x, x, inv_norms[dp_idx],
+                  centers[block_idx][center_idx].values_slice());
+        }
+      }
+
+      MutableSpan<uint8_t> code(codes.data() + dp_idx * num_blocks,
+                                num_blocks);
+      InitializeToMinResidualNorm(residual_stats, code);
+      double parallel_residual =
+          ComputeParallelResidualComponent(code, residual_stats);
+      enum { kMaxRounds = 10 };
+      bool cur_round_changes = true;
+      for (int round = 0; cur_round_changes && round < kMaxRounds; ++round) {
+        cur_round_changes = false;
+        for (size_t block_idx : Seq(num_blocks)) {
+          auto block_result = OptimizeSingleSubspace(
+              residual_stats[block_idx], code[block_idx], parallel_residual,
+              parallel_cost_multipliers[dp_idx]);
+          if (block_result.new_center_idx != code[block_idx]) {
+            code[block_idx] = block_result.new_center_idx;
+            parallel_residual = block_result.new_parallel_residual_component;
+            cur_round_changes = true;
+          }
+        }
+      }
+
+      double residual_norm = 0.0;
+      for (size_t block_idx : Seq(num_blocks)) {
+        residual_norm += residual_stats[block_idx][code[block_idx]].residual_norm;
+      }
+      parallel_residuals[dp_idx] = parallel_residual;
+      losses[dp_idx] = residual_norm + (parallel_cost_multipliers[dp_idx] - 1.0) *
+                                           Square(parallel_residual);
+    });
+    VLOG(1) << "Anisotropic AH training iteration " << iteration
+            << ": mean loss = "
+            << std::accumulate(losses.begin(), losses.end(), 0.0) /
+                   num_datapoints;
+
+    ParallelFor<1>(Seq(num_blocks), pool, [&](size_t block_idx) {
+      const DenseDataset<double>& block = chunked_dataset[block_idx];
+      DenseDataset<double>& block_centers = centers[block_idx];
+      const size_t dims = block.dimensionality();
+      vector<Eigen::MatrixXd> lhs(num_centers,
+                                  Eigen::MatrixXd::Zero(dims, dims));
+      vector<Eigen::VectorXd> rhs(num_centers, Eigen::VectorXd::Zero(dims));
+      vector<uint32_t>& sizes = cluster_sizes[block_idx];
+      sizes.assign(num_centers, 0);
+      for (size_t dp_idx : Seq(num_datapoints)) {
+        const uint8_t center_idx = codes[dp_idx * num_blocks + block_idx];
+        Eigen::Map<const Eigen::VectorXd> x(block[dp_idx].values(), dims);
+        Eigen::Map<const Eigen::VectorXd> center(
+            block_centers[center_idx].values(), dims);
+        const Eigen::VectorXd direction = x * inv_norms[dp_idx];
+        const double excess_parallel_cost =
+            parallel_cost_multipliers[dp_idx] - 1.0;
+        const double other_blocks_parallel_residual =
+            parallel_residuals[dp_idx] - (x - center).dot(direction);
+        lhs[center_idx] +=
+            excess_parallel_cost * direction * direction.transpose();
+        rhs[center_idx] +=
+            x + excess_parallel_cost *
+                    (x.dot(direction) + other_blocks_parallel_residual) *
+                    direction;
+        ++sizes[center_idx];
+      }
+
+      for (size_t center_idx : Seq(num_centers)) {
+        if (sizes[center_idx] == 0) continue;
+        lhs[center_idx] += sizes[center_idx] * Eigen::MatrixXd::Identity(dims, dims);
+        const Eigen::VectorXd new_center =
+            lhs[center_idx].ldlt().solve(rhs[center_idx]);
+        MutableSpan<double> mut_center = block_centers.mutable_data(center_idx);
+        for (size_t d : Seq(dims)) {
+          mut_center[d] = new_center(d);
+        }
+      }
+    });
+  }
+  return OkStatus();
+}
+
 }  // namespace
 
 template <typename T>
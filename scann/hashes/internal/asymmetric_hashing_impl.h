@@ -53,6 +53,9 @@ inline std::vector<DenseDataset<double>> ConvertCentersIfNecessary<double>(
   return double_centers;
 }
 
+vector<DatapointIndex> SampleTrainingIndices(
+    const AsymmetricHasherConfig& config, DatapointIndex dataset_size);
+
 template <typename T>
 struct AhImpl {
   using FloatT = FloatingTypeFor<T>;
@@ -62,6 +65,12 @@ struct AhImpl {
       const TypedDataset<T>& dataset, const TrainingOptionsT& opts,
       shared_ptr<thread::ThreadPool> pool);
 
+  static StatusOr<std::vector<DenseDataset<double>>>
+  TrainOptimizedProductQuantization(
+      const TypedDataset<T>& dataset, const TrainingOptionsT& opts,
+      shared_ptr<thread::ThreadPool> pool,
+      shared_ptr<DenseDataset<float>>* rotation);
+
   static Status IndexDatapoint(const DatapointPtr<T>& input,
                                const ChunkingProjection<T>& projection,
                                const DistanceMeasure& quantization_distance,
@@ -97,6 +106,16 @@ StatusOr<std::vector<DenseDataset<double>>> TrainAsymmetricHashing(
   return AhImpl<T>::TrainAsymmetricHashing(dataset, opts, std::move(pool));
 }
 
+template <typename T>
+StatusOr<std::vector<DenseDataset<double>>> TrainOptimizedProductQuantization(
+    const TypedDataset<T>& dataset,
+    const asymmetric_hashing2::TrainingOptionsTyped<T>& opts,
+    shared_ptr<thread::ThreadPool> pool,
+    shared_ptr<DenseDataset<float>>* rotation) {
+  return AhImpl<T>::TrainOptimizedProductQuantization(dataset, opts,
+                                                      std::move(pool), rotation);
+}
+
 template <typename T>
 Status IndexDatapoint(const DatapointPtr<T>& input,
                       const ChunkingProjection<T>& projection,
@@ -17,6 +17,7 @@
 
 #include "scann/base/restrict_allowlist.h"
 #include "scann/utils/fast_top_neighbors.h"
+#include "scann/utils/fast_top_neighbors_crowding.h"
 #include "scann/utils/types.h"
 
 namespace tensorflow {
@@ -80,6 +81,19 @@ struct LUT16ArgsTopNBase : public LUT16Args<DistT> {
   }
 };
 
+template <size_t kNumWords = 1, typename Word, size_t kNumQueries>
+SCANN_INLINE bool AllQueriesRestrictedOut(
+    const array<const Word*, kNumQueries>& restrict_whitelist_ptrs,
+    size_t first_word) {
+  for (size_t j : Seq(kNumQueries)) {
+    if (!restrict_whitelist_ptrs[j]) return false;
+    for (size_t w : Seq(kNumWords)) {
+      if (restrict_whitelist_ptrs[j][first_word + w]) return false;
+    }
+  }
+  return true;
+}
+
 template <typename Dist, typename TopN = FastTopNeighbors<Dist>>
 struct LUT16ArgsTopN : public LUT16ArgsTopNBase<Dist, TopN> {};
 
@@ -92,6 +106,9 @@ struct LUT16ArgsTopN<float, TopN> : public LUT16ArgsTopNBase<float, TopN> {
   std::function<bool(DatapointIndex)> final_predicate;
 };
 
+using LUT16ArgsTopNWithCrowding =
+    LUT16ArgsTopN<int16_t, FastTopNeighborsWithCrowding<int16_t>>;
+
 #define SCANN_INSTANTIATE_CLASS_FOR_LUT16_BATCH_SIZES(EXTERN_KEYWORD, \
                                                       ClassName)      \
   EXTERN_KEYWORD template class ClassName<1, true>;                   \
@@ -355,6 +355,7 @@ SCANN_AVX2_INLINE void GetTopInt16DistancesImpl(
   auto restrict_whitelist_ptrs =
       args.template GetRestrictWhitelistPtrs<kNumQueries>();
   for (DatapointIndex k : Seq(num_32dp_simd_iters)) {
+    if (AllQueriesRestrictedOut(restrict_whitelist_ptrs, k)) continue;
     const uint8_t* data_start = packed_dataset + k * 16 * num_blocks;
     auto int16_accumulators = Avx2LUT16MiddleLoop<kNumQueries, kPrefetch>(
         data_start, lookups, num_blocks);
@@ -410,6 +411,12 @@ SCANN_AVX2_OUTLINE void LUT16Avx2<kNumQueries, kPrefetch>::GetTopInt16Distances(
   return GetTopInt16DistancesImpl<kNumQueries, kPrefetch>(std::move(args));
 }
 
+template <size_t kNumQueries, bool kPrefetch>
+SCANN_AVX2_OUTLINE void LUT16Avx2<kNumQueries, kPrefetch>::GetTopInt16Distances(
+    LUT16ArgsTopNWithCrowding args) {
+  return GetTopInt16DistancesImpl<kNumQueries, kPrefetch>(std::move(args));
+}
+
 SCANN_AVX2_INLINE int16_t GetInt16Threshold(float float_threshold) {
   constexpr float kMaxValue = numeric_limits<int16_t>::max();
 
@@ -457,6 +464,7 @@ SCANN_AVX2_INLINE void GetTopFloatDistancesImpl(
   auto restrict_whitelist_ptrs =
       args.template GetRestrictWhitelistPtrs<kNumQueries>();
   for (DatapointIndex k : Seq(num_32dp_simd_iters)) {
+    if (AllQueriesRestrictedOut(restrict_whitelist_ptrs, k)) continue;
     const uint8_t* data_start = packed_dataset + k * 16 * num_blocks;
     auto int16_accumulators = Avx2LUT16MiddleLoop<kNumQueries, kPrefetch>(
         data_start, lookups, num_blocks);
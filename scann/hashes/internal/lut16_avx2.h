@@ -33,6 +33,8 @@ class LUT16Avx2 {
 
   SCANN_AVX2_OUTLINE static void GetTopInt16Distances(
       LUT16ArgsTopN<int16_t> args);
+  SCANN_AVX2_OUTLINE static void GetTopInt16Distances(
+      LUT16ArgsTopNWithCrowding args);
   SCANN_AVX2_OUTLINE static void GetTopFloatDistances(
       LUT16ArgsTopN<float> args);
 
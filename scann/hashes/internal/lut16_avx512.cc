@@ -29,6 +29,7 @@ namespace scann_ops {
 namespace avx512 {
 namespace lut16 {
 
+using asymmetric_hashing_internal::AllQueriesRestrictedOut;
 using asymmetric_hashing_internal::LUT16Args;
 using asymmetric_hashing_internal::LUT16ArgsTopN;
 
@@ -600,6 +601,14 @@ SCANN_AVX512_OUTLINE void GetTopDistancesImpl(LUT16ArgsTopN<T, TopN> args) {
   while (num_32dp_simd_iters >= 8) {
     num_32dp_simd_iters -= 8;
     constexpr size_t kNumDatapoints = 256;
+    if constexpr (!kIgnoreWhitelist) {
+      if (AllQueriesRestrictedOut<4>(whitelist_ptrs, 0)) {
+        for (size_t j : Seq(kNumQueries)) whitelist_ptrs[j] += 4;
+        data_start += kNumDatapoints * num_codes_per_dp / 2;
+        first_dp_index += kNumDatapoints;
+        continue;
+      }
+    }
     Avx512For<int16_t, kNumQueries, kNumDatapoints> int16_dists =
         Int16MiddleLoop<kNumDatapoints, kNumQueries, Tuning>(
             data_start, lookups, num_codes_per_dp);
@@ -669,6 +678,14 @@ SCANN_AVX512_OUTLINE void GetTopDistancesImpl(LUT16ArgsTopN<T, TopN> args) {
   while (num_32dp_simd_iters >= 4) {
     num_32dp_simd_iters -= 4;
     constexpr size_t kNumDatapoints = 128;
+    if constexpr (!kIgnoreWhitelist) {
+      if (AllQueriesRestrictedOut<2>(whitelist_ptrs, 0)) {
+        for (size_t j : Seq(kNumQueries)) whitelist_ptrs[j] += 2;
+        data_start += kNumDatapoints * num_codes_per_dp / 2;
+        first_dp_index += kNumDatapoints;
+        continue;
+      }
+    }
     Avx512For<int16_t, kNumQueries, kNumDatapoints> int16_dists =
         Int16MiddleLoop<kNumDatapoints, kNumQueries, Tuning>(
             data_start, lookups, num_codes_per_dp);
@@ -735,6 +752,17 @@ SCANN_AVX512_OUTLINE void GetTopDistancesImpl(LUT16ArgsTopN<T, TopN> args) {
   }
 
   for (size_t k : Seq(num_32dp_simd_iters)) {
+    if constexpr (!kIgnoreWhitelist) {
+      array<const uint32_t*, kNumQueries> whitelist_ptrs32;
+      for (size_t j : Seq(kNumQueries)) {
+        whitelist_ptrs32[j] =
+            reinterpret_cast<const uint32_t*>(whitelist_ptrs[j]);
+      }
+      if (AllQueriesRestrictedOut(whitelist_ptrs32, k)) {
+        data_start += 32 * num_codes_per_dp / 2;
+        continue;
+      }
+    }
     Avx512For<int16_t, kNumQueries, 32> int16_dists =
         Int16MiddleLoop<32, kNumQueries, Tuning>(data_start, lookups,
                                                  num_codes_per_dp);
@@ -807,6 +835,20 @@ void LUT16Avx512<kNumQueries, kPrefetch>::GetTopInt16Distances(
   }
 }
 
+template <size_t kNumQueries, bool kPrefetch>
+void LUT16Avx512<kNumQueries, kPrefetch>::GetTopInt16Distances(
+    LUT16ArgsTopNWithCrowding args) {
+  using Tuning = LUT16Tuning<kPrefetch>;
+
+  if (args.restrict_whitelists.empty()) {
+    return GetTopDistancesImpl<int16_t, kNumQueries, Tuning, true>(
+        std::move(args));
+  } else {
+    return GetTopDistancesImpl<int16_t, kNumQueries, Tuning, false>(
+        std::move(args));
+  }
+}
+
 template <size_t kNumQueries, bool kPrefetch>
 void LUT16Avx512<kNumQueries, kPrefetch>::GetTopFloatDistances(
     LUT16ArgsTopN<float> args) {
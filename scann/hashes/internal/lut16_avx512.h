@@ -37,6 +37,7 @@ class LUT16Avx512 {
       LUT16Args<float> args, ConstSpan<float> inv_fp_multipliers);
 
   static void GetTopInt16Distances(LUT16ArgsTopN<int16_t> args);
+  static void GetTopInt16Distances(LUT16ArgsTopNWithCrowding args);
   static void GetTopFloatDistances(LUT16ArgsTopN<float> args);
 };
 
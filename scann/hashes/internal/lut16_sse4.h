@@ -33,6 +33,8 @@ class LUT16Sse4 {
 
   SCANN_SSE4_OUTLINE static void GetTopInt16Distances(
       LUT16ArgsTopN<int16_t> args);
+  SCANN_SSE4_OUTLINE static void GetTopInt16Distances(
+      LUT16ArgsTopNWithCrowding args);
   SCANN_SSE4_OUTLINE static void GetTopFloatDistances(
       LUT16ArgsTopN<float> args);
 
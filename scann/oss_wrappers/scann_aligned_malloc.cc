@@ -14,6 +14,19 @@
 
 #include "scann/oss_wrappers/scann_aligned_malloc.h"
 
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
+#endif
+
 namespace tensorflow {
 namespace scann_ops {
 
@@ -38,5 +51,76 @@ void aligned_free(void *aligned_memory) { _aligned_free(aligned_memory); }
 #else
 #endif
 
+namespace {
+
+std::mutex large_allocation_options_mutex;
+
+// Set once any buffer has been locked, so that unlocking stays free for
+// processes that never lock.
+std::atomic<bool> memory_locked{false};
+
+LargeAllocationOptions *MutableLargeAllocationOptions() {
+  static LargeAllocationOptions *options = new LargeAllocationOptions;
+  return options;
+}
+
+}  // namespace
+
+void SetLargeAllocationOptions(const LargeAllocationOptions &options) {
+  std::lock_guard<std::mutex> lock(large_allocation_options_mutex);
+  *MutableLargeAllocationOptions() = options;
+}
+
+LargeAllocationOptions GetLargeAllocationOptions() {
+  std::lock_guard<std::mutex> lock(large_allocation_options_mutex);
+  return *MutableLargeAllocationOptions();
+}
+
+void AdviseLargeAllocation(const void *ptr, size_t populated_bytes,
+                           size_t allocated_bytes) {
+#ifdef __linux__
+  const LargeAllocationOptions options = GetLargeAllocationOptions();
+  if (ptr == nullptr || allocated_bytes < options.min_bytes) return;
+  if (!options.transparent_huge_pages && !options.lock_in_memory) return;
+
+  // madvise and mlock operate on whole pages; only the pages lying entirely
+  // inside the buffer are touched so neighbouring allocations are unaffected.
+  const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  const uintptr_t begin =
+      (reinterpret_cast<uintptr_t>(ptr) + page_size - 1) & ~(page_size - 1);
+  const uintptr_t populated_end =
+      (reinterpret_cast<uintptr_t>(ptr) + populated_bytes) & ~(page_size - 1);
+  const uintptr_t allocated_end =
+      (reinterpret_cast<uintptr_t>(ptr) + allocated_bytes) & ~(page_size - 1);
+  if (allocated_end <= begin) return;
+
+  if (options.transparent_huge_pages) {
+    madvise(reinterpret_cast<void *>(begin), allocated_end - begin,
+            MADV_HUGEPAGE);
+    if (options.collapse_populated && populated_end > begin) {
+      madvise(reinterpret_cast<void *>(begin), populated_end - begin,
+              MADV_COLLAPSE);
+    }
+  }
+  if (options.lock_in_memory && populated_end > begin) {
+    memory_locked.store(true, std::memory_order_relaxed);
+    mlock(reinterpret_cast<void *>(begin), populated_end - begin);
+  }
+#endif
+}
+
+void UnadviseLargeAllocation(const void *ptr, size_t allocated_bytes) {
+#ifdef __linux__
+  if (ptr == nullptr || !memory_locked.load(std::memory_order_relaxed)) return;
+  const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+  const uintptr_t begin =
+      (reinterpret_cast<uintptr_t>(ptr) + page_size - 1) & ~(page_size - 1);
+  const uintptr_t allocated_end =
+      (reinterpret_cast<uintptr_t>(ptr) + allocated_bytes) & ~(page_size - 1);
+  if (allocated_end <= begin) return;
+  munlock(reinterpret_cast<void *>(begin), allocated_end - begin);
+#endif
+}
+
 }  // namespace scann_ops
 }  // namespace tensorflow
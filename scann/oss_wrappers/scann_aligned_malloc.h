@@ -23,6 +23,40 @@ namespace scann_ops {
 void *aligned_malloc(size_t size, size_t minimum_alignment);
 void aligned_free(void *aligned_memory);
 
+// Process-wide policy for large, long-lived arrays (datasets, packed LUT16
+// codes, k-means centers) whose random access pattern makes them dTLB-bound.
+struct LargeAllocationOptions {
+  // Back large arrays with transparent huge pages.
+  bool transparent_huge_pages = false;
+
+  // Ask the kernel to collapse already-populated ranges into huge pages right
+  // away instead of waiting for khugepaged.  Requires Linux 6.1.
+  bool collapse_populated = true;
+
+  // Lock large arrays in memory so they are never swapped out.
+  bool lock_in_memory = false;
+
+  // Arrays smaller than this are left alone.
+  size_t min_bytes = size_t{2} << 20;
+};
+
+void SetLargeAllocationOptions(const LargeAllocationOptions &options);
+LargeAllocationOptions GetLargeAllocationOptions();
+
+// Applies the current LargeAllocationOptions in place to an existing buffer of
+// allocated_bytes bytes, of which the first populated_bytes are in use.  Only
+// the populated prefix is collapsed or locked, so spare capacity stays
+// unbacked.  Best effort: failures (e.g. RLIMIT_MEMLOCK, no THP support) are
+// ignored, and this is a no-op on non-Linux hosts.
+void AdviseLargeAllocation(const void *ptr, size_t populated_bytes,
+                           size_t allocated_bytes);
+
+// Releases the memory lock AdviseLargeAllocation may have taken on a buffer of
+// allocated_bytes bytes.  Must be called before the buffer is freed or
+// reallocated, since freed memory below the mmap threshold stays mapped and
+// would keep counting against RLIMIT_MEMLOCK.
+void UnadviseLargeAllocation(const void *ptr, size_t allocated_bytes);
+
 }  // namespace scann_ops
 }  // namespace tensorflow
 
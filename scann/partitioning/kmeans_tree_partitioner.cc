@@ -122,11 +122,8 @@ Status KMeansTreePartitioner<T>::TokenForDatapoint(
 
   if (this->tokenization_mode() == UntypedPartitioner::QUERY) {
     if (query_tokenization_type_ == ASYMMETRIC_HASHING) {
-      int pre_reordering_num_neighbors =
-          TokenizationSearcher()->reordering_enabled() ? kAhMultiplierNoSpilling
-                                                       : 1;
-      return TokenForDatapointUseSearcher(dptr, result,
-                                          pre_reordering_num_neighbors);
+      return TokenForDatapointUseSearcher(
+          dptr, result, AhPreReorderingNumNeighbors(1, kAhMultiplierNoSpilling));
     } else {
       vector<KMeansTreeSearchResult> result_vec;
       SCANN_RETURN_IF_ERROR(
@@ -141,11 +138,8 @@ Status KMeansTreePartitioner<T>::TokenForDatapoint(
     }
   } else if (this->tokenization_mode() == UntypedPartitioner::DATABASE) {
     if (database_tokenization_type_ == ASYMMETRIC_HASHING) {
-      int pre_reordering_num_neighbors =
-          TokenizationSearcher()->reordering_enabled() ? kAhMultiplierNoSpilling
-                                                       : 1;
-      return TokenForDatapointUseSearcher(dptr, result,
-                                          pre_reordering_num_neighbors);
+      return TokenForDatapointUseSearcher(
+          dptr, result, AhPreReorderingNumNeighbors(1, kAhMultiplierNoSpilling));
     } else {
       vector<KMeansTreeSearchResult> result_vec;
       SCANN_RETURN_IF_ERROR(
@@ -209,12 +203,13 @@ Status KMeansTreePartitioner<T>::TokensForDatapointWithSpilling(
                                  : query_spilling_max_centers_;
 
     if (query_tokenization_type_ == ASYMMETRIC_HASHING) {
-      int pre_reordering_num_neighbors =
-          TokenizationSearcher()->reordering_enabled()
-              ? max_centers * kAhMultiplierSpilling
-              : max_centers;
+      const int32_t num_neighbors =
+          query_spilling_type_ == QuerySpillingConfig::NO_SPILLING
+              ? 1
+              : std::min<int32_t>(max_centers, n_tokens());
       return TokensForDatapointWithSpillingUseSearcher(
-          dptr, result, max_centers, pre_reordering_num_neighbors);
+          dptr, result, num_neighbors,
+          AhPreReorderingNumNeighbors(num_neighbors, kAhMultiplierSpilling));
     }
 
     return kmeans_tree_->Tokenize(
@@ -227,14 +222,11 @@ Status KMeansTreePartitioner<T>::TokensForDatapointWithSpilling(
   } else if (this->tokenization_mode() == UntypedPartitioner::DATABASE) {
     if (database_spilling_fixed_number_of_centers_ > 0) {
       if (database_tokenization_type_ == ASYMMETRIC_HASHING) {
-        int pre_reordering_num_neighbors =
-            TokenizationSearcher()->reordering_enabled()
-                ? database_spilling_fixed_number_of_centers_ *
-                      kAhMultiplierSpilling
-                : database_spilling_fixed_number_of_centers_;
         return TokensForDatapointWithSpillingUseSearcher(
             dptr, result, database_spilling_fixed_number_of_centers_,
-            pre_reordering_num_neighbors);
+            AhPreReorderingNumNeighbors(
+                database_spilling_fixed_number_of_centers_,
+                kAhMultiplierSpilling));
       } else {
         return kmeans_tree_->Tokenize(
             dptr, *query_tokenization_dist_,
@@ -376,6 +368,70 @@ Status KMeansTreePartitioner<T>::TokensForDatapointWithSpillingUseSearcher(
   return OkStatus();
 }
 
+template <typename T>
+Status
+KMeansTreePartitioner<T>::TokensForDatapointWithSpillingBatchedUseSearcher(
+    const DenseDataset<float>& queries, ConstSpan<int32_t> max_centers_override,
+    MutableSpan<vector<KMeansTreeSearchResult>> results) const {
+  if (!TokenizationSearcher()) {
+    return FailedPreconditionError(
+        "CreateAsymmetricHashingSearcherForTokenization must "
+        "be called first.");
+  }
+
+  float threshold = numeric_limits<float>::infinity();
+  if (query_spilling_type_ == QuerySpillingConfig::ABSOLUTE_DISTANCE) {
+    threshold = query_spilling_threshold_;
+  }
+  vector<SearchParameters> params;
+  params.reserve(queries.size());
+  for (DatapointIndex query_idx : IndicesOf(queries)) {
+    const int32_t max_centers =
+        !max_centers_override.empty() && max_centers_override[query_idx] > 0
+            ? max_centers_override[query_idx]
+            : query_spilling_max_centers_;
+    const int32_t num_neighbors =
+        query_spilling_type_ == QuerySpillingConfig::NO_SPILLING
+            ? 1
+            : std::min<int32_t>(max_centers, n_tokens());
+    params.emplace_back(
+        AhPreReorderingNumNeighbors(num_neighbors, kAhMultiplierSpilling),
+        numeric_limits<float>::infinity(), num_neighbors, threshold);
+  }
+
+  vector<NNResultsVector> search_results(queries.size());
+  SCANN_RETURN_IF_ERROR(TokenizationSearcher()->FindNeighborsBatched(
+      queries, params, MakeMutableSpan(search_results)));
+
+  DCHECK(is_one_level_tree_);
+  const auto* root = kmeans_tree_->root();
+  for (DatapointIndex query_idx : IndicesOf(queries)) {
+    auto& result = results[query_idx];
+    result.clear();
+    result.reserve(search_results[query_idx].size());
+    for (const auto& elem : search_results[query_idx]) {
+      result.emplace_back(KMeansTreeSearchResult{
+          &root->Children()[elem.first], elem.second,
+          populate_residual_stdev_ &&
+                  elem.first < root->residual_stdevs().size()
+              ? root->residual_stdevs()[elem.first]
+              : 1.0});
+    }
+  }
+  return OkStatus();
+}
+
+template <typename T>
+int32_t KMeansTreePartitioner<T>::AhPreReorderingNumNeighbors(
+    int32_t num_neighbors, int32_t multiplier) const {
+  const auto* searcher = TokenizationSearcher();
+  if (!searcher || !searcher->reordering_enabled()) return num_neighbors;
+  return std::max<int32_t>(
+      num_neighbors,
+      std::min<int64_t>(static_cast<int64_t>(num_neighbors) * multiplier,
+                        n_tokens()));
+}
+
 namespace {
 
 template <typename FloatT, typename T>
@@ -482,7 +538,10 @@ KMeansTreePartitioner<T>::TokenizeDatabase(
     return FailedPreconditionError(
         "Cannot run TokenizeDatabase when not in database tokenization mode.");
   }
-  if (typeid(*database_tokenization_dist_) == typeid(const SquaredL2Distance) &&
+  const auto dist_tag =
+      database_tokenization_dist_->specially_optimized_distance_tag();
+  if ((dist_tag == DistanceMeasure::SQUARED_L2 ||
+       dist_tag == DistanceMeasure::DOT_PRODUCT) &&
       is_one_level_tree_ && database.IsDense() &&
       kmeans_tree_->learned_spilling_type() ==
           DatabaseSpillingConfig::NO_SPILLING &&
@@ -536,9 +595,12 @@ enable_if_t<IsSame<T, CenterType>(), StatusOr<vector<KMeansTreeSearchResult>>>
 KMeansTreePartitioner<T>::TokenizeDatabaseImplFastPath(
     const DenseDataset<T>& database, const DenseDataset<CenterType>& centers,
     thread::ThreadPool* pool_or_null) const {
-  SquaredL2Distance dist;
-  auto nearest_centers =
-      DenseDistanceManyToManyTop1<T>(dist, database, centers, pool_or_null);
+  // The centers are not pretransposed.  The kernel transposes each block of
+  // centers once per query batch of ~512KiB, which is negligible next to the
+  // distance computation, and the only pretransposed kernel is FP8, whose
+  // quantized centers would change token assignments.
+  auto nearest_centers = DenseDistanceManyToManyTop1<T>(
+      *database_tokenization_dist_, database, centers, pool_or_null);
   return PostprocessNearestCenters<CenterType>(nearest_centers);
 }
 
@@ -550,7 +612,7 @@ KMeansTreePartitioner<T>::TokenizeDatabaseImplFastPath(
     thread::ThreadPool* pool_or_null) const {
   constexpr size_t kBatchSize = 128;
   vector<pair<DatapointIndex, CenterType>> nearest_centers(database.size());
-  SquaredL2Distance dist;
+  const DistanceMeasure& dist = *database_tokenization_dist_;
 
   ParallelFor<1>(
       SeqWithStride<kBatchSize>(0, database.size()), pool_or_null,
@@ -621,6 +683,15 @@ Status KMeansTreePartitioner<T>::TokensForDatapointWithSpillingBatched(
         "The max_centers override must have the same "
         "size as batched queries.");
 
+  if (this->tokenization_mode() == UntypedPartitioner::QUERY &&
+      query_tokenization_type_ == ASYMMETRIC_HASHING && queries.IsDense()) {
+    DenseDataset<float> float_query_storage;
+    auto float_queries = ConvertToFloatIfNecessary(
+        *down_cast<const DenseDataset<T>*>(&queries), &float_query_storage);
+    return TokensForDatapointWithSpillingBatchedUseSearcher(
+        *float_queries, max_centers_override, results);
+  }
+
   if (this->tokenization_mode() != UntypedPartitioner::QUERY ||
       !SupportsLowLevelQueryBatching() || !queries.IsDense()) {
     for (DatapointIndex i = 0; i < queries.size(); ++i) {
@@ -811,7 +882,7 @@ KMeansTreePartitioner<T>::TokenizationSearcher() const {
 template <typename T>
 Status
 KMeansTreePartitioner<T>::CreateAsymmetricHashingSearcherForQueryTokenization(
-    bool with_exact_reordering) {
+    bool with_exact_reordering, shared_ptr<thread::ThreadPool> pool) {
   if (!is_one_level_tree_) {
     return FailedPreconditionError(
         "Use searcher for tokenization only works for one_level_tree.");
@@ -837,8 +908,9 @@ KMeansTreePartitioner<T>::CreateAsymmetricHashingSearcherForQueryTokenization(
       query_tokenization_searcher_,
       internal::CreateRecommendedAsymmetricSearcher(
           std::move(centers), query_tokenization_dist_,
-          query_spilling_max_centers_, numeric_limits<float>::infinity(),
-          with_exact_reordering));
+          std::min<int32_t>(query_spilling_max_centers_, n_tokens()),
+          numeric_limits<float>::infinity(), with_exact_reordering,
+          std::move(pool)));
   return OkStatus();
 }
 
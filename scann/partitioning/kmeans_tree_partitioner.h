@@ -170,7 +170,16 @@ class KMeansTreePartitioner final : public KMeansTreeLikePartitioner<T> {
   Status CreateAsymmetricHashingSearcherForDatabaseTokenization();
 
   Status CreateAsymmetricHashingSearcherForQueryTokenization(
-      bool with_exact_reordering = true);
+      bool with_exact_reordering = true,
+      shared_ptr<thread::ThreadPool> pool = nullptr);
+
+  bool SupportsAsymmetricQueryTokenization() const {
+    return is_one_level_tree_ &&
+           (query_spilling_type_ == QuerySpillingConfig::NO_SPILLING ||
+            query_spilling_type_ == QuerySpillingConfig::ABSOLUTE_DISTANCE ||
+            query_spilling_type_ ==
+                QuerySpillingConfig::FIXED_NUMBER_OF_CENTERS);
+  }
 
   const SingleMachineSearcherBase<float>* TokenizationSearcher() const;
 
@@ -196,6 +205,13 @@ class KMeansTreePartitioner final : public KMeansTreeLikePartitioner<T> {
   Status TokensForDatapointWithSpillingUseSearcher(
       const DatapointPtr<T>& dptr, std::vector<KMeansTreeSearchResult>* result,
       int32_t num_neighbors, int32_t pre_reordering_num_neighbors) const;
+  Status TokensForDatapointWithSpillingBatchedUseSearcher(
+      const DenseDataset<float>& queries,
+      ConstSpan<int32_t> max_centers_override,
+      MutableSpan<std::vector<KMeansTreeSearchResult>> results) const;
+
+  int32_t AhPreReorderingNumNeighbors(int32_t num_neighbors,
+                                      int32_t multiplier) const;
 
   void SetIsOneLevelTree();
 
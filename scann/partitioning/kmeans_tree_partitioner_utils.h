@@ -22,6 +22,42 @@
 namespace tensorflow {
 namespace scann_ops {
 
+template <typename T>
+Status ConfigureQueryTokenization(const PartitioningConfig& config,
+                                  shared_ptr<thread::ThreadPool> pool,
+                                  KMeansTreePartitioner<T>* partitioner) {
+  if (config.query_tokenization_type() ==
+      PartitioningConfig::FIXED_POINT_INT8) {
+    partitioner->SetQueryTokenizationType(
+        KMeansTreePartitioner<T>::FIXED_POINT_INT8);
+    return OkStatus();
+  }
+  if (config.query_tokenization_type() == PartitioningConfig::ASYMMETRIC) {
+    SCANN_RETURN_IF_ERROR(
+        partitioner->CreateAsymmetricHashingSearcherForQueryTokenization(
+            true, std::move(pool)));
+    partitioner->SetQueryTokenizationType(
+        KMeansTreePartitioner<T>::ASYMMETRIC_HASHING);
+    return OkStatus();
+  }
+
+  partitioner->SetQueryTokenizationType(KMeansTreePartitioner<T>::FLOAT);
+  const int32_t min_centers =
+      config.asymmetric_query_tokenization_min_centers();
+  if (min_centers <= 0 || partitioner->n_tokens() < min_centers ||
+      !partitioner->SupportsAsymmetricQueryTokenization()) {
+    return OkStatus();
+  }
+  LOG(INFO) << "Using asymmetric hashing query tokenization for "
+            << partitioner->n_tokens() << " centers.";
+  SCANN_RETURN_IF_ERROR(
+      partitioner->CreateAsymmetricHashingSearcherForQueryTokenization(
+          true, std::move(pool)));
+  partitioner->SetQueryTokenizationType(
+      KMeansTreePartitioner<T>::ASYMMETRIC_HASHING);
+  return OkStatus();
+}
+
 template <typename T>
 StatusOr<unique_ptr<Partitioner<T>>>
 KMeansTreePartitionerFactoryPreSampledAndProjected(
@@ -79,13 +115,8 @@ KMeansTreePartitionerFactoryPreSampledAndProjected(
         config.database_spilling().max_spill_centers());
   }
 
-  if (config.query_tokenization_type() == PartitioningConfig::FLOAT) {
-    result->SetQueryTokenizationType(KMeansTreePartitioner<T>::FLOAT);
-  } else if (config.query_tokenization_type() ==
-             PartitioningConfig::FIXED_POINT_INT8) {
-    result->SetQueryTokenizationType(
-        KMeansTreePartitioner<T>::FIXED_POINT_INT8);
-  }
+  SCANN_RETURN_IF_ERROR(ConfigureQueryTokenization(
+      config, training_parallelization_pool, result.get()));
 
   if (config.database_tokenization_type() == PartitioningConfig::FLOAT) {
     result->SetDatabaseTokenizationType(KMeansTreePartitioner<T>::FLOAT);
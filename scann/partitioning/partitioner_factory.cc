@@ -126,18 +126,8 @@ StatusOr<unique_ptr<Partitioner<T>>> PartitionerFromKMeansTree(
     km->set_database_spilling_fixed_number_of_centers(
         config.database_spilling().max_spill_centers());
   }
-  if (config.query_tokenization_type() == PartitioningConfig::FLOAT) {
-    km->SetQueryTokenizationType(KMeansTreePartitioner<T>::FLOAT);
-  } else if (config.query_tokenization_type() ==
-             PartitioningConfig::FIXED_POINT_INT8) {
-    km->SetQueryTokenizationType(KMeansTreePartitioner<T>::FIXED_POINT_INT8);
-  } else if (config.query_tokenization_type() ==
-             PartitioningConfig::ASYMMETRIC) {
-    SCANN_RETURN_IF_ERROR(
-        km->CreateAsymmetricHashingSearcherForQueryTokenization());
-    km->SetQueryTokenizationType(
-        tensorflow::scann_ops::KMeansTreePartitioner<T>::ASYMMETRIC_HASHING);
-  }
+  SCANN_RETURN_IF_ERROR(
+      ConfigureQueryTokenization<T>(config, nullptr, km.get()));
 
   if (config.database_tokenization_type() == PartitioningConfig::FLOAT) {
     km->SetDatabaseTokenizationType(KMeansTreePartitioner<T>::FLOAT);
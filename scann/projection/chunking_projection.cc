@@ -22,6 +22,24 @@
 namespace tensorflow {
 namespace scann_ops {
 
+template <typename T>
+StatusOr<unique_ptr<ChunkingProjection<T>>> BuildVariableChunkingProjection(
+    const ProjectionConfig& config) {
+  if (config.variable_blocks_size() <= 0) {
+    return InvalidArgumentError(
+        "variable_blocks must be populated for projection type "
+        "VARIABLE_CHUNK.");
+  }
+  vector<int32_t> dims_per_block;
+  int32_t num_blocks = 0;
+  for (const auto& vblock : config.variable_blocks()) {
+    dims_per_block.insert(dims_per_block.end(), vblock.num_blocks(),
+                          vblock.num_dims_per_block());
+    num_blocks += vblock.num_blocks();
+  }
+  return make_unique<ChunkingProjection<T>>(num_blocks, dims_per_block);
+}
+
 template <typename T>
 StatusOr<unique_ptr<ChunkingProjection<T>>> BuildFromConfigImpl(
     const ProjectionConfig& config) {
@@ -32,21 +50,8 @@ StatusOr<unique_ptr<ChunkingProjection<T>>> BuildFromConfigImpl(
   const int32_t input_dim = config.input_dim();
 
   switch (config.projection_type()) {
-    case ProjectionConfig::VARIABLE_CHUNK: {
-      if (config.variable_blocks_size() <= 0) {
-        return InvalidArgumentError(
-            "variable_blocks must be populated for projection type "
-            "VARIABLE_CHUNK.");
-      }
-      vector<int32_t> dims_per_block;
-      int32_t num_blocks = 0;
-      for (const auto& vblock : config.variable_blocks()) {
-        dims_per_block.insert(dims_per_block.end(), vblock.num_blocks(),
-                              vblock.num_dims_per_block());
-        num_blocks += vblock.num_blocks();
-      }
-      return make_unique<ChunkingProjection<T>>(num_blocks, dims_per_block);
-    }
+    case ProjectionConfig::VARIABLE_CHUNK:
+      return BuildVariableChunkingProjection<T>(config);
 
     case ProjectionConfig::IDENTITY_CHUNK:
       if (!config.has_num_blocks()) {
@@ -55,6 +60,11 @@ StatusOr<unique_ptr<ChunkingProjection<T>>> BuildFromConfigImpl(
       }
       return make_unique<ChunkingProjection<T>>(config.num_blocks());
 
+    case ProjectionConfig::OPQ:
+      if (config.variable_blocks_size() > 0) {
+        return BuildVariableChunkingProjection<T>(config);
+      }
+      ABSL_FALLTHROUGH_INTENDED;
     case ProjectionConfig::CHUNK:
     case ProjectionConfig::PCA:
     default: {
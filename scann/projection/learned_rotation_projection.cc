@@ -0,0 +1,58 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#include "scann/projection/learned_rotation_projection.h"
+
+#include "scann/utils/datapoint_utils.h"
+
+namespace tensorflow {
+namespace scann_ops {
+
+template <typename T>
+LearnedRotationProjection<T>::LearnedRotationProjection(
+    shared_ptr<const DenseDataset<float>> rotation_matrix)
+    : rotation_matrix_(std::move(rotation_matrix)) {
+  CHECK(rotation_matrix_ != nullptr);
+  CHECK(!rotation_matrix_->empty()) << "Rotation matrix must be non-empty";
+}
+
+template <typename T>
+template <typename FloatT>
+Status LearnedRotationProjection<T>::ProjectInputImpl(
+    const DatapointPtr<T>& input, Datapoint<FloatT>* projected) const {
+  CHECK(projected != nullptr);
+  const DenseDataset<float>& rotation_matrix = *rotation_matrix_;
+  if (rotation_matrix.dimensionality() != input.dimensionality()) {
+    return InvalidArgumentError(absl::StrCat(
+        "Input dimensionality (", input.dimensionality(),
+        ") does not match learned rotation dimensionality (",
+        rotation_matrix.dimensionality(), ")."));
+  }
+
+  projected->clear();
+  projected->mutable_values()->resize(rotation_matrix.size());
+  FloatT* out = projected->mutable_values()->data();
+  for (size_t i : IndicesOf(rotation_matrix)) {
+    out[i] = static_cast<FloatT>(DotProduct(input, rotation_matrix[i]));
+  }
+  return OkStatus();
+}
+
+DEFINE_PROJECT_INPUT_OVERRIDES(LearnedRotationProjection);
+SCANN_INSTANTIATE_TYPED_CLASS(, LearnedRotationProjection);
+
+}  // namespace scann_ops
+}  // namespace tensorflow
@@ -95,6 +95,11 @@ StatusOr<unique_ptr<Projection<T>>> ProjectionFactoryImpl<T>::Create(
       return {std::move(projection)};
     }
 
+    case ProjectionConfig::OPQ:
+      return FailedPreconditionError(
+          "Projection type OPQ is learned during asymmetric hashing training "
+          "and must be loaded together with the AH codebook.");
+
     default:
       return UnimplementedError(
           "The specified projection type is not implemented.");
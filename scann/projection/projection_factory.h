@@ -55,6 +55,7 @@ inline StatusOr<unique_ptr<ChunkingProjection<T>>> ChunkingProjectionFactory(
     case ProjectionConfig::CHUNK:
     case ProjectionConfig::VARIABLE_CHUNK:
     case ProjectionConfig::IDENTITY_CHUNK:
+    case ProjectionConfig::OPQ:
       break;
     default: {
       TF_ASSIGN_OR_RETURN(initial_projection,
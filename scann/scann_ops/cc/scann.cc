@@ -14,20 +14,162 @@
 
 #include "scann/scann_ops/cc/scann.h"
 
+#include <deque>
 #include <fstream>
+#include <tuple>
 
 #include "absl/base/internal/sysinfo.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/node_hash_set.h"
+#include "scann/oss_wrappers/scann_aligned_malloc.h"
 #include "scann/partitioning/partitioner.pb.h"
 #include "scann/proto/centers.pb.h"
+#include "scann/tree_x_hybrid/tree_ah_hybrid_residual.h"
 #include "scann/tree_x_hybrid/tree_x_params.h"
+#include "scann/utils/file_backed_reordering_helper.h"
 #include "scann/utils/io_npy.h"
 #include "scann/utils/io_oss_wrapper.h"
+#include "scann/utils/numa.h"
 #include "scann/utils/threads.h"
 
 namespace tensorflow {
 namespace scann_ops {
 
+class AsyncSearchBatcher {
+ public:
+  struct Request {
+    vector<float> query;
+    int final_nn;
+    int pre_reorder_nn;
+    int leaves;
+    AsyncSearchCallback done;
+    // Set instead of done for external-id queries.
+    AsyncExternalIdSearchCallback done_with_external_ids;
+    absl::Time enqueue_time;
+  };
+
+  AsyncSearchBatcher(const ScannInterface* scann,
+                     const AsyncSearchOptions& options, bool can_batch)
+      : scann_(scann), options_(options), can_batch_(can_batch) {
+    pool_ = StartThreadPool("scann_async_search", options_.num_threads);
+    for (int i = 0; i < options_.num_threads; ++i) {
+      pool_->Schedule([this] { DispatchLoop(); });
+    }
+  }
+
+  ~AsyncSearchBatcher() {
+    {
+      absl::MutexLock lock(&mutex_);
+      stopping_ = true;
+    }
+    pool_ = nullptr;
+  }
+
+  void Enqueue(Request request) {
+    request.enqueue_time = absl::Now();
+    absl::MutexLock lock(&mutex_);
+    queue_.push_back(std::move(request));
+  }
+
+ private:
+  void DispatchLoop() {
+    for (;;) {
+      vector<Request> batch;
+      {
+        absl::MutexLock lock(&mutex_);
+        mutex_.Await(absl::Condition(
+            +[](AsyncSearchBatcher* b) {
+              return b->stopping_ || !b->queue_.empty();
+            },
+            this));
+        if (queue_.empty()) return;
+        mutex_.AwaitWithDeadline(
+            absl::Condition(
+                +[](AsyncSearchBatcher* b) {
+                  return b->stopping_ ||
+                         b->queue_.size() >= b->options_.max_batch_size;
+                },
+                this),
+            queue_.front().enqueue_time + options_.max_batching_delay);
+        const size_t batch_size =
+            std::min(queue_.size(), options_.max_batch_size);
+        batch.reserve(batch_size);
+        for (size_t i = 0; i < batch_size; ++i) {
+          batch.push_back(std::move(queue_.front()));
+          queue_.pop_front();
+        }
+      }
+      Dispatch(MakeMutableSpan(batch));
+    }
+  }
+
+  void Dispatch(MutableSpan<Request> batch) const {
+    // Queries only share a FindNeighborsBatched call when they were submitted
+    // with the same search parameters.
+    absl::flat_hash_map<std::tuple<int, int, int>, vector<size_t>> groups;
+    for (size_t i : IndicesOf(batch)) {
+      Request& request = batch[i];
+      if (request.done_with_external_ids) {
+        // There is no batched external-id search, so these run one at a time.
+        ExternalIdNNResultsVector result;
+        Status status = scann_->SearchWithExternalIds(
+            MakeDatapointPtr(request.query), &result, request.final_nn,
+            request.pre_reorder_nn, request.leaves);
+        request.done_with_external_ids(std::move(status), std::move(result));
+        continue;
+      }
+      groups[std::make_tuple(batch[i].final_nn, batch[i].pre_reorder_nn,
+                             batch[i].leaves)]
+          .push_back(i);
+    }
+    for (const auto& [key, indices] : groups) {
+      if (indices.size() == 1 || !can_batch_) {
+        for (size_t i : indices) {
+          Request& request = batch[i];
+          NNResultsVector result;
+          Status status = scann_->Search(
+              MakeDatapointPtr(request.query), &result, request.final_nn,
+              request.pre_reorder_nn, request.leaves);
+          request.done(std::move(status), std::move(result));
+        }
+        continue;
+      }
+
+      const size_t dimensionality = batch[indices[0]].query.size();
+      vector<float> query_storage;
+      query_storage.reserve(indices.size() * dimensionality);
+      for (size_t i : indices) {
+        query_storage.insert(query_storage.end(), batch[i].query.begin(),
+                             batch[i].query.end());
+      }
+      DenseDataset<float> queries(std::move(query_storage), indices.size());
+      vector<NNResultsVector> results(indices.size());
+      const Request& first = batch[indices[0]];
+      Status status = scann_->SearchBatched(
+          queries, MakeMutableSpan(results), first.final_nn,
+          first.pre_reorder_nn, first.leaves);
+      for (size_t j : IndicesOf(indices)) {
+        batch[indices[j]].done(
+            status, status.ok() ? std::move(results[j]) : NNResultsVector());
+      }
+    }
+  }
+
+  const ScannInterface* scann_;
+  const AsyncSearchOptions options_;
+  const bool can_batch_;
+
+  absl::Mutex mutex_;
+  std::deque<Request> queue_ ABSL_GUARDED_BY(mutex_);
+  bool stopping_ ABSL_GUARDED_BY(mutex_) = false;
+
+  unique_ptr<thread::ThreadPool> pool_;
+};
+
+ScannInterface::ScannInterface() {}
+
+ScannInterface::~ScannInterface() {}
+
 Status ScannInterface::Initialize(ConstSpan<float> dataset,
                                   ConstSpan<int32_t> datapoint_to_token,
                                   ConstSpan<uint8_t> hashed_dataset,
@@ -58,6 +200,7 @@ Status ScannInterface::Initialize(ScannConfig config,
                                   ConstSpan<int32_t> datapoint_to_token,
                                   ConstSpan<uint8_t> hashed_dataset,
                                   DimensionIndex dimensionality) {
+  async_batcher_ = nullptr;
   config_ = config;
   if (opts.ah_codebook != nullptr && !hashed_dataset.empty()) {
     vector<uint8_t> hashed_db(hashed_dataset.data(),
@@ -83,6 +226,7 @@ Status ScannInterface::Initialize(ConstSpan<float> dataset,
                                   DimensionIndex dimensionality,
                                   const std::string& config,
                                   int training_threads) {
+  async_batcher_ = nullptr;
   ::google::protobuf::TextFormat::ParseFromString(config, &config_);
   if (training_threads < 0)
     return InvalidArgumentError("training_threads must be non-negative");
@@ -98,6 +242,7 @@ Status ScannInterface::Initialize(ConstSpan<float> dataset,
                                   DimensionIndex dimensionality,
                                   const ScannConfig& config,
                                   int training_threads) {
+  async_batcher_ = nullptr;
   config_ = config;
   if (training_threads < 0)
     return InvalidArgumentError("training_threads must be non-negative");
@@ -117,11 +262,29 @@ Status ScannInterface::Initialize(ConstSpan<float> ds_span,
   //     return InvalidArgumentError("Dataset must be non-empty");
   // }
 
+  // 批处理线程仍引用旧的 scann_ 和 config_, 须在替换前停止
+  async_batcher_ = nullptr;
+
+  // 大数组策略为进程级, 须在构建数据集前生效
+  if (config_.has_large_allocation()) {
+    const LargeAllocationConfig& large_allocation = config_.large_allocation();
+    if (large_allocation.min_bytes() < 0)
+      return InvalidArgumentError("large_allocation.min_bytes must be >= 0");
+    LargeAllocationOptions options;
+    options.transparent_huge_pages = large_allocation.transparent_huge_pages();
+    options.collapse_populated = large_allocation.collapse_populated();
+    options.lock_in_memory = large_allocation.lock_in_memory();
+    options.min_bytes = large_allocation.min_bytes();
+    SetLargeAllocationOptions(options);
+  }
+
   dimensionality_ = dimensionality;
   n_points_ = ds_span.size() / dimensionality_;
 
   vector<float> dataset_vec(ds_span.data(), ds_span.data() + ds_span.size());
   auto dataset = absl::make_unique<DenseDataset<float>>(dataset_vec, n_points_);
+  // 加载时可不带原始数据(如磁盘重排), 维度仍需保留
+  if (dataset->empty()) dataset->set_dimensionality(dimensionality_);
 
   if (config_.has_partitioning() &&
       config_.partitioning().partitioning_type() ==
@@ -140,28 +303,71 @@ Status ScannInterface::Initialize(ConstSpan<float> ds_span,
   return OkStatus();
 }
 
-void ScannInterface::AddDocsWithIds(const std::vector<int64_t> &ids, const std::vector<float> &vecs) {
+Status ScannInterface::AddDocsWithIds(const std::vector<int64_t> &ids, const std::vector<float> &vecs,
+                                     ConstSpan<int64_t> crowding_attributes,
+                                     ConstSpan<uint64_t> restrict_tokens) {
   auto n_points = ids.size();
-  n_points_ += n_points;
 
   DenseDataset<uint8_t> hashed_dataset;
   auto dataset = absl::make_unique<DenseDataset<float>>(vecs, n_points);
-  std::vector<std::string> idstr_vec (ids.size(), "");
+  std::vector<std::string> idstr_vec;
+  idstr_vec.reserve(ids.size());
   for (auto id : ids) {
-    //idstr_vec.push_back(std::to_string(id));
+    idstr_vec.push_back(std::to_string(id));
   }
-  auto ret = scann_->AddDatasetWithIds(*dataset, hashed_dataset, idstr_vec, config_);
-  if (!ret) {
-    LOG(ERROR) << "add has error";
+  AddDatasetAttributes attributes;
+  attributes.crowding_attributes = crowding_attributes;
+  attributes.restrict_tokens = restrict_tokens;
+  if (!scann_->AddDatasetWithIds(*dataset, hashed_dataset, idstr_vec, config_,
+                                 attributes)) {
+    return InternalError("Failed to add %d datapoints; see the log for details.",
+                         n_points);
   }
+  n_points_ += n_points;
+  return OkStatus();
 }
 
-Status ScannInterface::Search(const DatapointPtr<float> query,
-                              NNResultsVector* res, int final_nn,
-                              int pre_reorder_nn, int leaves) const {
-  if (query.dimensionality() != dimensionality_) {
-    return InvalidArgumentError("Query doesn't match dataset dimsensionality");
+Status ScannInterface::SetExternalIds(ConstSpan<int64_t> external_ids) {
+  auto* tree_ah = dynamic_cast<TreeAHHybridResidual*>(scann_.get());
+  if (tree_ah == nullptr) {
+    return FailedPreconditionError(
+        "External ids are only supported for tree-AH searchers.");
+  }
+  return tree_ah->SetExternalIds(external_ids);
+}
+
+Status ScannInterface::SetRestrictTokens(ConstSpan<uint64_t> restrict_tokens) {
+  auto* tree_ah = dynamic_cast<TreeAHHybridResidual*>(scann_.get());
+  if (tree_ah == nullptr) {
+    return FailedPreconditionError(
+        "Restrict tokens are only supported for tree-AH searchers.");
+  }
+  return tree_ah->SetRestrictTokens(restrict_tokens,
+                                    config_.disjoint_restrict_token());
+}
+
+Status ScannInterface::EnableNumaPlacement(int threads_per_node,
+                                           bool replicate_small_structures) {
+  auto* tree_ah = dynamic_cast<TreeAHHybridResidual*>(scann_.get());
+  if (tree_ah == nullptr) {
+    return FailedPreconditionError(
+        "NUMA placement is only supported for tree-AH searchers.");
   }
+  TF_ASSIGN_OR_RETURN(auto numa_pools,
+                      NumaThreadPools::Start("scann_numa", threads_per_node));
+  return tree_ah->EnableNumaPlacement(std::move(numa_pools),
+                                      replicate_small_structures);
+}
+
+bool ScannInterface::external_ids_enabled() const {
+  const auto* tree_ah =
+      dynamic_cast<const TreeAHHybridResidual*>(scann_.get());
+  return tree_ah != nullptr && tree_ah->external_ids_enabled();
+}
+
+SearchParameters ScannInterface::MakeSearchParameters(int final_nn,
+                                                      int pre_reorder_nn,
+                                                      int leaves) const {
   bool has_reordering =
       config_.has_exact_reordering() || config_.has_compressed_reordering();
   int post_reorder_nn = -1;
@@ -179,7 +385,34 @@ Status ScannInterface::Search(const DatapointPtr<float> query,
     params.set_searcher_specific_optional_parameters(tree_params);
   }
   scann_->SetUnspecifiedParametersToDefaults(&params);
-  return scann_->FindNeighbors(query, params, res);
+  return params;
+}
+
+Status ScannInterface::Search(const DatapointPtr<float> query,
+                              NNResultsVector* res, int final_nn,
+                              int pre_reorder_nn, int leaves) const {
+  if (query.dimensionality() != dimensionality_) {
+    return InvalidArgumentError("Query doesn't match dataset dimsensionality");
+  }
+  return scann_->FindNeighbors(
+      query, MakeSearchParameters(final_nn, pre_reorder_nn, leaves), res);
+}
+
+Status ScannInterface::SearchWithExternalIds(const DatapointPtr<float> query,
+                                             ExternalIdNNResultsVector* res,
+                                             int final_nn, int pre_reorder_nn,
+                                             int leaves) const {
+  if (query.dimensionality() != dimensionality_) {
+    return InvalidArgumentError("Query doesn't match dataset dimsensionality");
+  }
+  const auto* tree_ah =
+      dynamic_cast<const TreeAHHybridResidual*>(scann_.get());
+  if (tree_ah == nullptr) {
+    return FailedPreconditionError(
+        "External ids are only supported for tree-AH searchers.");
+  }
+  return tree_ah->FindNeighborsWithExternalIds(
+      query, MakeSearchParameters(final_nn, pre_reorder_nn, leaves), res);
 }
 
 Status ScannInterface::SearchBatched(const DenseDataset<float>& queries,
@@ -236,6 +469,144 @@ Status ScannInterface::SearchBatchedParallel(const DenseDataset<float>& queries,
       });
 }
 
+Status ScannInterface::CheckAsyncSearchQuery(ConstSpan<float> query) const {
+  if (!async_batcher_) {
+    return FailedPreconditionError("Async search has not been enabled.");
+  }
+  if (query.size() != dimensionality_) {
+    return InvalidArgumentError("Query doesn't match dataset dimsensionality");
+  }
+  return OkStatus();
+}
+
+void ScannInterface::SearchAsync(ConstSpan<float> query, int final_nn,
+                                 int pre_reorder_nn, int leaves,
+                                 AsyncSearchCallback done) const {
+  Status status = CheckAsyncSearchQuery(query);
+  if (!status.ok()) {
+    done(std::move(status), NNResultsVector());
+    return;
+  }
+  AsyncSearchBatcher::Request request;
+  request.query.assign(query.begin(), query.end());
+  request.final_nn = final_nn;
+  request.pre_reorder_nn = pre_reorder_nn;
+  request.leaves = leaves;
+  request.done = std::move(done);
+  async_batcher_->Enqueue(std::move(request));
+}
+
+std::future<StatusOr<NNResultsVector>> ScannInterface::SearchAsync(
+    ConstSpan<float> query, int final_nn, int pre_reorder_nn,
+    int leaves) const {
+  auto promise = std::make_shared<std::promise<StatusOr<NNResultsVector>>>();
+  auto future = promise->get_future();
+  SearchAsync(query, final_nn, pre_reorder_nn, leaves,
+              [promise](Status status, NNResultsVector result) {
+                if (status.ok()) {
+                  promise->set_value(std::move(result));
+                } else {
+                  promise->set_value(std::move(status));
+                }
+              });
+  return future;
+}
+
+void ScannInterface::SearchAsyncWithExternalIds(
+    ConstSpan<float> query, int final_nn, int pre_reorder_nn, int leaves,
+    AsyncExternalIdSearchCallback done) const {
+  Status status = CheckAsyncSearchQuery(query);
+  if (!status.ok()) {
+    done(std::move(status), ExternalIdNNResultsVector());
+    return;
+  }
+  AsyncSearchBatcher::Request request;
+  request.query.assign(query.begin(), query.end());
+  request.final_nn = final_nn;
+  request.pre_reorder_nn = pre_reorder_nn;
+  request.leaves = leaves;
+  request.done_with_external_ids = std::move(done);
+  async_batcher_->Enqueue(std::move(request));
+}
+
+Status ScannInterface::EnableAsyncSearch(const AsyncSearchOptions& options) {
+  if (!scann_) {
+    return FailedPreconditionError(
+        "The searcher must be initialized before enabling async search.");
+  }
+  if (options.max_batch_size == 0 || options.num_threads <= 0) {
+    return InvalidArgumentError(
+        "max_batch_size and num_threads must be positive, got %d and %d.",
+        options.max_batch_size, options.num_threads);
+  }
+  if (options.max_batching_delay < absl::ZeroDuration()) {
+    return InvalidArgumentError("max_batching_delay must be non-negative.");
+  }
+  const bool can_batch = std::isinf(scann_->default_pre_reordering_epsilon()) &&
+                         std::isinf(scann_->default_post_reordering_epsilon());
+  async_batcher_ = nullptr;
+  async_batcher_ = make_unique<AsyncSearchBatcher>(this, options, can_batch);
+  return OkStatus();
+}
+
+StatusOr<vector<SearchParameters>> ScannInterface::MakeRangeSearchParameters(
+    const DenseDataset<float>& queries, float radius, int leaves) const {
+  if (queries.dimensionality() != dimensionality_)
+    return InvalidArgumentError("Query doesn't match dataset dimsensionality");
+
+  const float epsilon = result_multiplier_ * radius;
+  std::shared_ptr<TreeXOptionalParameters> tree_params;
+  if (leaves > 0) {
+    tree_params = std::make_shared<TreeXOptionalParameters>();
+    tree_params->set_num_partitions_to_search_override(leaves);
+  }
+  vector<SearchParameters> params(queries.size());
+  for (auto& p : params) {
+    p.set_pre_reordering_epsilon(epsilon);
+    p.set_post_reordering_epsilon(epsilon);
+    if (tree_params) p.set_searcher_specific_optional_parameters(tree_params);
+    scann_->SetUnspecifiedParametersToDefaults(&p);
+  }
+  return params;
+}
+
+Status ScannInterface::SearchInRangeBatched(const DenseDataset<float>& queries,
+                                            float radius,
+                                            RangeSearchResults* res,
+                                            int leaves,
+                                            bool exact_reverification) const {
+  const auto* tree_ah =
+      dynamic_cast<const TreeAHHybridResidual*>(scann_.get());
+  if (tree_ah == nullptr) {
+    return FailedPreconditionError(
+        "Range search is only supported for tree-AH searchers.");
+  }
+  TF_ASSIGN_OR_RETURN(auto params,
+                      MakeRangeSearchParameters(queries, radius, leaves));
+  SCANN_RETURN_IF_ERROR(tree_ah->FindNeighborsInRangeBatched(
+      queries, params, exact_reverification, res));
+  for (auto& neighbor : res->neighbors) neighbor.second *= result_multiplier_;
+  return OkStatus();
+}
+
+Status ScannInterface::SearchInRangeBatchedWithExternalIds(
+    const DenseDataset<float>& queries, float radius,
+    ExternalIdRangeSearchResults* res, int leaves,
+    bool exact_reverification) const {
+  const auto* tree_ah =
+      dynamic_cast<const TreeAHHybridResidual*>(scann_.get());
+  if (tree_ah == nullptr) {
+    return FailedPreconditionError(
+        "Range search is only supported for tree-AH searchers.");
+  }
+  TF_ASSIGN_OR_RETURN(auto params,
+                      MakeRangeSearchParameters(queries, radius, leaves));
+  SCANN_RETURN_IF_ERROR(tree_ah->FindNeighborsInRangeBatchedWithExternalIds(
+      queries, params, exact_reverification, res));
+  for (auto& neighbor : res->neighbors) neighbor.second *= result_multiplier_;
+  return OkStatus();
+}
+
 Status ScannInterface::Serialize(std::string path) {
   TF_ASSIGN_OR_RETURN(auto opts, scann_->ExtractSingleMachineFactoryOptions());
 
@@ -270,6 +641,8 @@ static const std::string kSerializedPartitionerPbName = "serialized_partitioner"
 static const std::string kDataSetDataName = "dataset";
 static const std::string kDataPointDataName = "datapoint";
 static const std::string kHashedDataDataName = "hasheddata";
+static const std::string kExternalIdsDataName = "externalids";
+static const std::string kRestrictTokensDataName = "restricttokens";
 
 static Status AppendProtobufToFile(const std::string& pb_name,
                            google::protobuf::Message* message,
@@ -320,6 +693,33 @@ int ScannInterface::WriteIndex(std::string filename, bool write_dataset) {
       AppendProtobufToFile(kCodeBookPbName, opts.ah_codebook.get(), &file);
     if (opts.serialized_partitioner != nullptr)
       AppendProtobufToFile(kSerializedPartitionerPbName, opts.serialized_partitioner.get(), &file);
+    if (const auto* tree_ah =
+            dynamic_cast<const TreeAHHybridResidual*>(scann_.get())) {
+      vector<int64_t> external_ids = tree_ah->ExternalIdsByDatapoint();
+      if (!external_ids.empty()) {
+        AppendDataToFile(kExternalIdsDataName, ConstSpan<int64_t>(external_ids), &file);
+      }
+      vector<uint64_t> restrict_tokens = tree_ah->RestrictTokensByDatapoint();
+      if (!restrict_tokens.empty()) {
+        AppendDataToFile(kRestrictTokensDataName, ConstSpan<uint64_t>(restrict_tokens), &file);
+      }
+    }
+    // 磁盘重排文件在加载时直接复用, 写索引时只需落盘
+    const ReorderingInterface<float>* final_stage =
+        scann_->reordering_enabled() ? &scann_->reordering_helper() : nullptr;
+    if (const auto* tiered_helper =
+            dynamic_cast<const TieredReorderingHelper<float>*>(final_stage)) {
+      final_stage = &tiered_helper->final_stage();
+    }
+    if (const auto* file_backed_helper =
+            dynamic_cast<const FileBackedFloatDenseReorderingHelper*>(
+                final_stage)) {
+      auto sync_status = file_backed_helper->Sync();
+      if (!sync_status.ok()) {
+        LOG(ERROR) << "sync reordering file error: " << sync_status;
+        return -1;
+      }
+    }
     if (write_dataset) {
       if (opts.datapoints_by_token != nullptr) {
         vector<int32_t> datapoint_to_token(n_points_);
@@ -331,11 +731,41 @@ int ScannInterface::WriteIndex(std::string filename, bool write_dataset) {
       if (opts.hashed_dataset != nullptr) {
         AppendDataToFile(kHashedDataDataName, ConstSpan<uint8_t>((*opts.hashed_dataset).data()), &file);
       }
-      auto data = down_cast<const DenseDataset<float>*>(scann_->dataset())->data();
-      if (data.empty()) {
-        LOG(ERROR) << "can not get dataset";
+      const ReorderingInterface<float>* reordering_helper = final_stage;
+      // 数据集已释放时, 从重排数据(半精度/磁盘)还原
+      auto reconstruct_dataset = [&](const auto& helper) -> Status {
+        const DimensionIndex dims = helper.dimensionality();
+        vector<float> data(helper.size() * dims);
+        for (DatapointIndex i = 0; i < helper.size(); ++i) {
+          SCANN_RETURN_IF_ERROR(helper.Reconstruct(
+              i, MakeMutableSpan(data.data() + i * dims, dims)));
+        }
+        AppendDataToFile(kDataSetDataName, ConstSpan<float>(data), &file);
+        return OkStatus();
+      };
+      Status reconstruct_status = OkStatus();
+      if (scann_->dataset() != nullptr) {
+        auto data =
+            down_cast<const DenseDataset<float>*>(scann_->dataset())->data();
+        if (data.empty()) {
+          LOG(ERROR) << "can not get dataset";
+        } else {
+          AppendDataToFile(kDataSetDataName, data, &file);
+        }
+      } else if (const auto* half_precision_helper =
+                     dynamic_cast<const HalfPrecisionFloatDenseReorderingHelper*>(
+                         reordering_helper)) {
+        reconstruct_status = reconstruct_dataset(*half_precision_helper);
+      } else if (const auto* file_backed_helper =
+                     dynamic_cast<const FileBackedFloatDenseReorderingHelper*>(
+                         reordering_helper)) {
+        reconstruct_status = reconstruct_dataset(*file_backed_helper);
       } else {
-        AppendDataToFile(kDataSetDataName, data, &file);
+        LOG(ERROR) << "can not get dataset";
+      }
+      if (!reconstruct_status.ok()) {
+        LOG(ERROR) << "reconstruct dataset error: " << reconstruct_status;
+        return -1;
       }
     }
   } catch (std::exception &e) {
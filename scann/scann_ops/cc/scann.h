@@ -16,10 +16,13 @@
 #ifndef SCANN__SCANN_OPS_CC_SCANN_H_
 #define SCANN__SCANN_OPS_CC_SCANN_H_
 
+#include <functional>
+#include <future>
 #include <limits>
 
 #include "absl/memory/memory.h"
 #include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "google/protobuf/text_format.h"
 #include "scann/base/search_parameters.h"
@@ -33,8 +36,27 @@
 namespace tensorflow {
 namespace scann_ops {
 
+struct AsyncSearchOptions {
+  // A batch is dispatched once its oldest query has waited this long, or as
+  // soon as max_batch_size queries are queued, whichever comes first.
+  absl::Duration max_batching_delay = absl::Microseconds(200);
+  size_t max_batch_size = 64;
+
+  // Threads dispatching batches.  Each batch is one FindNeighborsBatched call.
+  int num_threads = 1;
+};
+
+using AsyncSearchCallback = std::function<void(Status, NNResultsVector)>;
+using AsyncExternalIdSearchCallback =
+    std::function<void(Status, ExternalIdNNResultsVector)>;
+
+class AsyncSearchBatcher;
+
 class ScannInterface {
  public:
+  ScannInterface();
+  ~ScannInterface();
+
   Status Initialize(ConstSpan<float> dataset,
                     ConstSpan<int32_t> datapoint_to_token,
                     ConstSpan<uint8_t> hashed_dataset,
@@ -54,18 +76,43 @@ class ScannInterface {
       SingleMachineFactoryOptions opts = SingleMachineFactoryOptions());
   Status Search(const DatapointPtr<float> query, NNResultsVector* res,
                 int final_nn, int pre_reorder_nn, int leaves) const;
+  Status SearchWithExternalIds(const DatapointPtr<float> query,
+                               ExternalIdNNResultsVector* res, int final_nn,
+                               int pre_reorder_nn, int leaves) const;
   Status SearchBatched(const DenseDataset<float>& queries,
                        MutableSpan<NNResultsVector> res, int final_nn,
                        int pre_reorder_nn, int leaves) const;
   Status SearchBatchedParallel(const DenseDataset<float>& queries,
                                MutableSpan<NNResultsVector> res, int final_nn,
                                int pre_reorder_nn, int leaves) const;
+  // Queues a single query for micro-batched search.  Queries submitted
+  // concurrently with the same final_nn, pre_reorder_nn and leaves are
+  // coalesced into one SearchBatched call.  done runs on a batching thread.
+  // Requires EnableAsyncSearch.
+  void SearchAsync(ConstSpan<float> query, int final_nn, int pre_reorder_nn,
+                   int leaves, AsyncSearchCallback done) const;
+  std::future<StatusOr<NNResultsVector>> SearchAsync(ConstSpan<float> query,
+                                                     int final_nn,
+                                                     int pre_reorder_nn,
+                                                     int leaves) const;
+  // As SearchAsync, returning external ids.  These queries are queued and
+  // run on the batching threads but are searched one at a time.
+  void SearchAsyncWithExternalIds(ConstSpan<float> query, int final_nn,
+                                  int pre_reorder_nn, int leaves,
+                                  AsyncExternalIdSearchCallback done) const;
+  Status SearchInRangeBatched(const DenseDataset<float>& queries, float radius,
+                              RangeSearchResults* res, int leaves,
+                              bool exact_reverification = true) const;
+  Status SearchInRangeBatchedWithExternalIds(
+      const DenseDataset<float>& queries, float radius,
+      ExternalIdRangeSearchResults* res, int leaves,
+      bool exact_reverification = true) const;
   Status Serialize(std::string path);
   int WriteIndex(std::string file_name, bool write_dataset = true);
   StatusOr<SingleMachineFactoryOptions> ExtractOptions();
 
-  template <typename T_idx>
-  void ReshapeNNResult(const NNResultsVector& res, T_idx* indices,
+  template <typename T_idx, typename ResultsVector>
+  void ReshapeNNResult(const ResultsVector& res, T_idx* indices,
                        float* distances);
   template <typename T_idx>
   void ReshapeBatchedNNResult(ConstSpan<NNResultsVector> res, T_idx* indices,
@@ -74,19 +121,51 @@ class ScannInterface {
   size_t n_points() const { return n_points_; }
   DimensionIndex dimensionality() const { return dimensionality_; }
   const ScannConfig* config() const { return &config_; }
-  void AddDocsWithIds(const std::vector<int64_t> &ids, const std::vector<float> &vecs);
+  // crowding_attributes is required, one per added point, when the index
+  // was built with crowding enabled.  restrict_tokens tags the added points
+  // once restrict tokens are set; untagged points match no token.
+  Status AddDocsWithIds(const std::vector<int64_t> &ids, const std::vector<float> &vecs,
+                        ConstSpan<int64_t> crowding_attributes = {},
+                        ConstSpan<uint64_t> restrict_tokens = {});
+
+  Status SetExternalIds(ConstSpan<int64_t> external_ids);
+  bool external_ids_enabled() const;
+
+  // One disjoint restrict token per datapoint, searched with the
+  // disjoint_restrict_token settings of the config.
+  Status SetRestrictTokens(ConstSpan<uint64_t> restrict_tokens);
+
+  // Must be called before serving: leaf data is moved without guarding
+  // in-flight searches.
+  Status EnableNumaPlacement(int threads_per_node,
+                             bool replicate_small_structures = true);
+
+  // Starts the batching threads behind SearchAsync.  Queries already queued
+  // under previous options are flushed first.  Must not race with
+  // SearchAsync.  Initialize stops async search, flushing queued queries
+  // against the old searcher; call this again afterwards.
+  Status EnableAsyncSearch(
+      const AsyncSearchOptions& options = AsyncSearchOptions());
 
  private:
+  SearchParameters MakeSearchParameters(int final_nn, int pre_reorder_nn,
+                                        int leaves) const;
+  StatusOr<vector<SearchParameters>> MakeRangeSearchParameters(
+      const DenseDataset<float>& queries, float radius, int leaves) const;
+  Status CheckAsyncSearchQuery(ConstSpan<float> query) const;
+
   size_t n_points_;
   DimensionIndex dimensionality_;
   std::unique_ptr<SingleMachineSearcherBase<float>> scann_;
   ScannConfig config_;
 
   float result_multiplier_;
+
+  std::unique_ptr<AsyncSearchBatcher> async_batcher_;
 };
 
-template <typename T_idx>
-void ScannInterface::ReshapeNNResult(const NNResultsVector& res, T_idx* indices,
+template <typename T_idx, typename ResultsVector>
+void ScannInterface::ReshapeNNResult(const ResultsVector& res, T_idx* indices,
                                      float* distances) {
   for (const auto& p : res) {
     *(indices++) = static_cast<T_idx>(p.first);
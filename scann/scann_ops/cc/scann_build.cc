@@ -162,11 +162,73 @@ int ScannExt::BuildIndex(const std::vector<float>& dataset, int dimensionality,
     int train_sample_size = dataset.size()/dimensionality * train_sample_ratio;
     scann_conf.mutable_partitioning()->set_expected_sample_size(train_sample_size);
   }
+  // ah 码本训练采样数
+  if (conf_map.count("ah_train_sample_size")) {
+    int ah_sample_size = std::atoi(conf_map["ah_train_sample_size"].c_str());
+    if (ah_sample_size > 0) {
+      scann_conf.mutable_hash()->mutable_asymmetric_hash()->set_expected_sample_size(ah_sample_size);
+    }
+  }
+  // ah 各 block 码本并行训练, 默认关闭; 开启后第 i 个 block 的种子为 clustering_seed + i, 码本与串行训练不同
+  if (conf_map.count("ah_train_blocks_in_parallel")) {
+    bool in_parallel = std::atoi(conf_map["ah_train_blocks_in_parallel"].c_str()) != 0;
+    scann_conf.mutable_hash()->mutable_asymmetric_hash()->set_train_blocks_in_parallel(in_parallel);
+  }
+  // ah 码本按 anisotropic loss 训练, 需要 noise_shaping_threshold
+  if (conf_map.count("ah_anisotropic_training")) {
+    bool anisotropic = std::atoi(conf_map["ah_anisotropic_training"].c_str()) != 0;
+    scann_conf.mutable_hash()->mutable_asymmetric_hash()->set_use_anisotropic_codebook_training(anisotropic);
+  }
+  if (conf_map.count("ah_anisotropic_iterations")) {
+    int iterations = std::atoi(conf_map["ah_anisotropic_iterations"].c_str());
+    if (iterations > 0) {
+      scann_conf.mutable_hash()->mutable_asymmetric_hash()->set_anisotropic_training_iterations(iterations);
+    }
+  }
+  // 训练 OPQ 旋转矩阵, 与码本一起保存
+  if (conf_map.count("opq") && std::atoi(conf_map["opq"].c_str()) != 0) {
+    scann_conf.mutable_hash()->mutable_asymmetric_hash()->mutable_projection()->set_projection_type(ProjectionConfig::OPQ);
+    if (conf_map.count("opq_iterations")) {
+      int opq_iterations = std::atoi(conf_map["opq_iterations"].c_str());
+      scann_conf.mutable_hash()->mutable_asymmetric_hash()->mutable_projection()->set_opq_iterations(opq_iterations);
+    }
+  }
+  // 聚类中心数不小于该值时, query 分桶先用 LUT16 量化中心粗排再精排, 0 表示关闭
+  if (conf_map.count("ah_query_tokenization_min_centers")) {
+    int min_centers = std::atoi(conf_map["ah_query_tokenization_min_centers"].c_str());
+    scann_conf.mutable_partitioning()->set_asymmetric_query_tokenization_min_centers(min_centers);
+  }
   // 预估最大搜索数
   if (conf_map.count("max_search_num")) {
     int max_num = std::atoi(conf_map["max_search_num"].c_str());
     scann_conf.mutable_exact_reordering()->set_approx_num_neighbors(2*max_num);
   }
+  // 精排数据存储精度: bf16 / fp16, 默认 float32
+  if (conf_map.count("reordering_storage")) {
+    const std::string& storage = conf_map["reordering_storage"];
+    if (storage == "bf16") {
+      scann_conf.mutable_exact_reordering()->set_storage_type(ExactReordering::BFLOAT16);
+    } else if (storage == "fp16") {
+      scann_conf.mutable_exact_reordering()->set_storage_type(ExactReordering::FLOAT16);
+    }
+  }
+  // 精排向量存放在本地磁盘文件中, 按需读取, 内存只保留热点行缓存
+  if (conf_map.count("reordering_file")) {
+    auto* out_of_core = scann_conf.mutable_exact_reordering()->mutable_out_of_core();
+    out_of_core->set_filename(conf_map["reordering_file"]);
+    if (conf_map.count("reordering_cache_rows")) {
+      out_of_core->set_cache_size_rows(std::atoll(conf_map["reordering_cache_rows"].c_str()));
+    }
+  }
+  // 精排前先用 int8 定点粗排, 保留该数量的候选再做精排, 0 表示关闭
+  if (conf_map.count("reordering_int8_num")) {
+    int int8_num = std::atoi(conf_map["reordering_int8_num"].c_str());
+    if (int8_num > 0) {
+      auto* stage = scann_conf.mutable_exact_reordering()->add_tiered_stages();
+      stage->set_num_neighbors(int8_num);
+      stage->mutable_fixed_point()->set_enabled(true);
+    }
+  }
   if (conf_map.count("nprobe")) {
     nprobe_ = std::atoi(conf_map["nprobe"].c_str());
     scann_conf.mutable_partitioning()->mutable_query_spilling()->set_max_spill_centers(nprobe_);
@@ -183,8 +245,35 @@ int ScannExt::BuildIndex(const std::vector<float>& dataset, int dimensionality,
   RuntimeErrorIfNotOk("Error during build: ", status);
   return 0;
 }
-void ScannExt::AddDocsWithIds(const std::vector<int64_t>& ids, const std::vector<float>& vecs) {
-  scann_->AddDocsWithIds(ids, vecs);
+void ScannExt::AddDocsWithIds(const std::vector<int64_t>& ids, const std::vector<float>& vecs,
+                              const std::vector<int64_t>& crowding_attributes,
+                              const std::vector<uint64_t>& restrict_tokens) {
+  RuntimeErrorIfNotOk("Error during add: ",
+                      scann_->AddDocsWithIds(ids, vecs,
+                                             absl::MakeConstSpan(crowding_attributes),
+                                             absl::MakeConstSpan(restrict_tokens)));
+}
+
+int ScannExt::SetExternalIds(const std::vector<int64_t>& ids) {
+  auto status = scann_->SetExternalIds(absl::MakeConstSpan(ids));
+  if (!status.ok()) {
+    LOG(ERROR) << "set external ids error: " << status;
+    return -1;
+  }
+  return 0;
+}
+
+bool ScannExt::ExternalIdsEnabled() const {
+  return scann_->external_ids_enabled();
+}
+
+int ScannExt::SetRestrictTokens(const std::vector<uint64_t>& tokens) {
+  auto status = scann_->SetRestrictTokens(absl::MakeConstSpan(tokens));
+  if (!status.ok()) {
+    LOG(ERROR) << "set restrict tokens error: " << status;
+    return -1;
+  }
+  return 0;
 }
 
 int ScannExt::WriteIndex(const char* filename, bool write_dataset) {
@@ -224,18 +313,98 @@ void ScannExt::Search(long n, const std::vector<float> &vecs, long k,
                         std::vector<float> &distances, std::vector<int64_t> &labels) {
   if (n == 1) {
     DatapointPtr<float> ptr(nullptr, vecs.data(), vecs.size(), vecs.size());
-    NNResultsVector res;
-    auto status = scann_->Search(ptr, &res, k, -1, nprobe_);
-    RuntimeErrorIfNotOk("Error during search: ", status);
-
     distances.resize(k);
     labels.resize(k);
-    scann_->ReshapeNNResult(res, labels.data(), distances.data());
+    if (scann_->external_ids_enabled()) {
+      ExternalIdNNResultsVector res;
+      auto status = scann_->SearchWithExternalIds(ptr, &res, k, -1, nprobe_);
+      RuntimeErrorIfNotOk("Error during search: ", status);
+      scann_->ReshapeNNResult(res, labels.data(), distances.data());
+    } else {
+      NNResultsVector res;
+      auto status = scann_->Search(ptr, &res, k, -1, nprobe_);
+      RuntimeErrorIfNotOk("Error during search: ", status);
+      scann_->ReshapeNNResult(res, labels.data(), distances.data());
+    }
   } else {
     // batch接口
   }
   return;
 }
 
+int ScannExt::EnableAsyncSearch(int max_delay_us, int max_batch_size, int num_threads) {
+  if (max_delay_us < 0 || max_batch_size <= 0 || num_threads <= 0) {
+    LOG(ERROR) << "enable async search error: max_delay_us must be non-negative, "
+               << "max_batch_size and num_threads must be positive, got "
+               << max_delay_us << ", " << max_batch_size << ", " << num_threads;
+    return -1;
+  }
+  AsyncSearchOptions options;
+  options.max_batching_delay = absl::Microseconds(max_delay_us);
+  options.max_batch_size = max_batch_size;
+  options.num_threads = num_threads;
+  auto status = scann_->EnableAsyncSearch(options);
+  if (!status.ok()) {
+    LOG(ERROR) << "enable async search error: " << status;
+    return -1;
+  }
+  return 0;
+}
+
+void ScannExt::SearchAsync(const std::vector<float> &vec, long k,
+                           std::function<void(int, std::vector<float>, std::vector<int64_t>)> done) {
+  ScannInterface* scann = scann_.get();
+  auto reply = [scann, k, done](Status status, auto res) {
+    if (!status.ok()) {
+      LOG(ERROR) << "Error during async search: " << status;
+      done(-1, {}, {});
+      return;
+    }
+    std::vector<float> distances(k);
+    std::vector<int64_t> labels(k);
+    scann->ReshapeNNResult(res, labels.data(), distances.data());
+    done(0, std::move(distances), std::move(labels));
+  };
+  // 外部 id 检索同样在批处理线程上执行, 但逐条检索不合并
+  if (scann_->external_ids_enabled()) {
+    scann_->SearchAsyncWithExternalIds(absl::MakeConstSpan(vec), k, -1, nprobe_,
+                                       reply);
+  } else {
+    scann_->SearchAsync(absl::MakeConstSpan(vec), k, -1, nprobe_, reply);
+  }
+}
+
+void ScannExt::RangeSearch(long n, const std::vector<float> &vecs, float radius,
+                           std::vector<size_t> &offsets, std::vector<float> &distances,
+                           std::vector<int64_t> &labels) {
+  DenseDataset<float> queries(vecs, n);
+  // 未设置外部 id 时结果只是内部下标, 不能当作 id 返回
+  const bool external_ids = scann_->external_ids_enabled();
+  if (!external_ids) {
+    LOG_FIRST_N(ERROR, 1) << "scann index has no external ids, labels are set to -1";
+  }
+  auto copy_results = [&](const auto& res) {
+    offsets.assign(res.offsets.begin(), res.offsets.end());
+    distances.resize(res.neighbors.size());
+    labels.resize(res.neighbors.size());
+    for (size_t i = 0; i < res.neighbors.size(); ++i) {
+      labels[i] = external_ids ? static_cast<int64_t>(res.neighbors[i].first) : -1;
+      distances[i] = res.neighbors[i].second;
+    }
+  };
+  if (external_ids) {
+    ExternalIdRangeSearchResults res;
+    auto status =
+        scann_->SearchInRangeBatchedWithExternalIds(queries, radius, &res, nprobe_);
+    RuntimeErrorIfNotOk("Error during range search: ", status);
+    copy_results(res);
+  } else {
+    RangeSearchResults res;
+    auto status = scann_->SearchInRangeBatched(queries, radius, &res, nprobe_);
+    RuntimeErrorIfNotOk("Error during range search: ", status);
+    copy_results(res);
+  }
+}
+
 }  // namespace scann_ops
 }  // namespace tensorflow
@@ -1,6 +1,7 @@
 #ifndef SCANN__SCANN_OPS_CC_SCANN_NPY_H_
 #define SCANN__SCANN_OPS_CC_SCANN_NPY_H_
 
+#include <functional>
 #include <limits>
 #include <memory>
 #include <optional>
@@ -18,6 +19,17 @@ class ScannExt {
   ScannExt();
   void Search(long n, const std::vector<float> &vecs, long k, std::vector<float> &distances,
               std::vector<int64_t> &labels);
+  // 开启异步检索: 并发到达的单条 query 等待 max_delay_us 微秒或攒满 max_batch_size 条后合并为一次批量检索
+  // 重新 BuildIndex 会停止异步检索, 之后须再次调用
+  int EnableAsyncSearch(int max_delay_us = 200, int max_batch_size = 64, int num_threads = 1);
+  // 异步检索单条 query, 完成后在批处理线程上回调 done(ret, distances, labels), ret 非 0 表示失败
+  void SearchAsync(const std::vector<float> &vec, long k,
+                   std::function<void(int, std::vector<float>, std::vector<int64_t>)> done);
+  // 返回距离在 radius 内的全部结果, 第 i 个 query 的结果为 [offsets[i], offsets[i+1])
+  // 未设置外部 id 时 labels 全为 -1
+  void RangeSearch(long n, const std::vector<float> &vecs, float radius,
+                   std::vector<size_t> &offsets, std::vector<float> &distances,
+                   std::vector<int64_t> &labels);
   int BuildIndex(const std::vector<float>& dataset, int dimensionality, const char* config, int conf_length);
   int BuildIndex(const char* conf_str, int conf_length, const char* codebook_str, int code_length,
                  const char* partition_str, int partition_length,
@@ -26,7 +38,16 @@ class ScannExt {
                  const std::vector<uint8_t>& hashed_dataset,
                  int dimensionality);
   int WriteIndex(const char* file, bool write_dataset = true);
-  void AddDocsWithIds(const std::vector<int64_t> &ids, const std::vector<float> &vecs);
+  // 索引开启 crowding 时须为每个新增点给出 crowding 属性;
+  // 已设置 restrict token 时可为新增点指定 token
+  void AddDocsWithIds(const std::vector<int64_t> &ids, const std::vector<float> &vecs,
+                      const std::vector<int64_t> &crowding_attributes = {},
+                      const std::vector<uint64_t> &restrict_tokens = {});
+  // 按数据点顺序设置外部 id, 之后 Search 直接返回外部 id
+  int SetExternalIds(const std::vector<int64_t> &ids);
+  bool ExternalIdsEnabled() const;
+  // 按数据点顺序设置 disjoint restrict token
+  int SetRestrictTokens(const std::vector<uint64_t> &tokens);
  private:
   int nprobe_ = -1;
   int training_thread_num_ = 2;
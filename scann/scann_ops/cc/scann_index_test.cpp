@@ -53,6 +53,8 @@ static const std::string kSerializedPartitionerPbName = "serialized_partitioner"
 static const std::string kDataSetDataName = "dataset";
 static const std::string kDataPointDataName = "datapoint";
 static const std::string kHashedDataDataName = "hasheddata";
+static const std::string kExternalIdsDataName = "externalids";
+static const std::string kRestrictTokensDataName = "restricttokens";
 
 int ScannIndex::loadconfig(const std::string& filename) {
   std::ifstream fin(filename, std::ifstream::binary);
@@ -102,7 +104,6 @@ void ScannIndex::add_with_ids(const std::vector<int64_t> &ids, const std::vector
     return;
   }
   //scann_->AddDocsWithIds(ids, vecs);
-  id_map_.insert(id_map_.end(), ids.begin(), ids.end());
   data_set_.insert(data_set_.end(), vecs.begin(), vecs.end());
   return;
 }
@@ -113,7 +114,6 @@ void ScannIndex::add_with_ids2(const std::vector<int64_t> &ids, const std::vecto
         << " with dimensionality " << dimensionality_;
     return;
   }
-  id_map_.insert(id_map_.end(), ids.begin(), ids.end());
   scann_->AddDocsWithIds(ids, vecs);
   return;
 }
@@ -121,7 +121,18 @@ void ScannIndex::add_with_ids2(const std::vector<int64_t> &ids, const std::vecto
 void ScannIndex::range_search(long n, const std::vector<float> &vecs, float radius,
                               std::vector<std::vector<float>> &distances,
                               std::vector<std::vector<int64_t>> &labels) {
-  LOG(ERROR) << "scann index don't support range search";
+  std::vector<size_t> offsets;
+  std::vector<float> flat_distances;
+  std::vector<int64_t> flat_labels;
+  scann_->RangeSearch(n, vecs, radius, offsets, flat_distances, flat_labels);
+  distances.resize(n);
+  labels.resize(n);
+  for (long i = 0; i < n; i++) {
+    distances[i].assign(flat_distances.begin() + offsets[i],
+                        flat_distances.begin() + offsets[i + 1]);
+    labels[i].assign(flat_labels.begin() + offsets[i],
+                     flat_labels.begin() + offsets[i + 1]);
+  }
   return;
 }
 
@@ -131,17 +142,20 @@ void ScannIndex::update(const std::vector<int64_t> &ids, const std::vector<float
 
 void ScannIndex::clear() {
   scann_.reset();
-  id_map_.clear();
   data_set_.clear();
 }
 
-void ScannIndex::train(const std::vector<int64_t> &ids, const std::vector<float> &vecs, const std::string& config, const std::string& output_file) {
+int ScannIndex::train(const std::vector<int64_t> &ids, const std::vector<float> &vecs, const std::string& config, const std::string& output_file) {
   // train when rebuild (save)
-  id_map_.insert(id_map_.end(), ids.begin(), ids.end());
   config_ = config;
   scann_->BuildIndex(vecs, dimensionality_, config.c_str(), config.length());
+  // 外部 id 存在索引叶子中, 检索结果直接返回外部 id
+  if (scann_->SetExternalIds(ids) != 0) {
+    LOG(ERROR) << "ids size " << ids.size() << " unmatch vecs size " << vecs.size();
+    return -1;
+  }
   scann_->WriteIndex(output_file.c_str(), false);
-  return;
+  return 0;
 }
 
 int ScannIndex::save(const std::string &filename) {
@@ -170,8 +184,6 @@ int ScannIndex::save(const std::string &filename) {
 void ScannIndex::search(long n, const std::vector<float> &vecs, long k,
                         std::vector<float> &distances, std::vector<int64_t> &labels) {
 
-  //if (id_map_.empty()) return;
-
   std::vector<int64_t> index_ids;
   std::vector<float> index_distances;
   scann_->Search(n, vecs, k, index_distances, index_ids);
@@ -181,13 +193,13 @@ void ScannIndex::search(long n, const std::vector<float> &vecs, long k,
         << " result dist num: " << index_distances.size();
     return;
   }
+  // 未设置外部 id 时结果只是内部下标, 不能当作 id 返回
+  const bool external_ids = scann_->ExternalIdsEnabled();
+  if (!external_ids) {
+    LOG_FIRST_N(ERROR, 1) << "scann index has no external ids, labels are set to -1";
+  }
   for (int i = 0; i < k; i++) {
-    auto idx = index_ids[i];
-    if (idx >= 0 && idx < id_map_.size()) {
-      labels[i] = id_map_[idx];
-    } else {
-      labels[i] = -1;
-    }
+    labels[i] = external_ids ? index_ids[i] : -1;
     distances[i] = index_distances[i];
     // LOG(INFO) << "i: " << i << ", index: " << idx << ", distance: " << index_distances[i]
     //     << ", label: " << labels[i];
@@ -203,6 +215,8 @@ int ScannIndex::load(const std::string& file_name) {
 
   std::ifstream fin(file_name, std::ifstream::binary);
   std::vector<float> dataset_tmp;
+  std::vector<int64_t> external_ids;
+  std::vector<uint64_t> restrict_tokens;
 
   for (std::string line; std::getline(fin, line);) {
     if (line.size() > kConfigPrefix.size() && line.compare(0, kConfigPrefix.size(), kConfigPrefix) == 0) {
@@ -263,6 +277,10 @@ int ScannIndex::load(const std::string& file_name) {
           datapoint_to_token_.insert(datapoint_to_token_.end(), (int32_t*)(buffer.data()), (int32_t*)(buffer.data() + length));
         } else if (data_name == kHashedDataDataName) {
           hashed_dataset_.insert(hashed_dataset_.end(), (uint8_t*)(buffer.data()), (uint8_t*)(buffer.data() + length));
+        } else if (data_name == kExternalIdsDataName) {
+          external_ids.assign((int64_t*)(buffer.data()), (int64_t*)(buffer.data() + length));
+        } else if (data_name == kRestrictTokensDataName) {
+          restrict_tokens.assign((uint64_t*)(buffer.data()), (uint64_t*)(buffer.data() + length));
         }
       }
     } else if (line.size() > kIdMapPrefix.size() && line.compare(0, kIdMapPrefix.size(), kIdMapPrefix) == 0) {
@@ -276,7 +294,8 @@ int ScannIndex::load(const std::string& file_name) {
           LOG(ERROR) << "Failed to parse " << sub_str;
           return -1;
         }
-        id_map_.insert(id_map_.end(), (int64_t*)(buffer.data()), (int64_t*)(buffer.data() + length));
+        // 兼容旧格式的 idmap
+        external_ids.assign((int64_t*)(buffer.data()), (int64_t*)(buffer.data() + length));
       }
     }
   }
@@ -287,6 +306,12 @@ int ScannIndex::load(const std::string& file_name) {
 		  //data_set_, datapoint_to_token_, hashed_dataset_,
 		  dataset_tmp, datapoint_to_token_, hashed_dataset_,
 		  dimensionality_);
+  if (!external_ids.empty() && scann_->SetExternalIds(external_ids) != 0) {
+    return -1;
+  }
+  if (!restrict_tokens.empty() && scann_->SetRestrictTokens(restrict_tokens) != 0) {
+    return -1;
+  }
   return 0;
 }
 
@@ -60,7 +60,7 @@ class ScannIndex {
   void clear();
   int load(const std::string &file);
   int save(const std::string &file);
-  void train(const std::vector<int64_t> &ids, const std::vector<float> &vecs, const std::string& config, const std::string& output_file);
+  int train(const std::vector<int64_t> &ids, const std::vector<float> &vecs, const std::string& config, const std::string& output_file);
   ~ScannIndex();
 
   int loadconfig(const std::string& filename);
@@ -72,7 +72,6 @@ class ScannIndex {
   std::string config_;
   int dimensionality_=128;
   int train_threads_num_ = 2;
-  std::vector<int64_t> id_map_;
 
   std::vector<float> data_set_;
   std::vector<int32_t> datapoint_to_token_;
@@ -15,6 +15,8 @@
 #ifndef SCANN__TREE_X_HYBRID_INTERNAL_UTILS_H_
 #define SCANN__TREE_X_HYBRID_INTERNAL_UTILS_H_
 
+#include <algorithm>
+
 #include "scann/base/restrict_allowlist.h"
 #include "scann/base/search_parameters.h"
 #include "scann/base/single_machine_base.h"
@@ -25,10 +27,42 @@
 namespace tensorflow {
 namespace scann_ops {
 
-inline void TranslateGlobalToLeafLocalWhitelist(
+inline bool TranslateGlobalToLeafLocalWhitelist(
     const SearchParameters& params,
     ConstSpan<DatapointIndex> leaf_local_to_global,
-    SearchParameters* leaf_params) {}
+    SearchParameters* leaf_params) {
+  if (!params.restricts_enabled()) {
+    leaf_params->DisableRestricts();
+    return true;
+  }
+
+  RestrictAllowlist* leaf_whitelist = leaf_params->mutable_restrict_whitelist();
+  if (leaf_whitelist) {
+    leaf_whitelist->Initialize(leaf_local_to_global.size(), false);
+  } else {
+    leaf_params->EnableRestricts(leaf_local_to_global.size(), false);
+    leaf_whitelist = leaf_params->mutable_restrict_whitelist();
+  }
+
+  const RestrictAllowlist& global_whitelist = *params.restrict_whitelist();
+  constexpr size_t kBitsPerWord = RestrictAllowlist::kBitsPerWord;
+  size_t* leaf_words = leaf_whitelist->data();
+  size_t any_whitelisted = 0;
+  for (size_t word_start = 0; word_start < leaf_local_to_global.size();
+       word_start += kBitsPerWord) {
+    const size_t word_end =
+        std::min(word_start + kBitsPerWord, leaf_local_to_global.size());
+    size_t word = 0;
+    for (size_t i = word_start; i < word_end; ++i) {
+      const bool whitelisted = global_whitelist.IsWhitelistedWithDefault(
+          leaf_local_to_global[i], false);
+      word |= static_cast<size_t>(whitelisted) << (i - word_start);
+    }
+    leaf_words[word_start / kBitsPerWord] = word;
+    any_whitelisted |= word;
+  }
+  return any_whitelisted != 0;
+}
 
 template <template <class> class V, typename T>
 StatusOr<SingleMachineFactoryOptions> MergeAHLeafOptions(
@@ -0,0 +1,139 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#include "scann/tree_x_hybrid/restrict_token_postings.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace tensorflow {
+namespace scann_ops {
+
+const RestrictTokenPostings::LeafPostings*
+RestrictTokenPostings::TokenPostings::FindLeaf(int32_t leaf) const {
+  auto it = std::lower_bound(
+      leaves.begin(), leaves.end(), leaf,
+      [](const LeafPostings& lp, int32_t leaf) { return lp.leaf < leaf; });
+  if (it == leaves.end() || it->leaf != leaf) return nullptr;
+  return &*it;
+}
+
+StatusOr<unique_ptr<RestrictTokenPostings>> RestrictTokenPostings::Build(
+    ConstSpan<RestrictToken> token_by_datapoint,
+    ConstSpan<std::vector<DatapointIndex>> datapoints_by_leaf) {
+  auto result = make_unique<RestrictTokenPostings>();
+  result->token_by_datapoint_.assign(token_by_datapoint.begin(),
+                                     token_by_datapoint.end());
+  for (size_t leaf : IndicesOf(datapoints_by_leaf)) {
+    ConstSpan<DatapointIndex> leaf_datapoints = datapoints_by_leaf[leaf];
+    for (size_t local_index : IndicesOf(leaf_datapoints)) {
+      const DatapointIndex dp_index = leaf_datapoints[local_index];
+      if (dp_index >= token_by_datapoint.size()) {
+        return InvalidArgumentError(
+            "Datapoint %d in leaf %d has no restrict token (only %d tokens "
+            "given).",
+            dp_index, leaf, token_by_datapoint.size());
+      }
+      result->Append(dp_index, leaf, local_index, token_by_datapoint[dp_index]);
+    }
+  }
+  return result;
+}
+
+void RestrictTokenPostings::Append(DatapointIndex dp_index, int32_t leaf,
+                                   DatapointIndex local_index,
+                                   RestrictToken token) {
+  if (dp_index >= token_by_datapoint_.size()) {
+    token_by_datapoint_.resize(dp_index + 1, kNoToken);
+  }
+  token_by_datapoint_[dp_index] = token;
+  if (token == kNoToken) return;
+
+  TokenPostings& postings = postings_[token];
+  if (postings.leaves.empty() || postings.leaves.back().leaf < leaf) {
+    postings.leaves.push_back({leaf, {}});
+  }
+  LeafPostings* leaf_postings = &postings.leaves.back();
+  if (leaf_postings->leaf != leaf) {
+    auto it = std::lower_bound(
+        postings.leaves.begin(), postings.leaves.end(), leaf,
+        [](const LeafPostings& lp, int32_t leaf) { return lp.leaf < leaf; });
+    if (it == postings.leaves.end() || it->leaf != leaf) {
+      it = postings.leaves.insert(it, {leaf, {}});
+    }
+    leaf_postings = &*it;
+  }
+  DCHECK(leaf_postings->local_indices.empty() ||
+         leaf_postings->local_indices.back() < local_index);
+  leaf_postings->local_indices.push_back(local_index);
+  ++postings.size;
+}
+
+const RestrictTokenPostings::TokenPostings* RestrictTokenPostings::Find(
+    RestrictToken token) const {
+  auto it = postings_.find(token);
+  return it == postings_.end() ? nullptr : &it->second;
+}
+
+RestrictTokenSearchDecision PlanRestrictTokenSearch(
+    const RestrictTokenPlannerInputs& inputs,
+    const DisjointRestrictToken& config) {
+  RestrictTokenSearchDecision result;
+  result.selectivity =
+      inputs.num_datapoints == 0
+          ? 0.0f
+          : static_cast<float>(inputs.num_matching) / inputs.num_datapoints;
+
+  const bool below_brute_force_bar =
+      inputs.num_matching <= config.low_bar_for_brute_force() ||
+      result.selectivity <= config.brute_force_max_selectivity();
+  if (inputs.can_brute_force && below_brute_force_bar) {
+    result.plan = RestrictTokenSearchPlan::kBruteForce;
+    return result;
+  }
+
+  if (result.selectivity >= config.post_filter_min_selectivity()) {
+    result.plan = RestrictTokenSearchPlan::kPostFilter;
+    result.num_centers_to_search = inputs.num_centers_to_search;
+    return result;
+  }
+
+  const size_t widened = std::ceil(inputs.num_centers_to_search /
+                                   std::max(result.selectivity, 1e-6f));
+  result.num_centers_to_search =
+      std::max<size_t>(1, std::min(widened, inputs.num_leaves));
+
+  if (inputs.can_brute_force && inputs.num_leaves > 0 &&
+      inputs.num_ah_blocks > 0) {
+    // LUT16 scores 32 datapoints per block per shuffle; exact float distances
+    // take one 8-wide FMA per 8 dimensions.
+    const double ann_cost = static_cast<double>(result.num_centers_to_search) *
+                            inputs.num_datapoints / inputs.num_leaves *
+                            inputs.num_ah_blocks / 32.0;
+    const double brute_force_cost =
+        static_cast<double>(inputs.num_matching) * inputs.dimensionality / 8.0;
+    if (brute_force_cost <= ann_cost) {
+      result.plan = RestrictTokenSearchPlan::kBruteForce;
+      return result;
+    }
+  }
+
+  result.plan = RestrictTokenSearchPlan::kFilteredAnn;
+  return result;
+}
+
+}  // namespace scann_ops
+}  // namespace tensorflow
@@ -0,0 +1,117 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#ifndef SCANN__TREE_X_HYBRID_RESTRICT_TOKEN_POSTINGS_H_
+#define SCANN__TREE_X_HYBRID_RESTRICT_TOKEN_POSTINGS_H_
+
+#include "absl/container/flat_hash_map.h"
+#include "scann/proto/disjoint_restrict_token.pb.h"
+#include "scann/utils/types.h"
+
+namespace tensorflow {
+namespace scann_ops {
+
+using RestrictToken = uint64_t;
+
+// Posting lists for disjoint restrict tokens, i.e. each datapoint carries at
+// most one token.  For every token, the leaf-local indices of the datapoints
+// carrying it are kept grouped by leaf, both in ascending order.
+class RestrictTokenPostings {
+ public:
+  static constexpr RestrictToken kNoToken =
+      numeric_limits<RestrictToken>::max();
+
+  struct LeafPostings {
+    int32_t leaf;
+    std::vector<DatapointIndex> local_indices;
+  };
+
+  struct TokenPostings {
+    const LeafPostings* FindLeaf(int32_t leaf) const;
+
+    DatapointIndex size = 0;
+    std::vector<LeafPostings> leaves;
+  };
+
+  RestrictTokenPostings() {}
+
+  static StatusOr<unique_ptr<RestrictTokenPostings>> Build(
+      ConstSpan<RestrictToken> token_by_datapoint,
+      ConstSpan<std::vector<DatapointIndex>> datapoints_by_leaf);
+
+  void Append(DatapointIndex dp_index, int32_t leaf, DatapointIndex local_index,
+              RestrictToken token);
+
+  const TokenPostings* Find(RestrictToken token) const;
+
+  RestrictToken TokenForDatapoint(DatapointIndex dp_index) const {
+    return dp_index < token_by_datapoint_.size()
+               ? token_by_datapoint_[dp_index]
+               : kNoToken;
+  }
+
+  DatapointIndex num_datapoints() const { return token_by_datapoint_.size(); }
+
+  ConstSpan<RestrictToken> token_by_datapoint() const {
+    return token_by_datapoint_;
+  }
+
+  size_t num_tokens() const { return postings_.size(); }
+
+ private:
+  absl::flat_hash_map<RestrictToken, TokenPostings> postings_;
+
+  vector<RestrictToken> token_by_datapoint_;
+};
+
+enum class RestrictTokenSearchPlan {
+  kFilteredAnn,
+  kBruteForce,
+  kPostFilter,
+};
+
+struct RestrictTokenPlannerInputs {
+  DatapointIndex num_matching = 0;
+  DatapointIndex num_datapoints = 0;
+  size_t num_leaves = 0;
+  size_t num_centers_to_search = 0;
+  DimensionIndex dimensionality = 0;
+  size_t num_ah_blocks = 0;
+  bool can_brute_force = false;
+};
+
+struct RestrictTokenSearchDecision {
+  RestrictTokenSearchPlan plan = RestrictTokenSearchPlan::kFilteredAnn;
+
+  float selectivity = 1.0f;
+
+  size_t num_centers_to_search = 0;
+};
+
+// Picks the cheapest way of answering a query restricted to one token.  Very
+// selective tokens are brute-forced over their posting list, unselective ones
+// are answered by an unrestricted search followed by filtering, and everything
+// in between runs the leaf searchers with a restrict allowlist over a number of
+// leaves widened so that about as many eligible datapoints are scored as an
+// unrestricted search would score.
+RestrictTokenSearchDecision PlanRestrictTokenSearch(
+    const RestrictTokenPlannerInputs& inputs,
+    const DisjointRestrictToken& config);
+
+}  // namespace scann_ops
+}  // namespace tensorflow
+
+#endif
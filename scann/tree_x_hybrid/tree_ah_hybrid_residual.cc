@@ -21,6 +21,9 @@
 #include <unordered_set>
 
 #include "absl/flags/flag.h"
+#include "absl/numeric/int128.h"
+#include "absl/strings/numbers.h"
+#include "scann/base/restrict_allowlist.h"
 #include "scann/base/search_parameters.h"
 #include "scann/base/single_machine_base.h"
 #include "scann/distance_measures/distance_measure_factory.h"
@@ -34,6 +37,7 @@
 #include "scann/proto/centers.pb.h"
 #include "scann/proto/distance_measure.pb.h"
 #include "scann/tree_x_hybrid/internal/utils.h"
+#include "scann/tree_x_hybrid/restrict_token_postings.h"
 #include "scann/tree_x_hybrid/tree_x_params.h"
 
 #include "absl/synchronization/mutex.h"
@@ -41,7 +45,11 @@
 #include "absl/time/time.h"
 #include "scann/oss_wrappers/scann_status_builder.h"
 #include "scann/utils/fast_top_neighbors.h"
+#include "scann/utils/fast_top_neighbors_crowding.h"
+#include "scann/utils/parallel_for.h"
 #include "scann/utils/types.h"
+#include "scann/utils/util_functions.h"
+#include "scann/utils/zip_sort.h"
 #include "tensorflow/core/lib/core/errors.h"
 
 namespace tensorflow {
@@ -52,25 +60,37 @@ using asymmetric_hashing2::AsymmetricHashingOptionalParameters;
 Status TreeAHHybridResidual::EnableCrowdingImpl(
     ConstSpan<int64_t> datapoint_index_to_crowding_attribute) {
   if (leaf_searchers_.empty()) return OkStatus();
+  vector<std::vector<int64_t>> crowding_attributes_by_token(
+      leaf_searchers_.size());
   for (size_t token = 0; token < leaf_searchers_.size(); ++token) {
     ConstSpan<DatapointIndex> cur_leaf_datapoints = datapoints_by_token_[token];
-    vector<int64_t> leaf_datapoint_index_to_crowding_attribute(
+    vector<int64_t>& leaf_datapoint_index_to_crowding_attribute =
+        crowding_attributes_by_token[token];
+    leaf_datapoint_index_to_crowding_attribute.resize(
         cur_leaf_datapoints.size());
     for (size_t i = 0; i < cur_leaf_datapoints.size(); ++i) {
       leaf_datapoint_index_to_crowding_attribute[i] =
           datapoint_index_to_crowding_attribute[cur_leaf_datapoints[i]];
     }
     Status status = leaf_searchers_[token]->EnableCrowding(
-        std::move(leaf_datapoint_index_to_crowding_attribute));
+        leaf_datapoint_index_to_crowding_attribute);
     if (!status.ok()) {
       for (size_t i = 0; i <= token; ++i) {
         leaf_searchers_[i]->DisableCrowding();
       }
+      crowding_attributes_by_token_.clear();
+      return status;
     }
   }
+  crowding_attributes_by_token_ = std::move(crowding_attributes_by_token);
   return OkStatus();
 }
 
+void TreeAHHybridResidual::DisableCrowdingImpl() {
+  for (auto& leaf_searcher : leaf_searchers_) leaf_searcher->DisableCrowding();
+  crowding_attributes_by_token_.clear();
+}
+
 Status TreeAHHybridResidual::CheckBuildLeafSearchersPreconditions(
     const AsymmetricHasherConfig& config,
     const KMeansTreeLikePartitioner<float>& partitioner) const {
@@ -127,7 +147,8 @@ vector<uint32_t> OrderLeafTokensByCenterNorm(
 template <typename GetResidual>
 StatusOr<DenseDataset<float>> ComputeResidualsImpl(
     const DenseDataset<float>& dataset, GetResidual get_residual,
-    ConstSpan<std::vector<DatapointIndex>> datapoints_by_token) {
+    ConstSpan<std::vector<DatapointIndex>> datapoints_by_token,
+    ConstSpan<DatapointIndex> sample, thread::ThreadPool* pool) {
   const size_t dimensionality = dataset.dimensionality();
 
   vector<uint32_t> tokens_by_datapoint(dataset.size());
@@ -138,16 +159,26 @@ StatusOr<DenseDataset<float>> ComputeResidualsImpl(
     }
   }
 
+  const size_t num_residuals = sample.empty() ? dataset.size() : sample.size();
   DenseDataset<float> residuals;
-  residuals.set_dimensionality(dimensionality);
-  residuals.Reserve(dataset.size());
-
-  for (size_t dp_idx : Seq(dataset.size())) {
-    const uint32_t token = tokens_by_datapoint[dp_idx];
-    TF_ASSIGN_OR_RETURN(auto residual, get_residual(dataset[dp_idx], token));
-    residuals.AppendOrDie(residual, "");
+  if (num_residuals == 0) {
+    residuals.set_dimensionality(dimensionality);
+    return residuals;
   }
 
+  vector<float> residual_storage(num_residuals * dimensionality);
+  SCANN_RETURN_IF_ERROR(ParallelForWithStatus<64>(
+      Seq(num_residuals), pool, [&](size_t residual_idx) {
+        const DatapointIndex dp_idx =
+            sample.empty() ? residual_idx : sample[residual_idx];
+        MutableSpan<float> result(
+            residual_storage.data() + residual_idx * dimensionality,
+            dimensionality);
+        return get_residual(dataset[dp_idx], tokens_by_datapoint[dp_idx],
+                            result);
+      }));
+
+  residuals = DenseDataset<float>(std::move(residual_storage), num_residuals);
   return residuals;
 }
 
@@ -156,43 +187,76 @@ StatusOr<DenseDataset<float>> ComputeResidualsImpl(
 StatusOr<DenseDataset<float>> TreeAHHybridResidual::ComputeResiduals(
     const DenseDataset<float>& dataset,
     const DenseDataset<float>& kmeans_centers,
-    ConstSpan<std::vector<DatapointIndex>> datapoints_by_token) {
+    ConstSpan<std::vector<DatapointIndex>> datapoints_by_token,
+    thread::ThreadPool* pool) {
   DCHECK(!kmeans_centers.empty());
   DCHECK_EQ(kmeans_centers.size(), datapoints_by_token.size());
   DCHECK_EQ(kmeans_centers.dimensionality(), dataset.dimensionality());
   const size_t dimensionality = dataset.dimensionality();
-  vector<float> scratch(dimensionality);
-  auto get_residual =
-      [&](const DatapointPtr<float>& dptr,
-          const int32_t token) -> StatusOr<DatapointPtr<float>> {
+  auto get_residual = [&](const DatapointPtr<float>& dptr, const int32_t token,
+                          MutableSpan<float> result) -> Status {
     ConstSpan<float> datapoint = dptr.values_slice();
     ConstSpan<float> center = kmeans_centers[token].values_slice();
     DCHECK_EQ(center.size(), dimensionality);
     DCHECK_EQ(datapoint.size(), dimensionality);
     for (size_t d : Seq(dimensionality)) {
-      scratch[d] = datapoint[d] - center[d];
+      result[d] = datapoint[d] - center[d];
     }
-    return MakeDatapointPtr(scratch);
+    return OkStatus();
   };
 
-  return ComputeResidualsImpl(dataset, get_residual, datapoints_by_token);
+  return ComputeResidualsImpl(dataset, get_residual, datapoints_by_token, {},
+                              pool);
 }
 
-StatusOr<DenseDataset<float>> TreeAHHybridResidual::ComputeResiduals(
+namespace {
+
+// An empty sample means every datapoint.
+StatusOr<DenseDataset<float>> ComputePartitionerResiduals(
     const DenseDataset<float>& dataset,
     const KMeansTreeLikePartitioner<float>* partitioner,
     ConstSpan<std::vector<DatapointIndex>> datapoints_by_token,
-    bool normalize_residual_by_cluster_stdev) {
-  Datapoint<float> residual;
-  auto get_residual =
-      [&](const DatapointPtr<float>& dptr,
-          const int32_t token) -> StatusOr<DatapointPtr<float>> {
-    TF_ASSIGN_OR_RETURN(residual,
+    ConstSpan<DatapointIndex> sample, bool normalize_residual_by_cluster_stdev,
+    thread::ThreadPool* pool) {
+  auto get_residual = [&](const DatapointPtr<float>& dptr, const int32_t token,
+                          MutableSpan<float> result) -> Status {
+    TF_ASSIGN_OR_RETURN(Datapoint<float> residual,
                         partitioner->ResidualizeToFloat(
                             dptr, token, normalize_residual_by_cluster_stdev));
-    return residual.ToPtr();
+    ConstSpan<float> values = residual.values_slice();
+    SCANN_RET_CHECK_EQ(values.size(), result.size());
+    std::copy(values.begin(), values.end(), result.begin());
+    return OkStatus();
   };
-  return ComputeResidualsImpl(dataset, get_residual, datapoints_by_token);
+  return ComputeResidualsImpl(dataset, get_residual, datapoints_by_token,
+                              sample, pool);
+}
+
+}  // namespace
+
+StatusOr<DenseDataset<float>> TreeAHHybridResidual::ComputeResiduals(
+    const DenseDataset<float>& dataset,
+    const KMeansTreeLikePartitioner<float>* partitioner,
+    ConstSpan<std::vector<DatapointIndex>> datapoints_by_token,
+    bool normalize_residual_by_cluster_stdev, thread::ThreadPool* pool) {
+  return ComputePartitionerResiduals(dataset, partitioner, datapoints_by_token,
+                                     {}, normalize_residual_by_cluster_stdev,
+                                     pool);
+}
+
+StatusOr<DenseDataset<float>> TreeAHHybridResidual::ComputeResidualsForSample(
+    const DenseDataset<float>& dataset,
+    const KMeansTreeLikePartitioner<float>* partitioner,
+    ConstSpan<std::vector<DatapointIndex>> datapoints_by_token,
+    ConstSpan<DatapointIndex> sample, bool normalize_residual_by_cluster_stdev,
+    thread::ThreadPool* pool) {
+  if (sample.empty()) {
+    return InvalidArgumentError(
+        "Cannot compute residuals for an empty training sample.");
+  }
+  return ComputePartitionerResiduals(dataset, partitioner, datapoints_by_token,
+                                     sample,
+                                     normalize_residual_by_cluster_stdev, pool);
 }
 
 StatusOr<unique_ptr<SearchParameters::UnlockedQueryPreprocessingResults>>
@@ -224,7 +288,7 @@ Status TreeAHHybridResidual::BuildLeafSearchers(
         "pre-training.");
   }
   TF_ASSIGN_OR_RETURN(shared_ptr<const ChunkingProjection<float>> projector,
-                      ChunkingProjectionFactory<float>(config.projection()));
+                      ah_model->BuildProjection(config.projection()));
   TF_ASSIGN_OR_RETURN(auto quantization_distance,
                       GetDistanceMeasure(config.quantization_distance()));
   lookup_type_tag_ = config.lookup_type();
@@ -287,6 +351,12 @@ Status TreeAHHybridResidual::BuildLeafSearchers(
     absl::MutexLock mutex(&status_mutex);
     if (status.ok()) status = new_status;
   };
+  vector<size_t> leaf_sizes(datapoints_by_token.size());
+  for (size_t token : IndicesOf(datapoints_by_token)) {
+    leaf_sizes[token] = datapoints_by_token[token].size();
+  }
+  ParallelForOptions parallel_for_options;
+  parallel_for_options.cost_hints = leaf_sizes;
   ParallelFor<1>(IndicesOf(datapoints_by_token), pool, [&](size_t token) {
     const absl::Time token_start = absl::Now();
     auto hashed_partition = make_unique<DenseDataset<uint8_t>>();
@@ -352,7 +422,7 @@ Status TreeAHHybridResidual::BuildLeafSearchers(
     // if (!leaf_searchers_[token]->needs_hashed_dataset()) {
     //   leaf_searchers_[token]->ReleaseHashedDataset();
     // }
-  });
+  }, parallel_for_options);
   SCANN_RETURN_IF_ERROR(status);
 
   for (auto& vec : datapoints_by_token) {
@@ -375,6 +445,13 @@ Status TreeAHHybridResidual::BuildLeafSearchers(
 Status TreeAHHybridResidual::FindNeighborsImpl(const DatapointPtr<float>& query,
                                                const SearchParameters& params,
                                                NNResultsVector* result) const {
+  auto tree_x_params =
+      params.searcher_specific_optional_parameters<TreeXOptionalParameters>();
+  if (tree_x_params && tree_x_params->restrict_token_enabled()) {
+    return FindNeighborsWithRestrictToken(
+        query, params, tree_x_params->restrict_token(), result);
+  }
+
   auto query_preprocessing_results =
       params.unlocked_query_preprocessing_results<
           UnlockedTreeAHHybridResidualPreprocessingResults>();
@@ -385,32 +462,43 @@ Status TreeAHHybridResidual::FindNeighborsImpl(const DatapointPtr<float>& query,
         result);
   }
 
-  int num_centers = 0;
+  TF_ASSIGN_OR_RETURN(auto centers_to_search, CentersToSearch(query, params));
+  return FindNeighborsInternal1(query, params, centers_to_search, result);
+}
+
+int32_t TreeAHHybridResidual::NumCentersToSearch(
+    const SearchParameters& params) const {
   auto tree_x_params =
       params.searcher_specific_optional_parameters<TreeXOptionalParameters>();
   if (tree_x_params) {
-    int center_override = tree_x_params->num_partitions_to_search_override();
-    if (center_override > 0) num_centers = center_override;
+    int32_t center_override =
+        tree_x_params->num_partitions_to_search_override();
+    if (center_override > 0) return center_override;
   }
+  return 0;
+}
+
+StatusOr<vector<KMeansTreeSearchResult>> TreeAHHybridResidual::CentersToSearch(
+    const DatapointPtr<float>& query, int32_t num_centers) const {
   vector<KMeansTreeSearchResult> centers_to_search;
   SCANN_RETURN_IF_ERROR(query_tokenizer_->TokensForDatapointWithSpilling(
       query, num_centers, &centers_to_search));
-  return FindNeighborsInternal1(query, params, centers_to_search, result);
+  return centers_to_search;
 }
 
 namespace {
 
-bool SupportsLowLevelBatching(const TypedDataset<float>& queries,
-                              ConstSpan<SearchParameters> params) {
-  if (!queries.IsDense()) return false;
-  for (const SearchParameters& p : params) {
-    if (p.pre_reordering_crowding_enabled() || p.restricts_enabled()) {
-      return false;
-    }
-  }
-  return true;
+bool SupportsLowLevelBatching(const TypedDataset<float>& queries) {
+  return queries.IsDense();
 }
 
+template <typename TopN>
+struct IsCrowdingTopN : std::false_type {};
+
+template <typename DistT, typename DatapointIndexT>
+struct IsCrowdingTopN<FastTopNeighborsWithCrowding<DistT, DatapointIndexT>>
+    : std::true_type {};
+
 struct QueryForLeaf {
   QueryForLeaf() {}
   QueryForLeaf(DatapointIndex query_index, float distance_to_center)
@@ -435,30 +523,94 @@ vector<std::vector<QueryForLeaf>> InvertCentersToSearch(
   return result;
 }
 
+template <typename Mutator>
 vector<SearchParameters> CreateParamsSubsetForLeaf(
-    ConstSpan<SearchParameters> params,
-    ConstSpan<FastTopNeighbors<float>::Mutator> mutators,
+    ConstSpan<SearchParameters> params, ConstSpan<Mutator> mutators,
     ConstSpan<
         shared_ptr<asymmetric_hashing2::AsymmetricHashingOptionalParameters>>
         lookup_tables,
-    ConstSpan<QueryForLeaf> queries_for_leaf) {
+    ConstSpan<DatapointIndex> leaf_local_to_global,
+    std::vector<QueryForLeaf>* queries_for_leaf) {
   vector<SearchParameters> result;
-  result.reserve(queries_for_leaf.size());
-  for (const QueryForLeaf& q : queries_for_leaf) {
+  result.reserve(queries_for_leaf->size());
+  size_t num_queries_kept = 0;
+  for (const QueryForLeaf& q : *queries_for_leaf) {
     SearchParameters leaf_params;
+    if (!TranslateGlobalToLeafLocalWhitelist(
+            params[q.query_index], leaf_local_to_global, &leaf_params)) {
+      continue;
+    }
     leaf_params.set_pre_reordering_num_neighbors(
         params[q.query_index].pre_reordering_num_neighbors());
+    leaf_params.set_per_crowding_attribute_pre_reordering_num_neighbors(
+        params[q.query_index]
+            .per_crowding_attribute_pre_reordering_num_neighbors());
     leaf_params.set_pre_reordering_epsilon(mutators[q.query_index].epsilon() -
                                            q.distance_to_center);
     leaf_params.set_searcher_specific_optional_parameters(
         lookup_tables[q.query_index]);
     result.emplace_back(std::move(leaf_params));
+    (*queries_for_leaf)[num_queries_kept++] = q;
   }
+  queries_for_leaf->resize(num_queries_kept);
   return result;
 }
 
-template <typename Mutator>
-void AddLeafResultsToTopN(ConstSpan<DatapointIndex> local_to_global_index,
+// Moves the crowded queries of a leaf behind the uncrowded ones, which the
+// leaf searcher can batch, and returns the number of uncrowded queries.
+size_t PartitionCrowdedQueriesLast(vector<SearchParameters>* leaf_params,
+                                   std::vector<QueryForLeaf>* queries_for_leaf) {
+  size_t num_uncrowded = 0;
+  for (size_t j : IndicesOf(*leaf_params)) {
+    if ((*leaf_params)[j].pre_reordering_crowding_enabled()) continue;
+    if (j != num_uncrowded) {
+      std::swap((*leaf_params)[j], (*leaf_params)[num_uncrowded]);
+      std::swap((*queries_for_leaf)[j], (*queries_for_leaf)[num_uncrowded]);
+    }
+    ++num_uncrowded;
+  }
+  return num_uncrowded;
+}
+
+// Copies everything but the unlocked preprocessing results, which the batched
+// path recomputes anyway.
+SearchParameters CopySearchParameters(const SearchParameters& params) {
+  SearchParameters result(params.pre_reordering_num_neighbors(),
+                          params.pre_reordering_epsilon(),
+                          params.post_reordering_num_neighbors(),
+                          params.post_reordering_epsilon());
+  result.set_sort_results(params.sort_results());
+  result.set_per_crowding_attribute_pre_reordering_num_neighbors(
+      params.per_crowding_attribute_pre_reordering_num_neighbors());
+  result.set_per_crowding_attribute_post_reordering_num_neighbors(
+      params.per_crowding_attribute_post_reordering_num_neighbors());
+  result.set_searcher_specific_optional_parameters(
+      params.searcher_specific_optional_parameters<
+          SearcherSpecificOptionalParameters>());
+  result.set_restrict_whitelist(params.shared_restrict_whitelist());
+  return result;
+}
+
+// Stands in for the top-N mutators in CreateParamsSubsetForLeaf when leaves
+// are scanned concurrently, so that epsilons cannot tighten across leaves.
+struct FixedEpsilon {
+  float epsilon() const { return value; }
+
+  float value;
+};
+
+struct ExternalIdAndDatapointIndex {
+  ConstSpan<int64_t> external_ids;
+  ConstSpan<DatapointIndex> datapoint_indices;
+
+  absl::uint128 operator[](DatapointIndex local_idx) const {
+    return absl::MakeUint128(external_ids[local_idx],
+                             datapoint_indices[local_idx]);
+  }
+};
+
+template <typename Mutator, typename LeafResultIndex>
+void AddLeafResultsToTopN(const LeafResultIndex& local_to_result_index,
                           const float distance_to_center,
                           const float query_variance_adjustment,
                           const float cluster_stdev_adjustment,
@@ -470,7 +622,32 @@ void AddLeafResultsToTopN(ConstSpan<DatapointIndex> local_to_global_index,
     const float dist = result.second * cluster_stdev_adjustment + per_leaf_term;
     if (dist < epsilon) {
       if (ABSL_PREDICT_FALSE(
-              mutator->Push(local_to_global_index[result.first], dist))) {
+              mutator->Push(local_to_result_index[result.first], dist))) {
+        mutator->GarbageCollect();
+        epsilon = mutator->epsilon();
+      }
+    }
+  }
+}
+
+// As above, but pushes with the leaf-local crowding attributes so that the
+// crowding top-N never touches the global attribute array.
+template <typename Mutator, typename LeafResultIndex>
+void AddLeafResultsToCrowdingTopN(
+    const LeafResultIndex& local_to_result_index,
+    ConstSpan<int64_t> leaf_crowding_attributes,
+    const float distance_to_center, const float query_variance_adjustment,
+    const float cluster_stdev_adjustment,
+    ConstSpan<pair<DatapointIndex, float>> leaf_results, Mutator* mutator) {
+  float epsilon = mutator->epsilon();
+  const float per_leaf_term = distance_to_center - query_variance_adjustment;
+  for (const auto& result : leaf_results) {
+    const float dist = result.second * cluster_stdev_adjustment + per_leaf_term;
+    if (dist < epsilon) {
+      DCHECK_LT(result.first, leaf_crowding_attributes.size());
+      if (ABSL_PREDICT_FALSE(mutator->PushWithAttribute(
+              local_to_result_index[result.first], dist,
+              leaf_crowding_attributes[result.first]))) {
         mutator->GarbageCollect();
         epsilon = mutator->epsilon();
       }
@@ -483,6 +660,76 @@ inline void AssignResults(TopN* top_n, NNResultsVector* results) {
   top_n->FinishUnsorted(results);
 }
 
+struct GlobalToLeafLocalWhitelist {
+  bool operator()(int32_t token, SearchParameters* leaf_params) const {
+    return TranslateGlobalToLeafLocalWhitelist(
+        params, datapoints_by_token[token], leaf_params);
+  }
+
+  const SearchParameters& params;
+  ConstSpan<std::vector<DatapointIndex>> datapoints_by_token;
+};
+
+struct RestrictTokenLeafWhitelist {
+  bool operator()(int32_t token, SearchParameters* leaf_params) const {
+    const RestrictTokenPostings::LeafPostings* leaf_postings =
+        postings.FindLeaf(token);
+    if (!leaf_postings) return false;
+    ConstSpan<DatapointIndex> leaf_local_to_global = datapoints_by_token[token];
+    RestrictAllowlist* leaf_whitelist = leaf_params->mutable_restrict_whitelist();
+    if (leaf_whitelist) {
+      leaf_whitelist->Initialize(leaf_local_to_global.size(), false);
+    } else {
+      leaf_params->EnableRestricts(leaf_local_to_global.size(), false);
+      leaf_whitelist = leaf_params->mutable_restrict_whitelist();
+    }
+    bool any_whitelisted = false;
+    for (DatapointIndex local_index : leaf_postings->local_indices) {
+      if (!params.IsWhitelisted(leaf_local_to_global[local_index])) continue;
+      leaf_whitelist->set(local_index, true);
+      any_whitelisted = true;
+    }
+    return any_whitelisted;
+  }
+
+  const SearchParameters& params;
+  const RestrictTokenPostings::TokenPostings& postings;
+  ConstSpan<std::vector<DatapointIndex>> datapoints_by_token;
+};
+
+void KeepBestResults(DatapointIndex num_neighbors, NNResultsVector* result) {
+  if (result->size() <= num_neighbors) return;
+  std::nth_element(result->begin(), result->begin() + num_neighbors,
+                   result->end(), DistanceComparatorBranchOptimized());
+  result->resize(num_neighbors);
+}
+
+void SplitExternalIdKeys(
+    ConstSpan<absl::uint128> keys, ConstSpan<float> dists,
+    NNResultsVector* candidates,
+    vector<pair<DatapointIndex, int64_t>>* external_id_by_datapoint) {
+  candidates->resize(keys.size());
+  external_id_by_datapoint->resize(keys.size());
+  for (size_t j : IndicesOf(keys)) {
+    const DatapointIndex dp_idx = absl::Uint128Low64(keys[j]);
+    (*candidates)[j] = {dp_idx, dists[j]};
+    (*external_id_by_datapoint)[j] = {
+        dp_idx, static_cast<int64_t>(absl::Uint128High64(keys[j]))};
+  }
+  std::sort(external_id_by_datapoint->begin(),
+            external_id_by_datapoint->end());
+}
+
+int64_t LookupExternalId(
+    ConstSpan<pair<DatapointIndex, int64_t>> external_id_by_datapoint,
+    DatapointIndex dp_idx) {
+  auto it = std::lower_bound(
+      external_id_by_datapoint.begin(), external_id_by_datapoint.end(),
+      std::make_pair(dp_idx, numeric_limits<int64_t>::min()));
+  DCHECK(it != external_id_by_datapoint.end() && it->first == dp_idx);
+  return it->second;
+}
+
 }  // namespace
 
 Status TreeAHHybridResidual::FindNeighborsBatchedImpl(
@@ -490,6 +737,7 @@ Status TreeAHHybridResidual::FindNeighborsBatchedImpl(
     MutableSpan<NNResultsVector> results) const {
   vector<int32_t> centers_override(queries.size());
   bool centers_overridden = false;
+  bool restrict_tokens_used = false;
   for (int i = 0; i < queries.size(); i++) {
     auto tree_x_params =
         params[i]
@@ -500,7 +748,43 @@ Status TreeAHHybridResidual::FindNeighborsBatchedImpl(
         centers_override[i] = center_override;
         centers_overridden = true;
       }
+      restrict_tokens_used |= tree_x_params->restrict_token_enabled();
+    }
+  }
+  if (restrict_tokens_used) {
+    // Restricted queries are planned one by one on the parallelization pool;
+    // the rest of the batch still takes the batched path below.
+    DenseDataset<float> unrestricted_queries;
+    vector<SearchParameters> unrestricted_params;
+    vector<size_t> unrestricted_indices;
+    vector<size_t> restricted_indices;
+    for (size_t i = 0; i < queries.size(); ++i) {
+      auto tree_x_params =
+          params[i]
+              .searcher_specific_optional_parameters<TreeXOptionalParameters>();
+      if (tree_x_params && tree_x_params->restrict_token_enabled()) {
+        restricted_indices.push_back(i);
+        continue;
+      }
+      SCANN_RETURN_IF_ERROR(unrestricted_queries.Append(queries[i], ""));
+      unrestricted_params.push_back(CopySearchParameters(params[i]));
+      unrestricted_indices.push_back(i);
+    }
+    SCANN_RETURN_IF_ERROR(ParallelForWithStatus<1>(
+        IndicesOf(restricted_indices), parallelization_pool_.get(),
+        [&](size_t j) {
+          const size_t i = restricted_indices[j];
+          return FindNeighborsImpl(queries[i], params[i], &results[i]);
+        }));
+    if (unrestricted_indices.empty()) return OkStatus();
+    vector<NNResultsVector> unrestricted_results(unrestricted_indices.size());
+    SCANN_RETURN_IF_ERROR(FindNeighborsBatchedImpl(
+        unrestricted_queries, unrestricted_params,
+        MakeMutableSpan(unrestricted_results)));
+    for (size_t j : IndicesOf(unrestricted_indices)) {
+      results[unrestricted_indices[j]] = std::move(unrestricted_results[j]);
     }
+    return OkStatus();
   }
 
   vector<vector<KMeansTreeSearchResult>> centers_to_search(queries.size());
@@ -512,8 +796,7 @@ Status TreeAHHybridResidual::FindNeighborsBatchedImpl(
     SCANN_RETURN_IF_ERROR(
         query_tokenizer_->TokensForDatapointWithSpillingBatched(
             queries, vector<int32_t>(), MakeMutableSpan(centers_to_search)));
-  if (!SupportsLowLevelBatching(queries, params) ||
-      !leaf_searchers_[0]->lut16_ ||
+  if (!SupportsLowLevelBatching(queries) || !leaf_searchers_[0]->lut16_ ||
       leaf_searchers_[0]->opts_.quantization_scheme() ==
           AsymmetricHasherConfig::PRODUCT_AND_BIAS) {
     for (size_t i = 0; i < centers_to_search.size(); ++i) {
@@ -522,6 +805,31 @@ Status TreeAHHybridResidual::FindNeighborsBatchedImpl(
     }
     return OkStatus();
   }
+  for (const SearchParameters& p : params) {
+    if (p.pre_reordering_crowding_enabled()) {
+      return FindNeighborsBatchedLowLevel<FastTopNeighborsWithCrowding<float>>(
+          queries, params, centers_to_search, results);
+    }
+  }
+  if (numa_pools_) {
+    return FindNeighborsBatchedNuma(queries, params, centers_to_search,
+                                    results);
+  }
+  return FindNeighborsBatchedLowLevel<FastTopNeighbors<float>>(
+      queries, params, centers_to_search, results);
+}
+
+template <typename TopN>
+Status TreeAHHybridResidual::FindNeighborsBatchedLowLevel(
+    const TypedDataset<float>& queries, ConstSpan<SearchParameters> params,
+    ConstSpan<vector<KMeansTreeSearchResult>> centers_to_search,
+    MutableSpan<NNResultsVector> results) const {
+  constexpr bool kCrowding = IsCrowdingTopN<TopN>::value;
+  if (kCrowding && crowding_attributes_by_token_.empty()) {
+    return FailedPreconditionError(
+        "Crowding is enabled in the search parameters but not on the "
+        "searcher.");
+  }
   auto queries_by_leaf =
       InvertCentersToSearch(centers_to_search, query_tokenizer_->n_tokens());
   vector<shared_ptr<AsymmetricHashingOptionalParameters>> lookup_tables(
@@ -532,20 +840,32 @@ Status TreeAHHybridResidual::FindNeighborsBatchedImpl(
     lookup_tables[i] =
         make_shared<AsymmetricHashingOptionalParameters>(std::move(lut));
   }
-  vector<FastTopNeighbors<float>> top_ns;
-  vector<FastTopNeighbors<float>::Mutator> mutators(params.size());
+  vector<TopN> top_ns;
+  vector<typename TopN::Mutator> mutators(params.size());
   top_ns.reserve(params.size());
   for (const auto& [idx, p] : Enumerate(params)) {
-    top_ns.emplace_back(p.pre_reordering_num_neighbors(),
-                        p.pre_reordering_epsilon());
+    if constexpr (kCrowding) {
+      top_ns.emplace_back(
+          p.pre_reordering_num_neighbors(), p.pre_reordering_epsilon(),
+          p.per_crowding_attribute_pre_reordering_num_neighbors());
+    } else {
+      top_ns.emplace_back(p.pre_reordering_num_neighbors(),
+                          p.pre_reordering_epsilon());
+    }
     top_ns[idx].AcquireMutator(&mutators[idx]);
   }
   vector<NNResultsVector> leaf_results;
   for (size_t leaf_token : leaf_tokens_by_norm_) {
+    if (queries_by_leaf[leaf_token].empty()) continue;
+    vector<SearchParameters> leaf_params = CreateParamsSubsetForLeaf(
+        params, MakeConstSpan(mutators), lookup_tables,
+        datapoints_by_token_[leaf_token], &queries_by_leaf[leaf_token]);
+    const size_t num_batchable =
+        kCrowding ? PartitionCrowdedQueriesLast(&leaf_params,
+                                                &queries_by_leaf[leaf_token])
+                  : leaf_params.size();
     ConstSpan<QueryForLeaf> queries_for_cur_leaf = queries_by_leaf[leaf_token];
     if (queries_for_cur_leaf.empty()) continue;
-    vector<SearchParameters> leaf_params = CreateParamsSubsetForLeaf(
-        params, mutators, lookup_tables, queries_for_cur_leaf);
     auto get_query = [&queries, &queries_for_cur_leaf](DatapointIndex i) {
       return queries[queries_for_cur_leaf[i].query_index];
     };
@@ -553,11 +873,19 @@ Status TreeAHHybridResidual::FindNeighborsBatchedImpl(
     leaf_results.resize(leaf_params.size());
     using asymmetric_hashing_internal::IdentityPostprocessFunctor;
     IdentityPostprocessFunctor postprocess;
-    SCANN_RETURN_IF_ERROR(
-        leaf_searchers_[leaf_token]
-            ->FindNeighborsBatchedInternal<IdentityPostprocessFunctor>(
-                get_query, leaf_params, postprocess,
-                MakeMutableSpan(leaf_results)));
+    if (num_batchable > 0) {
+      SCANN_RETURN_IF_ERROR(
+          leaf_searchers_[leaf_token]
+              ->FindNeighborsBatchedInternal<IdentityPostprocessFunctor>(
+                  get_query, MakeConstSpan(leaf_params.data(), num_batchable),
+                  postprocess,
+                  MakeMutableSpan(leaf_results.data(), num_batchable)));
+    }
+    for (size_t j = num_batchable; j < leaf_params.size(); ++j) {
+      SCANN_RETURN_IF_ERROR(
+          leaf_searchers_[leaf_token]->FindNeighborsNoSortNoExactReorder(
+              get_query(j), leaf_params[j], &leaf_results[j]));
+    }
 
     ConstSpan<DatapointIndex> local_to_global_index =
         datapoints_by_token_[leaf_token];
@@ -578,10 +906,172 @@ Status TreeAHHybridResidual::FindNeighborsBatchedImpl(
               ? (partition_variance_adjustment *
                  std::sqrt(SquaredL2Norm(queries[cur_query_index])))
               : 0.0f;
-      AddLeafResultsToTopN(local_to_global_index,
+      if constexpr (kCrowding) {
+        AddLeafResultsToCrowdingTopN(
+            local_to_global_index, crowding_attributes_by_token_[leaf_token],
+            queries_for_cur_leaf[j].distance_to_center,
+            query_variance_adjustment, partition_stdev, leaf_results[j],
+            &mutators[cur_query_index]);
+      } else {
+        AddLeafResultsToTopN(local_to_global_index,
+                             queries_for_cur_leaf[j].distance_to_center,
+                             query_variance_adjustment, partition_stdev,
+                             leaf_results[j], &mutators[cur_query_index]);
+      }
+    }
+  }
+  for (size_t query_index = 0; query_index < results.size(); ++query_index) {
+    mutators[query_index].Release();
+    top_ns[query_index].FinishUnsorted(&results[query_index]);
+  }
+  return OkStatus();
+}
+
+Status TreeAHHybridResidual::EnableNumaPlacement(
+    shared_ptr<NumaThreadPools> numa_pools, bool replicate_small_structures) {
+  if (!numa_pools) {
+    return InvalidArgumentError("NUMA thread pools must not be null.");
+  }
+  if (leaf_searchers_.empty()) {
+    return FailedPreconditionError(
+        "Leaf searchers must be built before enabling NUMA placement.");
+  }
+
+  // Largest leaves first, each onto the node holding the fewest datapoints.
+  vector<int32_t> tokens_by_size(datapoints_by_token_.size());
+  std::iota(tokens_by_size.begin(), tokens_by_size.end(), 0);
+  std::stable_sort(tokens_by_size.begin(), tokens_by_size.end(),
+                   [this](int32_t a, int32_t b) {
+                     return datapoints_by_token_[a].size() >
+                            datapoints_by_token_[b].size();
+                   });
+  const size_t num_nodes = numa_pools->num_nodes();
+  vector<std::vector<int32_t>> leaf_tokens_by_numa_node(num_nodes);
+  vector<size_t> num_datapoints_by_node(num_nodes, 0);
+  for (int32_t token : tokens_by_size) {
+    const size_t node = std::min_element(num_datapoints_by_node.begin(),
+                                         num_datapoints_by_node.end()) -
+                        num_datapoints_by_node.begin();
+    leaf_tokens_by_numa_node[node].push_back(token);
+    num_datapoints_by_node[node] += datapoints_by_token_[token].size();
+  }
+
+  SCANN_RETURN_IF_ERROR(numa_pools->RunOnEachNode([&](int node) {
+    for (int32_t token : leaf_tokens_by_numa_node[node]) {
+      leaf_searchers_[token]->ReallocatePackedDataset();
+    }
+    return OkStatus();
+  }));
+  numa_pools_ = std::move(numa_pools);
+  leaf_tokens_by_numa_node_ = std::move(leaf_tokens_by_numa_node);
+  numa_replicate_small_structures_ = replicate_small_structures;
+  return OkStatus();
+}
+
+Status TreeAHHybridResidual::FindNeighborsBatchedNuma(
+    const TypedDataset<float>& queries, ConstSpan<SearchParameters> params,
+    ConstSpan<vector<KMeansTreeSearchResult>> centers_to_search,
+    MutableSpan<NNResultsVector> results) const {
+  auto queries_by_leaf =
+      InvertCentersToSearch(centers_to_search, query_tokenizer_->n_tokens());
+  vector<asymmetric_hashing2::LookupTable> raw_lookup_tables(queries.size());
+  for (size_t i = 0; i < queries.size(); ++i) {
+    TF_ASSIGN_OR_RETURN(raw_lookup_tables[i],
+                        asymmetric_queryer_->CreateLookupTable(
+                            queries[i], lookup_type_tag_));
+  }
+  auto make_lookup_tables = [&raw_lookup_tables](bool copy) {
+    vector<shared_ptr<AsymmetricHashingOptionalParameters>> lookup_tables(
+        raw_lookup_tables.size());
+    for (size_t i : IndicesOf(raw_lookup_tables)) {
+      lookup_tables[i] = make_shared<AsymmetricHashingOptionalParameters>(
+          copy ? raw_lookup_tables[i] : std::move(raw_lookup_tables[i]));
+    }
+    return lookup_tables;
+  };
+  vector<shared_ptr<AsymmetricHashingOptionalParameters>> shared_lookup_tables;
+  if (!numa_replicate_small_structures_) {
+    shared_lookup_tables = make_lookup_tables(false);
+  }
+  vector<FixedEpsilon> initial_epsilons(params.size());
+  for (size_t i : IndicesOf(params)) {
+    initial_epsilons[i] = {params[i].pre_reordering_epsilon()};
+  }
+
+  vector<vector<NNResultsVector>> results_by_leaf(queries_by_leaf.size());
+  SCANN_RETURN_IF_ERROR(numa_pools_->RunOnEachNode([&](int node) {
+    // Replicas are built by a worker of the node, so they are first touched
+    // there.
+    const vector<shared_ptr<AsymmetricHashingOptionalParameters>>
+        lookup_tables = numa_replicate_small_structures_
+                            ? make_lookup_tables(true)
+                            : shared_lookup_tables;
+    ConstSpan<int32_t> node_tokens = leaf_tokens_by_numa_node_[node];
+    vector<size_t> leaf_costs(node_tokens.size());
+    for (size_t i : IndicesOf(node_tokens)) {
+      leaf_costs[i] = datapoints_by_token_[node_tokens[i]].size() *
+                      queries_by_leaf[node_tokens[i]].size();
+    }
+    ParallelForOptions parallel_for_options;
+    parallel_for_options.cost_hints = leaf_costs;
+    return ParallelForWithStatus<1>(
+        Seq(node_tokens.size()), numa_pools_->pool(node),
+        [&](size_t i) -> Status {
+          const int32_t leaf_token = node_tokens[i];
+          std::vector<QueryForLeaf>* queries_for_leaf =
+              &queries_by_leaf[leaf_token];
+          if (queries_for_leaf->empty()) return OkStatus();
+          vector<SearchParameters> leaf_params = CreateParamsSubsetForLeaf(
+              params, MakeConstSpan(initial_epsilons), lookup_tables,
+              datapoints_by_token_[leaf_token], queries_for_leaf);
+          if (queries_for_leaf->empty()) return OkStatus();
+          auto get_query = [&queries, queries_for_leaf](DatapointIndex j) {
+            return queries[(*queries_for_leaf)[j].query_index];
+          };
+          results_by_leaf[leaf_token].resize(leaf_params.size());
+          using asymmetric_hashing_internal::IdentityPostprocessFunctor;
+          return leaf_searchers_[leaf_token]
+              ->FindNeighborsBatchedInternal<IdentityPostprocessFunctor>(
+                  get_query, leaf_params, IdentityPostprocessFunctor(),
+                  MakeMutableSpan(results_by_leaf[leaf_token]));
+        },
+        parallel_for_options);
+  }));
+
+  vector<FastTopNeighbors<float>> top_ns;
+  vector<FastTopNeighbors<float>::Mutator> mutators(params.size());
+  top_ns.reserve(params.size());
+  for (const auto& [idx, p] : Enumerate(params)) {
+    top_ns.emplace_back(p.pre_reordering_num_neighbors(),
+                        p.pre_reordering_epsilon());
+    top_ns[idx].AcquireMutator(&mutators[idx]);
+  }
+  for (size_t leaf_token : leaf_tokens_by_norm_) {
+    ConstSpan<QueryForLeaf> queries_for_cur_leaf = queries_by_leaf[leaf_token];
+    if (results_by_leaf[leaf_token].empty()) continue;
+    const float partition_variance_adjustment =
+        ah_variance_adjustment_by_token_.empty()
+            ? 0.0f
+            : ah_variance_adjustment_by_token_[leaf_token];
+    auto status_or_partition_stdev =
+        query_tokenizer_->ResidualStdevForToken(leaf_token);
+    const float partition_stdev = status_or_partition_stdev.ok()
+                                      ? status_or_partition_stdev.ValueOrDie()
+                                      : 1.0;
+    for (size_t j = 0; j < queries_for_cur_leaf.size(); ++j) {
+      const DatapointIndex cur_query_index =
+          queries_for_cur_leaf[j].query_index;
+      const float query_variance_adjustment =
+          partition_variance_adjustment
+              ? (partition_variance_adjustment *
+                 std::sqrt(SquaredL2Norm(queries[cur_query_index])))
+              : 0.0f;
+      AddLeafResultsToTopN(ConstSpan<DatapointIndex>(
+                               datapoints_by_token_[leaf_token]),
                            queries_for_cur_leaf[j].distance_to_center,
                            query_variance_adjustment, partition_stdev,
-                           leaf_results[j], &mutators[cur_query_index]);
+                           results_by_leaf[leaf_token][j],
+                           &mutators[cur_query_index]);
     }
   }
   for (size_t query_index = 0; query_index < results.size(); ++query_index) {
@@ -595,22 +1085,42 @@ Status TreeAHHybridResidual::FindNeighborsInternal1(
     const DatapointPtr<float>& query, const SearchParameters& params,
     ConstSpan<KMeansTreeSearchResult> centers_to_search,
     NNResultsVector* result) const {
+  auto leaf_result_index = [this](int32_t token) {
+    return ConstSpan<DatapointIndex>(datapoints_by_token_[token]);
+  };
   if (params.pre_reordering_crowding_enabled()) {
-    return FailedPreconditionError("Crowding is not supported.");
+    if (crowding_attributes_by_token_.empty()) {
+      return FailedPreconditionError(
+          "Crowding is enabled in the search parameters but not on the "
+          "searcher.");
+    }
+    FastTopNeighborsWithCrowding<float> top_n(
+        params.pre_reordering_num_neighbors(), params.pre_reordering_epsilon(),
+        params.per_crowding_attribute_pre_reordering_num_neighbors());
+    SCANN_RETURN_IF_ERROR(FindNeighborsInternal2(
+        query, params, centers_to_search, leaf_result_index,
+        GlobalToLeafLocalWhitelist{params, datapoints_by_token_}, &top_n));
+    AssignResults(&top_n, result);
+    return OkStatus();
   } else {
     FastTopNeighbors<float> top_n(params.pre_reordering_num_neighbors(),
                                   params.pre_reordering_epsilon());
-    return FindNeighborsInternal2(query, params, centers_to_search,
-                                  std::move(top_n), result);
+    SCANN_RETURN_IF_ERROR(FindNeighborsInternal2(
+        query, params, centers_to_search, leaf_result_index,
+        GlobalToLeafLocalWhitelist{params, datapoints_by_token_}, &top_n));
+    AssignResults(&top_n, result);
+    return OkStatus();
   }
 }
 
-template <typename TopN>
+template <typename TopN, typename LeafResultIndexFactory,
+          typename LeafWhitelistFactory>
 Status TreeAHHybridResidual::FindNeighborsInternal2(
     const DatapointPtr<float>& query, const SearchParameters& params,
-    ConstSpan<KMeansTreeSearchResult> centers_to_search, TopN top_n,
-    NNResultsVector* result) const {
-  DCHECK(result);
+    ConstSpan<KMeansTreeSearchResult> centers_to_search,
+    const LeafResultIndexFactory& leaf_result_index,
+    const LeafWhitelistFactory& leaf_whitelist, TopN* top_n) const {
+  DCHECK(top_n);
   SearchParameters leaf_params;
   leaf_params.set_pre_reordering_num_neighbors(
       params.pre_reordering_num_neighbors());
@@ -632,15 +1142,14 @@ Status TreeAHHybridResidual::FindNeighborsInternal2(
             std::move(shared_lookup_table)));
   }
   typename TopN::Mutator mutator;
-  top_n.AcquireMutator(&mutator);
+  top_n->AcquireMutator(&mutator);
   for (size_t i = 0; i < centers_to_search.size(); ++i) {
     const int32_t token = centers_to_search[i].node->LeafId();
     NNResultsVector leaf_results;
     const float distance_to_center = centers_to_search[i].distance_to_center;
     leaf_params.set_pre_reordering_epsilon(mutator.epsilon() -
                                            distance_to_center);
-    TranslateGlobalToLeafLocalWhitelist(params, datapoints_by_token_[token],
-                                        &leaf_params);
+    if (!leaf_whitelist(token, &leaf_params)) continue;
     SCANN_RETURN_IF_ERROR(
         leaf_searchers_[token]->FindNeighborsNoSortNoExactReorder(
             query, leaf_params, &leaf_results));
@@ -650,16 +1159,471 @@ Status TreeAHHybridResidual::FindNeighborsInternal2(
             : (ah_variance_adjustment_by_token_[token] *
                std::sqrt(SquaredL2Norm(query)));
     float cluster_stdev_adjustment = centers_to_search[i].residual_stdev;
-    AddLeafResultsToTopN(datapoints_by_token_[token], distance_to_center,
-                         query_variance_adjustment, cluster_stdev_adjustment,
-                         leaf_results, &mutator);
+    if constexpr (IsCrowdingTopN<TopN>::value) {
+      AddLeafResultsToCrowdingTopN(
+          leaf_result_index(token), crowding_attributes_by_token_[token],
+          distance_to_center, query_variance_adjustment,
+          cluster_stdev_adjustment, leaf_results, &mutator);
+    } else {
+      AddLeafResultsToTopN(leaf_result_index(token), distance_to_center,
+                           query_variance_adjustment, cluster_stdev_adjustment,
+                           leaf_results, &mutator);
+    }
   }
   mutator.Release();
+  return OkStatus();
+}
 
-  AssignResults(&top_n, result);
+Status TreeAHHybridResidual::SetExternalIds(ConstSpan<int64_t> external_ids) {
+  if (external_ids.size() != num_datapoints_) {
+    return InvalidArgumentError(
+        "Number of external ids (%d) does not match number of datapoints (%d).",
+        external_ids.size(), num_datapoints_);
+  }
+  vector<std::vector<int64_t>> external_ids_by_token(
+      datapoints_by_token_.size());
+  for (size_t token : IndicesOf(datapoints_by_token_)) {
+    ConstSpan<DatapointIndex> leaf_datapoints = datapoints_by_token_[token];
+    external_ids_by_token[token].reserve(leaf_datapoints.size());
+    for (DatapointIndex dp_idx : leaf_datapoints) {
+      external_ids_by_token[token].push_back(external_ids[dp_idx]);
+    }
+  }
+  external_ids_by_token_ = std::move(external_ids_by_token);
   return OkStatus();
 }
 
+vector<int64_t> TreeAHHybridResidual::ExternalIdsByDatapoint() const {
+  if (!external_ids_enabled()) return {};
+  vector<int64_t> result(num_datapoints_, -1);
+  for (size_t token : IndicesOf(datapoints_by_token_)) {
+    ConstSpan<DatapointIndex> leaf_datapoints = datapoints_by_token_[token];
+    for (size_t j : IndicesOf(leaf_datapoints)) {
+      result[leaf_datapoints[j]] = external_ids_by_token_[token][j];
+    }
+  }
+  return result;
+}
+
+Status TreeAHHybridResidual::FindNeighborsWithExternalIds(
+    const DatapointPtr<float>& query, const SearchParameters& params,
+    ExternalIdNNResultsVector* result) const {
+  DCHECK(result);
+  if (!external_ids_enabled()) {
+    return FailedPreconditionError("External ids have not been set.");
+  }
+  SCANN_RETURN_IF_ERROR(params.Validate(reordering_enabled()));
+  if (params.pre_reordering_crowding_enabled()) {
+    return FailedPreconditionError("Crowding is not supported.");
+  }
+  TF_ASSIGN_OR_RETURN(auto centers_to_search, CentersToSearch(query, params));
+
+  if (!reordering_enabled()) {
+    FastTopNeighbors<float, uint64_t> top_n(params.pre_reordering_num_neighbors(),
+                                            params.pre_reordering_epsilon());
+    auto leaf_result_index = [this](int32_t token) {
+      return ConstSpan<int64_t>(external_ids_by_token_[token]);
+    };
+    SCANN_RETURN_IF_ERROR(FindNeighborsInternal2(
+        query, params, centers_to_search, leaf_result_index,
+        GlobalToLeafLocalWhitelist{params, datapoints_by_token_}, &top_n));
+    ConstSpan<uint64_t> ids;
+    ConstSpan<float> dists;
+    std::tie(ids, dists) = top_n.FinishUnsorted();
+    result->resize(ids.size());
+    for (size_t j : IndicesOf(ids)) {
+      (*result)[j] = {static_cast<int64_t>(ids[j]), dists[j]};
+    }
+    if (params.sort_results()) {
+      ZipSortBranchOptimized(DistanceComparatorBranchOptimized(),
+                             result->begin(), result->end());
+    }
+    return OkStatus();
+  }
+
+  FastTopNeighbors<float, absl::uint128> top_n(
+      params.pre_reordering_num_neighbors(), params.pre_reordering_epsilon());
+  auto leaf_result_index = [this](int32_t token) {
+    return ExternalIdAndDatapointIndex{external_ids_by_token_[token],
+                                       datapoints_by_token_[token]};
+  };
+  SCANN_RETURN_IF_ERROR(FindNeighborsInternal2(
+      query, params, centers_to_search, leaf_result_index,
+      GlobalToLeafLocalWhitelist{params, datapoints_by_token_}, &top_n));
+  ConstSpan<absl::uint128> keys;
+  ConstSpan<float> dists;
+  std::tie(keys, dists) = top_n.FinishUnsorted();
+
+  NNResultsVector candidates;
+  vector<pair<DatapointIndex, int64_t>> candidate_external_ids;
+  SplitExternalIdKeys(keys, dists, &candidates, &candidate_external_ids);
+
+  SCANN_RETURN_IF_ERROR(ReorderResults(query, params, &candidates));
+  SCANN_RETURN_IF_ERROR(SortAndDropResults(&candidates, params));
+
+  result->resize(candidates.size());
+  for (size_t j : IndicesOf(candidates)) {
+    (*result)[j] = {LookupExternalId(candidate_external_ids, candidates[j].first),
+                    candidates[j].second};
+  }
+  return OkStatus();
+}
+
+StatusOr<vector<vector<KMeansTreeSearchResult>>>
+TreeAHHybridResidual::CentersToSearchBatched(
+    const TypedDataset<float>& queries,
+    ConstSpan<SearchParameters> params) const {
+  if (queries.size() != params.size()) {
+    return InvalidArgumentError(
+        "Number of queries (%d) does not match number of search parameters "
+        "(%d).",
+        queries.size(), params.size());
+  }
+  vector<int32_t> centers_override(queries.size());
+  for (size_t i : IndicesOf(params)) {
+    if (params[i].pre_reordering_crowding_enabled()) {
+      return FailedPreconditionError("Crowding is not supported.");
+    }
+    centers_override[i] = NumCentersToSearch(params[i]);
+  }
+  vector<vector<KMeansTreeSearchResult>> centers_to_search(queries.size());
+  SCANN_RETURN_IF_ERROR(query_tokenizer_->TokensForDatapointWithSpillingBatched(
+      queries, centers_override, MakeMutableSpan(centers_to_search)));
+  return centers_to_search;
+}
+
+template <typename TopN, typename LeafResultIndexFactory>
+Status TreeAHHybridResidual::FindNeighborsInRange(
+    const DatapointPtr<float>& query, const SearchParameters& params,
+    ConstSpan<KMeansTreeSearchResult> centers_to_search,
+    const LeafResultIndexFactory& leaf_result_index, TopN* top_n) const {
+  // Sized for the whole dataset, the top-N grows instead of evicting, so it
+  // only ever thresholds at the radius.  The leaf LUT16 kernels then emit just
+  // the datapoints under the radius less the leaf's distance to center.
+  const DatapointIndex max_results =
+      std::max<DatapointIndex>(num_datapoints_, 1);
+  top_n->Init(max_results, params.pre_reordering_epsilon());
+  SearchParameters range_params;
+  range_params.set_pre_reordering_num_neighbors(max_results);
+  range_params.set_pre_reordering_epsilon(params.pre_reordering_epsilon());
+  return FindNeighborsInternal2(
+      query, range_params, centers_to_search, leaf_result_index,
+      GlobalToLeafLocalWhitelist{params, datapoints_by_token_}, top_n);
+}
+
+Status TreeAHHybridResidual::ReverifyRangeResults(
+    const DatapointPtr<float>& query, const SearchParameters& params,
+    NNResultsVector* candidates) const {
+  SCANN_RETURN_IF_ERROR(
+      reordering_helper().ComputeDistancesForReordering(query, candidates));
+  const float radius = params.post_reordering_epsilon();
+  candidates->erase(
+      std::remove_if(candidates->begin(), candidates->end(),
+                     [radius](const pair<DatapointIndex, float>& neighbor) {
+                       return !(neighbor.second <= radius);
+                     }),
+      candidates->end());
+  return OkStatus();
+}
+
+namespace {
+
+template <typename IdT>
+void ConcatenateRangeResults(
+    MutableSpan<std::vector<std::pair<IdT, float>>> results_by_query,
+    RangeSearchResultsT<IdT>* results) {
+  results->Clear();
+  size_t num_neighbors = 0;
+  for (const auto& query_results : results_by_query) {
+    num_neighbors += query_results.size();
+  }
+  results->offsets.reserve(results_by_query.size() + 1);
+  results->neighbors.reserve(num_neighbors);
+  for (auto& query_results : results_by_query) {
+    results->neighbors.insert(results->neighbors.end(), query_results.begin(),
+                              query_results.end());
+    results->offsets.push_back(results->neighbors.size());
+    std::vector<std::pair<IdT, float>>().swap(query_results);
+  }
+}
+
+}  // namespace
+
+Status TreeAHHybridResidual::FindNeighborsInRangeBatched(
+    const TypedDataset<float>& queries, ConstSpan<SearchParameters> params,
+    bool exact_reverification, RangeSearchResults* results) const {
+  DCHECK(results);
+  TF_ASSIGN_OR_RETURN(auto centers_to_search,
+                      CentersToSearchBatched(queries, params));
+  exact_reverification &= reordering_enabled();
+  auto leaf_result_index = [this](int32_t token) {
+    return ConstSpan<DatapointIndex>(datapoints_by_token_[token]);
+  };
+
+  vector<NNResultsVector> results_by_query(queries.size());
+  SCANN_RETURN_IF_ERROR(ParallelForWithStatus<1>(
+      Seq(queries.size()), parallelization_pool_.get(),
+      [&](size_t i) -> Status {
+        FastTopNeighbors<float> top_n;
+        NNResultsVector& candidates = results_by_query[i];
+        SCANN_RETURN_IF_ERROR(FindNeighborsInRange(
+            queries[i], params[i], centers_to_search[i], leaf_result_index,
+            &top_n));
+        top_n.FinishUnsorted(&candidates);
+        if (exact_reverification) {
+          SCANN_RETURN_IF_ERROR(
+              ReverifyRangeResults(queries[i], params[i], &candidates));
+        }
+        if (params[i].sort_results()) {
+          ZipSortBranchOptimized(DistanceComparatorBranchOptimized(),
+                                 candidates.begin(), candidates.end());
+        }
+        return OkStatus();
+      }));
+  ConcatenateRangeResults(MakeMutableSpan(results_by_query), results);
+  return OkStatus();
+}
+
+Status TreeAHHybridResidual::FindNeighborsInRangeBatchedWithExternalIds(
+    const TypedDataset<float>& queries, ConstSpan<SearchParameters> params,
+    bool exact_reverification, ExternalIdRangeSearchResults* results) const {
+  DCHECK(results);
+  if (!external_ids_enabled()) {
+    return FailedPreconditionError("External ids have not been set.");
+  }
+  TF_ASSIGN_OR_RETURN(auto centers_to_search,
+                      CentersToSearchBatched(queries, params));
+  exact_reverification &= reordering_enabled();
+
+  vector<ExternalIdNNResultsVector> results_by_query(queries.size());
+  auto sort_query_results = [&](size_t query_index) {
+    if (params[query_index].sort_results()) {
+      ZipSortBranchOptimized(DistanceComparatorBranchOptimized(),
+                             results_by_query[query_index].begin(),
+                             results_by_query[query_index].end());
+    }
+  };
+
+  if (!exact_reverification) {
+    auto leaf_result_index = [this](int32_t token) {
+      return ConstSpan<int64_t>(external_ids_by_token_[token]);
+    };
+    SCANN_RETURN_IF_ERROR(ParallelForWithStatus<1>(
+        Seq(queries.size()), parallelization_pool_.get(),
+        [&](size_t i) -> Status {
+          FastTopNeighbors<float, uint64_t> top_n;
+          SCANN_RETURN_IF_ERROR(FindNeighborsInRange(
+              queries[i], params[i], centers_to_search[i], leaf_result_index,
+              &top_n));
+          ConstSpan<uint64_t> ids;
+          ConstSpan<float> dists;
+          std::tie(ids, dists) = top_n.FinishUnsorted();
+          ExternalIdNNResultsVector& neighbors = results_by_query[i];
+          neighbors.reserve(ids.size());
+          for (size_t j : IndicesOf(ids)) {
+            neighbors.emplace_back(static_cast<int64_t>(ids[j]), dists[j]);
+          }
+          sort_query_results(i);
+          return OkStatus();
+        }));
+    ConcatenateRangeResults(MakeMutableSpan(results_by_query), results);
+    return OkStatus();
+  }
+
+  auto leaf_result_index = [this](int32_t token) {
+    return ExternalIdAndDatapointIndex{external_ids_by_token_[token],
+                                       datapoints_by_token_[token]};
+  };
+  SCANN_RETURN_IF_ERROR(ParallelForWithStatus<1>(
+      Seq(queries.size()), parallelization_pool_.get(),
+      [&](size_t i) -> Status {
+        FastTopNeighbors<float, absl::uint128> top_n;
+        SCANN_RETURN_IF_ERROR(FindNeighborsInRange(
+            queries[i], params[i], centers_to_search[i], leaf_result_index,
+            &top_n));
+        ConstSpan<absl::uint128> keys;
+        ConstSpan<float> dists;
+        std::tie(keys, dists) = top_n.FinishUnsorted();
+        NNResultsVector candidates;
+        vector<pair<DatapointIndex, int64_t>> candidate_external_ids;
+        SplitExternalIdKeys(keys, dists, &candidates, &candidate_external_ids);
+        SCANN_RETURN_IF_ERROR(
+            ReverifyRangeResults(queries[i], params[i], &candidates));
+        ExternalIdNNResultsVector& neighbors = results_by_query[i];
+        neighbors.reserve(candidates.size());
+        for (const auto& candidate : candidates) {
+          neighbors.emplace_back(
+              LookupExternalId(candidate_external_ids, candidate.first),
+              candidate.second);
+        }
+        sort_query_results(i);
+        return OkStatus();
+      }));
+  ConcatenateRangeResults(MakeMutableSpan(results_by_query), results);
+  return OkStatus();
+}
+
+Status TreeAHHybridResidual::SetRestrictTokens(
+    ConstSpan<RestrictToken> token_by_datapoint,
+    const DisjointRestrictToken& config) {
+  if (token_by_datapoint.size() != num_datapoints_) {
+    return InvalidArgumentError(
+        "Number of restrict tokens (%d) does not match number of datapoints "
+        "(%d).",
+        token_by_datapoint.size(), num_datapoints_);
+  }
+  TF_ASSIGN_OR_RETURN(
+      restrict_token_postings_,
+      RestrictTokenPostings::Build(token_by_datapoint, datapoints_by_token_));
+  restrict_token_config_ = config;
+  return OkStatus();
+}
+
+vector<RestrictToken> TreeAHHybridResidual::RestrictTokensByDatapoint() const {
+  if (!restrict_tokens_enabled()) return {};
+  vector<RestrictToken> result(num_datapoints_,
+                               RestrictTokenPostings::kNoToken);
+  for (DatapointIndex dp_idx : Seq(num_datapoints_)) {
+    result[dp_idx] = restrict_token_postings_->TokenForDatapoint(dp_idx);
+  }
+  return result;
+}
+
+RestrictTokenSearchDecision TreeAHHybridResidual::PlanRestrictedQuery(
+    const DatapointPtr<float>& query, const SearchParameters& params,
+    const RestrictTokenPostings::TokenPostings& postings) const {
+  int32_t num_centers = NumCentersToSearch(params);
+  if (num_centers <= 0) {
+    auto kmeans_tokenizer =
+        dynamic_cast<const KMeansTreePartitioner<float>*>(query_tokenizer_.get());
+    num_centers = kmeans_tokenizer
+                      ? kmeans_tokenizer->query_spilling_max_centers()
+                      : 1;
+  }
+  RestrictTokenPlannerInputs planner_inputs;
+  planner_inputs.num_matching = postings.size;
+  planner_inputs.num_datapoints = num_datapoints_;
+  planner_inputs.num_leaves = datapoints_by_token_.size();
+  planner_inputs.num_centers_to_search =
+      std::min<size_t>(num_centers, datapoints_by_token_.size());
+  planner_inputs.dimensionality = query.dimensionality();
+  planner_inputs.num_ah_blocks = asymmetric_queryer_->num_blocks();
+  planner_inputs.can_brute_force = reordering_enabled();
+  return PlanRestrictTokenSearch(planner_inputs, restrict_token_config_);
+}
+
+bool TreeAHHybridResidual::ResultsAreReordered(
+    const DatapointPtr<float>& query, const SearchParameters& params) const {
+  if (!restrict_tokens_enabled()) return false;
+  auto tree_x_params =
+      params.searcher_specific_optional_parameters<TreeXOptionalParameters>();
+  if (!tree_x_params || !tree_x_params->restrict_token_enabled()) return false;
+  const RestrictTokenPostings::TokenPostings* postings =
+      restrict_token_postings_->Find(tree_x_params->restrict_token());
+  return postings && PlanRestrictedQuery(query, params, *postings).plan ==
+                         RestrictTokenSearchPlan::kBruteForce;
+}
+
+Status TreeAHHybridResidual::FindNeighborsWithRestrictToken(
+    const DatapointPtr<float>& query, const SearchParameters& params,
+    RestrictToken restrict_token, NNResultsVector* result) const {
+  DCHECK(result);
+  if (!restrict_tokens_enabled()) {
+    return FailedPreconditionError("Restrict tokens have not been set.");
+  }
+  if (params.pre_reordering_crowding_enabled()) {
+    return FailedPreconditionError("Crowding is not supported.");
+  }
+  result->clear();
+  const RestrictTokenPostings::TokenPostings* postings =
+      restrict_token_postings_->Find(restrict_token);
+  if (!postings) return OkStatus();
+
+  const int32_t center_override = NumCentersToSearch(params);
+  const RestrictTokenSearchDecision decision =
+      PlanRestrictedQuery(query, params, *postings);
+
+  switch (decision.plan) {
+    case RestrictTokenSearchPlan::kBruteForce: {
+      result->reserve(postings->size);
+      for (const auto& leaf_postings : postings->leaves) {
+        ConstSpan<DatapointIndex> leaf_local_to_global =
+            datapoints_by_token_[leaf_postings.leaf];
+        for (DatapointIndex local_index : leaf_postings.local_indices) {
+          const DatapointIndex dp_index = leaf_local_to_global[local_index];
+          if (params.IsWhitelisted(dp_index)) {
+            result->emplace_back(dp_index, 0.0f);
+          }
+        }
+      }
+      // These are already the reordering distances, so ResultsAreReordered
+      // lets the base class skip its reordering pass and the post-reordering
+      // limits are applied here together with the pre-reordering ones.
+      SCANN_RETURN_IF_ERROR(
+          reordering_helper().ComputeDistancesForReordering(query, result));
+      const float epsilon = std::min(params.pre_reordering_epsilon(),
+                                     params.post_reordering_epsilon());
+      result->erase(std::remove_if(result->begin(), result->end(),
+                                   [epsilon](const pair<DatapointIndex, float>&
+                                                 neighbor) {
+                                     return neighbor.second > epsilon;
+                                   }),
+                    result->end());
+      KeepBestResults(std::min(params.pre_reordering_num_neighbors(),
+                               params.post_reordering_num_neighbors()),
+                      result);
+      return OkStatus();
+    }
+    case RestrictTokenSearchPlan::kPostFilter: {
+      const DatapointIndex widened_num_neighbors = std::max<DatapointIndex>(
+          params.pre_reordering_num_neighbors(),
+          std::min<double>(
+              std::ceil(params.pre_reordering_num_neighbors() /
+                        decision.selectivity),
+              restrict_token_config_.post_filter_max_num_neighbors()));
+      SearchParameters unfiltered_params;
+      unfiltered_params.set_pre_reordering_num_neighbors(widened_num_neighbors);
+      unfiltered_params.set_pre_reordering_epsilon(
+          params.pre_reordering_epsilon());
+      if (params.restricts_enabled()) {
+        unfiltered_params.set_restrict_whitelist(
+            params.shared_restrict_whitelist());
+      }
+      TF_ASSIGN_OR_RETURN(auto centers_to_search,
+                          CentersToSearch(query, center_override));
+      SCANN_RETURN_IF_ERROR(FindNeighborsInternal1(
+          query, unfiltered_params, centers_to_search, result));
+      result->erase(
+          std::remove_if(result->begin(), result->end(),
+                         [&](const pair<DatapointIndex, float>& neighbor) {
+                           return restrict_token_postings_->TokenForDatapoint(
+                                      neighbor.first) != restrict_token;
+                         }),
+          result->end());
+      KeepBestResults(params.pre_reordering_num_neighbors(), result);
+      return OkStatus();
+    }
+    case RestrictTokenSearchPlan::kFilteredAnn: {
+      TF_ASSIGN_OR_RETURN(
+          auto centers_to_search,
+          CentersToSearch(query, static_cast<int32_t>(
+                                     decision.num_centers_to_search)));
+      FastTopNeighbors<float> top_n(params.pre_reordering_num_neighbors(),
+                                    params.pre_reordering_epsilon());
+      auto leaf_result_index = [this](int32_t token) {
+        return ConstSpan<DatapointIndex>(datapoints_by_token_[token]);
+      };
+      SCANN_RETURN_IF_ERROR(FindNeighborsInternal2(
+          query, params, centers_to_search, leaf_result_index,
+          RestrictTokenLeafWhitelist{params, *postings, datapoints_by_token_},
+          &top_n));
+      AssignResults(&top_n, result);
+      return OkStatus();
+    }
+  }
+  return InternalError("Unknown restrict token search plan.");
+}
+
 StatusOr<pair<int32_t, DatapointPtr<float>>>
 TreeAHHybridResidual::TokenizeAndMaybeResidualize(
     const DatapointPtr<float>& dptr, Datapoint<float>* residual_storage) {
@@ -727,7 +1691,46 @@ TreeAHHybridResidual::ExtractSingleMachineFactoryOptions() {
   return opts;
 }
 
-bool TreeAHHybridResidual::AddDatasetWithIdsInternel(const TypedDataset<float>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config) {
+StatusOr<std::vector<int64_t>> TreeAHHybridResidual::ParseExternalIds(
+    DatapointIndex num_datapoints, const std::vector<std::string>& ids) {
+  if (ids.size() != num_datapoints) {
+    return InvalidArgumentError(
+        "External ids are enabled but %d ids were given for %d datapoints.",
+        ids.size(), num_datapoints);
+  }
+  std::vector<int64_t> result(num_datapoints);
+  for (DatapointIndex i : Seq(num_datapoints)) {
+    if (!absl::SimpleAtoi(ids[i], &result[i])) {
+      return InvalidArgumentError("Malformed external id \"%s\" for datapoint %d.",
+                                  ids[i], i);
+    }
+  }
+  return result;
+}
+
+Status TreeAHHybridResidual::CheckDatasetToAdd(
+    const TypedDataset<float>& dataset,
+    const TypedDataset<uint8_t>& hashed_dataset,
+    const std::vector<std::string>& ids,
+    const AddDatasetAttributes& attributes) const {
+  if (external_ids_enabled()) {
+    SCANN_RETURN_IF_ERROR(ParseExternalIds(dataset.size(), ids).status());
+  }
+  if (!attributes.restrict_tokens.empty()) {
+    if (!restrict_tokens_enabled()) {
+      return FailedPreconditionError(
+          "Restrict tokens were given but have not been set on the index.");
+    }
+    if (attributes.restrict_tokens.size() != dataset.size()) {
+      return InvalidArgumentError(
+          "%d restrict tokens were given for %d datapoints.",
+          attributes.restrict_tokens.size(), dataset.size());
+    }
+  }
+  return OkStatus();
+}
+
+bool TreeAHHybridResidual::AddDatasetWithIdsInternel(const TypedDataset<float>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config, const AddDatasetAttributes& attributes) {
   auto get_hashed_datapoint =
     [&](DatapointIndex i, int32_t token,
         Datapoint<uint8_t>* storage) -> StatusOr<DatapointPtr<uint8_t>> {
@@ -753,15 +1756,36 @@ bool TreeAHHybridResidual::AddDatasetWithIdsInternel(const TypedDataset<float>&
   query_tokenizer_->set_tokenization_mode(UntypedPartitioner::DATABASE);
   // 每个请求取top1 kmeans token
   vector<std::vector<DatapointIndex>> datapoints_by_token = {};
+  const absl::Time tokenization_start = absl::Now();
   auto token_status = query_tokenizer_->TokenizeDatabase(
-      dataset, nullptr);
+      dataset, parallelization_pool_.get());
   query_tokenizer_->set_tokenization_mode(UntypedPartitioner::QUERY);
   if (!token_status.ok()) {
     LOG(ERROR) << "token status: " << token_status.status();
     return false;
   }
+  const double tokenization_seconds =
+      absl::ToDoubleSeconds(absl::Now() - tokenization_start);
+  VLOG(1) << "Tokenized " << dataset.size() << " datapoints in "
+          << tokenization_seconds << "s ("
+          << dataset.size() / std::max(tokenization_seconds, 1e-9)
+          << " datapoints/s).";
   datapoints_by_token = token_status.ValueOrDie();
 
+  // 原始数据集可能已释放(半精度重排), 此时以num_datapoints_为起始下标
+  const DatapointIndex base_index =
+      this->dataset() ? this->dataset()->size() - dataset.size()
+                      : num_datapoints_;
+  // 先解析外部 id 并完成全部哈希, 出错时叶子尚未修改
+  std::vector<int64_t> external_ids;
+  if (external_ids_enabled()) {
+    auto status_or_ids = ParseExternalIds(dataset.size(), ids);
+    if (!status_or_ids.ok()) {
+      LOG(ERROR) << status_or_ids.status();
+      return false;
+    }
+    external_ids = std::move(status_or_ids).ValueOrDie();
+  }
   std::unordered_map<uint32_t, DenseDataset<uint8_t>> token2hasheddataset;
   Datapoint<uint8_t> hashed_storage;
   for (auto token : IndicesOf(datapoints_by_token)) {
@@ -771,25 +1795,56 @@ bool TreeAHHybridResidual::AddDatasetWithIdsInternel(const TypedDataset<float>&
       hashed_partition.set_packing_strategy(HashedItem::NIBBLE);
     }
     for (DatapointIndex dp_index : datapoints_by_token[token]) {
-      //dataset().size() - dataset.size() + i
-      datapoints_by_token_[token].push_back(this->dataset()->size() - dataset.size() + dp_index);
       auto status_or_hashed_dptr =
         get_hashed_datapoint(dp_index, token, &hashed_storage);
       if (!status_or_hashed_dptr.status().ok()) {
+        LOG(ERROR) << status_or_hashed_dptr.status();
         return false;
       }
       auto hashed_dptr = status_or_hashed_dptr.ValueOrDie();
       auto local_status = hashed_partition.Append(hashed_dptr, "");
       if (!local_status.ok()) {
+        LOG(ERROR) << local_status;
         return false;
       }
     }
   }
+  // 开启 crowding 时基类已检查属性个数, 叶子按各自新增点追加属性
+  const bool crowding = !crowding_attributes_by_token_.empty();
+  std::unordered_map<uint32_t, std::vector<int64_t>> token2crowdingattributes;
+  for (auto token : IndicesOf(datapoints_by_token)) {
+    for (DatapointIndex dp_index : datapoints_by_token[token]) {
+      if (external_ids_enabled()) {
+        external_ids_by_token_[token].push_back(external_ids[dp_index]);
+      }
+      if (crowding) {
+        const int64_t attribute = attributes.crowding_attributes[dp_index];
+        crowding_attributes_by_token_[token].push_back(attribute);
+        token2crowdingattributes[token].push_back(attribute);
+      }
+      //dataset().size() - dataset.size() + i
+      datapoints_by_token_[token].push_back(base_index + dp_index);
+      if (restrict_token_postings_) {
+        restrict_token_postings_->Append(
+            base_index + dp_index, token, datapoints_by_token_[token].size() - 1,
+            attributes.restrict_tokens.empty()
+                ? RestrictTokenPostings::kNoToken
+                : attributes.restrict_tokens[dp_index]);
+      }
+    }
+  }
+  num_datapoints_ = std::max<DatapointIndex>(num_datapoints_,
+                                             base_index + dataset.size());
   DenseDataset<float> tmp_dataset;
   for (const auto& pair : token2hasheddataset) {
     uint32_t token = pair.first;
     if (leaf_searchers_.size() > token and leaf_searchers_[token]) {
-      leaf_searchers_[token]->AddDatasetWithIds(tmp_dataset, pair.second, {}, config);
+      AddDatasetAttributes leaf_attributes;
+      if (crowding) {
+        leaf_attributes.crowding_attributes = token2crowdingattributes[token];
+      }
+      leaf_searchers_[token]->AddDatasetWithIds(tmp_dataset, pair.second, {},
+                                                config, leaf_attributes);
     } else {
       LOG(INFO) << "has error" <<  " token:" << token;
     }
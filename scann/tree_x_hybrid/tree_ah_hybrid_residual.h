@@ -27,8 +27,11 @@
 #include "scann/hashes/asymmetric_hashing2/searcher.h"
 #include "scann/partitioning/kmeans_tree_like_partitioner.h"
 #include "scann/partitioning/kmeans_tree_partitioner.h"
+#include "scann/proto/disjoint_restrict_token.pb.h"
 #include "scann/proto/hash.pb.h"
+#include "scann/tree_x_hybrid/restrict_token_postings.h"
 #include "scann/trees/kmeans_tree/kmeans_tree.h"
+#include "scann/utils/numa.h"
 #include "scann/utils/types.h"
 
 namespace tensorflow {
@@ -56,18 +59,32 @@ class TreeAHHybridResidual final : public SingleMachineSearcherBase<float> {
     database_tokenizer_ = database_tokenizer;
   }
 
+  void set_parallelization_pool(shared_ptr<thread::ThreadPool> pool) {
+    parallelization_pool_ = std::move(pool);
+  }
+
   bool supports_crowding() const final { return true; }
 
   static StatusOr<DenseDataset<float>> ComputeResiduals(
       const DenseDataset<float>& dataset,
       const KMeansTreeLikePartitioner<float>* partitioner,
       ConstSpan<std::vector<DatapointIndex>> datapoints_by_token,
-      bool normalize_residual_by_cluster_stdev = false);
+      bool normalize_residual_by_cluster_stdev = false,
+      thread::ThreadPool* pool = nullptr);
 
   static StatusOr<DenseDataset<float>> ComputeResiduals(
       const DenseDataset<float>& dataset,
       const DenseDataset<float>& kmeans_centers,
-      ConstSpan<std::vector<DatapointIndex>> datapoints_by_token);
+      ConstSpan<std::vector<DatapointIndex>> datapoints_by_token,
+      thread::ThreadPool* pool = nullptr);
+
+  static StatusOr<DenseDataset<float>> ComputeResidualsForSample(
+      const DenseDataset<float>& dataset,
+      const KMeansTreeLikePartitioner<float>* partitioner,
+      ConstSpan<std::vector<DatapointIndex>> datapoints_by_token,
+      ConstSpan<DatapointIndex> sample,
+      bool normalize_residual_by_cluster_stdev = false,
+      thread::ThreadPool* pool = nullptr);
 
   StatusOr<unique_ptr<SearchParameters::UnlockedQueryPreprocessingResults>>
   UnlockedPreprocessQuery(const DatapointPtr<float>& query) const final;
@@ -75,7 +92,53 @@ class TreeAHHybridResidual final : public SingleMachineSearcherBase<float> {
   StatusOr<SingleMachineFactoryOptions> ExtractSingleMachineFactoryOptions()
       override;
 
-  bool AddDatasetWithIdsInternel(const TypedDataset<float>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config) override;
+  Status CheckDatasetToAdd(const TypedDataset<float>& dataset,
+                           const TypedDataset<uint8_t>& hashed_dataset,
+                           const std::vector<std::string>& ids,
+                           const AddDatasetAttributes& attributes) const override;
+
+  bool AddDatasetWithIdsInternel(const TypedDataset<float>& dataset, const TypedDataset<uint8_t>& hashed_dataset, const std::vector<std::string>& ids, const ScannConfig& config, const AddDatasetAttributes& attributes) override;
+
+  Status SetExternalIds(ConstSpan<int64_t> external_ids);
+
+  bool external_ids_enabled() const { return !external_ids_by_token_.empty(); }
+
+  vector<int64_t> ExternalIdsByDatapoint() const;
+
+  Status FindNeighborsWithExternalIds(const DatapointPtr<float>& query,
+                                      const SearchParameters& params,
+                                      ExternalIdNNResultsVector* result) const;
+
+  Status FindNeighborsInRangeBatched(const TypedDataset<float>& queries,
+                                     ConstSpan<SearchParameters> params,
+                                     bool exact_reverification,
+                                     RangeSearchResults* results) const;
+
+  Status FindNeighborsInRangeBatchedWithExternalIds(
+      const TypedDataset<float>& queries, ConstSpan<SearchParameters> params,
+      bool exact_reverification, ExternalIdRangeSearchResults* results) const;
+
+  Status SetRestrictTokens(ConstSpan<RestrictToken> token_by_datapoint,
+                           const DisjointRestrictToken& config);
+
+  bool restrict_tokens_enabled() const {
+    return restrict_token_postings_ != nullptr;
+  }
+
+  // One token per datapoint, kNoToken for untagged ones.  Empty if restrict
+  // tokens are not enabled.
+  vector<RestrictToken> RestrictTokensByDatapoint() const;
+
+  // Spreads the leaves over the NUMA nodes of numa_pools, moves the packed
+  // codes of every leaf onto its node and makes batched searches scan each
+  // leaf on a worker of that node.  With replicate_small_structures, every
+  // node scans with its own copy of the query lookup tables.  The packed codes
+  // are replaced without synchronization, so this must be called before the
+  // searcher starts serving queries.
+  Status EnableNumaPlacement(shared_ptr<NumaThreadPools> numa_pools,
+                             bool replicate_small_structures);
+
+  bool numa_placement_enabled() const { return numa_pools_ != nullptr; }
 
  protected:
   bool impl_needs_dataset() const final { return leaf_searchers_.empty(); }
@@ -92,9 +155,14 @@ class TreeAHHybridResidual final : public SingleMachineSearcherBase<float> {
       const TypedDataset<float>& queries, ConstSpan<SearchParameters> params,
       MutableSpan<NNResultsVector> results) const final;
 
+  bool ResultsAreReordered(const DatapointPtr<float>& query,
+                           const SearchParameters& params) const final;
+
   Status EnableCrowdingImpl(
       ConstSpan<int64_t> datapoint_index_to_crowding_attribute) final;
 
+  void DisableCrowdingImpl() final;
+
  private:
   class UnlockedTreeAHHybridResidualPreprocessingResults
       : public SearchParameters::UnlockedQueryPreprocessingResults {
@@ -128,11 +196,60 @@ class TreeAHHybridResidual final : public SingleMachineSearcherBase<float> {
       ConstSpan<KMeansTreeSearchResult> centers_to_search,
       NNResultsVector* result) const;
 
-  template <typename TopN>
+  template <typename TopN, typename LeafResultIndexFactory,
+            typename LeafWhitelistFactory>
   Status FindNeighborsInternal2(
       const DatapointPtr<float>& query, const SearchParameters& params,
-      ConstSpan<KMeansTreeSearchResult> centers_to_search, TopN top_n,
-      NNResultsVector* result) const;
+      ConstSpan<KMeansTreeSearchResult> centers_to_search,
+      const LeafResultIndexFactory& leaf_result_index,
+      const LeafWhitelistFactory& leaf_whitelist, TopN* top_n) const;
+
+  template <typename TopN>
+  Status FindNeighborsBatchedLowLevel(
+      const TypedDataset<float>& queries, ConstSpan<SearchParameters> params,
+      ConstSpan<vector<KMeansTreeSearchResult>> centers_to_search,
+      MutableSpan<NNResultsVector> results) const;
+
+  Status FindNeighborsBatchedNuma(
+      const TypedDataset<float>& queries, ConstSpan<SearchParameters> params,
+      ConstSpan<vector<KMeansTreeSearchResult>> centers_to_search,
+      MutableSpan<NNResultsVector> results) const;
+
+  static StatusOr<std::vector<int64_t>> ParseExternalIds(
+      DatapointIndex num_datapoints, const std::vector<std::string>& ids);
+
+  RestrictTokenSearchDecision PlanRestrictedQuery(
+      const DatapointPtr<float>& query, const SearchParameters& params,
+      const RestrictTokenPostings::TokenPostings& postings) const;
+
+  Status FindNeighborsWithRestrictToken(const DatapointPtr<float>& query,
+                                        const SearchParameters& params,
+                                        RestrictToken restrict_token,
+                                        NNResultsVector* result) const;
+
+  template <typename TopN, typename LeafResultIndexFactory>
+  Status FindNeighborsInRange(
+      const DatapointPtr<float>& query, const SearchParameters& params,
+      ConstSpan<KMeansTreeSearchResult> centers_to_search,
+      const LeafResultIndexFactory& leaf_result_index, TopN* top_n) const;
+
+  Status ReverifyRangeResults(const DatapointPtr<float>& query,
+                              const SearchParameters& params,
+                              NNResultsVector* candidates) const;
+
+  int32_t NumCentersToSearch(const SearchParameters& params) const;
+
+  StatusOr<vector<vector<KMeansTreeSearchResult>>> CentersToSearchBatched(
+      const TypedDataset<float>& queries,
+      ConstSpan<SearchParameters> params) const;
+
+  StatusOr<vector<KMeansTreeSearchResult>> CentersToSearch(
+      const DatapointPtr<float>& query, int32_t num_centers) const;
+
+  StatusOr<vector<KMeansTreeSearchResult>> CentersToSearch(
+      const DatapointPtr<float>& query, const SearchParameters& params) const {
+    return CentersToSearch(query, NumCentersToSearch(params));
+  }
 
   Status CheckBuildLeafSearchersPreconditions(
       const AsymmetricHasherConfig& config,
@@ -153,8 +270,24 @@ class TreeAHHybridResidual final : public SingleMachineSearcherBase<float> {
   unique_ptr<KMeansTreeLikePartitioner<float>> query_tokenizer_;
   shared_ptr<const KMeansTreeLikePartitioner<float>> database_tokenizer_;
 
+  shared_ptr<thread::ThreadPool> parallelization_pool_;
+
   vector<std::vector<DatapointIndex>> datapoints_by_token_;
 
+  vector<std::vector<int64_t>> external_ids_by_token_;
+
+  vector<std::vector<int64_t>> crowding_attributes_by_token_;
+
+  unique_ptr<RestrictTokenPostings> restrict_token_postings_;
+
+  DisjointRestrictToken restrict_token_config_;
+
+  shared_ptr<NumaThreadPools> numa_pools_;
+
+  vector<std::vector<int32_t>> leaf_tokens_by_numa_node_;
+
+  bool numa_replicate_small_structures_ = false;
+
   DatapointIndex num_datapoints_ = 0;
 
   vector<float> ah_variance_adjustment_by_token_;
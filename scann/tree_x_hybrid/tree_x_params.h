@@ -74,11 +74,26 @@ class TreeXOptionalParameters final
     num_partitions_to_search_override_ = num_partitions_to_search_override;
   }
 
+  bool restrict_token_enabled() const { return restrict_token_enabled_; }
+
+  uint64_t restrict_token() const { return restrict_token_; }
+
+  void set_restrict_token(uint64_t restrict_token) {
+    restrict_token_ = restrict_token;
+    restrict_token_enabled_ = true;
+  }
+
+  void clear_restrict_token() { restrict_token_enabled_ = false; }
+
  private:
   vector<int32_t> leaf_tokens_to_search_ = {};
 
   int32_t num_partitions_to_search_override_ = 0;
 
+  uint64_t restrict_token_ = 0;
+
+  bool restrict_token_enabled_ = false;
+
   vector<shared_ptr<const SearcherSpecificOptionalParameters>>
       leaf_params_by_token_;
 
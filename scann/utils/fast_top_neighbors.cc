@@ -123,13 +123,24 @@ SCANN_INLINE DistT FastMedianOf3(DistT v0, DistT v1, DistT v2) {
 #define SCANN_SIMD_INLINE_LAMBDA SCANN_SIMD_ATTRIBUTE SCANN_INLINE_LAMBDA
 #define SCANN_SIMD_OUTLINE SCANN_SIMD_ATTRIBUTE SCANN_OUTLINE
 
+namespace avx512 {
+template <typename T>
+using Simd = avx2::Simd<T>;
+constexpr bool kSimdIsAvx512 = true;
+#define SCANN_SIMD_ATTRIBUTE SCANN_AVX512_ATTRIBUTE
+#include "scann/utils/fast_top_neighbors_impl.inc"
+#undef SCANN_SIMD_ATTRIBUTE
+}  // namespace avx512
+
 namespace avx2 {
+constexpr bool kSimdIsAvx512 = false;
 #define SCANN_SIMD_ATTRIBUTE SCANN_AVX2_ATTRIBUTE
 #include "scann/utils/fast_top_neighbors_impl.inc"
 #undef SCANN_SIMD_ATTRIBUTE
 }  // namespace avx2
 
 namespace sse4 {
+constexpr bool kSimdIsAvx512 = false;
 #define SCANN_SIMD_ATTRIBUTE SCANN_SSE4_ATTRIBUTE
 #include "scann/utils/fast_top_neighbors_impl.inc"
 #undef SCANN_SIMD_ATTRIBUTE
@@ -142,7 +153,9 @@ size_t FastTopNeighbors<DistT, DatapointIndexT>::ApproxNthElement(
     size_t keep_min, size_t keep_max, size_t sz, DatapointIndexT* ii, DistT* dd,
     uint32_t* mm) {
 #ifdef __x86_64__
-  if (RuntimeSupportsAvx2()) {
+  if (RuntimeSupportsAvx512()) {
+    return avx512::ApproxNthElementImpl(keep_min, keep_max, sz, ii, dd, mm);
+  } else if (RuntimeSupportsAvx2()) {
     return avx2::ApproxNthElementImpl(keep_min, keep_max, sz, ii, dd, mm);
   } else if (RuntimeSupportsSse4()) {
     return sse4::ApproxNthElementImpl(keep_min, keep_max, sz, ii, dd, mm);
@@ -0,0 +1,227 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#ifndef SCANN__UTILS_FAST_TOP_NEIGHBORS_CROWDING_H_
+#define SCANN__UTILS_FAST_TOP_NEIGHBORS_CROWDING_H_
+
+#include <algorithm>
+#include <numeric>
+
+#include "absl/container/flat_hash_map.h"
+#include "scann/utils/common.h"
+#include "scann/utils/types.h"
+
+namespace tensorflow {
+namespace scann_ops {
+
+// Drop-in replacement for FastTopNeighbors that keeps at most
+// per_crowding_attribute_max_results results per crowding attribute.  Pushes
+// are plain appends; crowding is enforced lazily whenever the buffer fills, by
+// a greedy pass in distance order that counts attributes in a hash table of at
+// most max_results entries.  Push looks attributes up in the span given at
+// Init (indexed by the pushed datapoint index); callers that already know the
+// attribute use PushWithAttribute instead.
+template <typename DistT, typename DatapointIndexT = DatapointIndex>
+class FastTopNeighborsWithCrowding {
+ public:
+  FastTopNeighborsWithCrowding() {}
+
+  FastTopNeighborsWithCrowding(size_t max_results, DistT epsilon,
+                               size_t per_crowding_attribute_max_results,
+                               ConstSpan<int64_t> crowding_attributes = {}) {
+    Init(max_results, epsilon, per_crowding_attribute_max_results,
+         crowding_attributes);
+  }
+
+  FastTopNeighborsWithCrowding(FastTopNeighborsWithCrowding&&) = default;
+  FastTopNeighborsWithCrowding& operator=(FastTopNeighborsWithCrowding&&) =
+      default;
+
+  void Init(size_t max_results, DistT epsilon,
+            size_t per_crowding_attribute_max_results,
+            ConstSpan<int64_t> crowding_attributes = {}) {
+    CHECK(!mutator_held_);
+    max_results_ = max_results;
+    per_crowding_attribute_max_results_ = per_crowding_attribute_max_results;
+    epsilon_ = epsilon;
+    crowding_attributes_ = crowding_attributes;
+    sz_ = 0;
+    const size_t initial_results = std::min<size_t>(
+        std::max<size_t>(max_results, 1), kMaxNoReallocResults);
+    Reserve(NextMultipleOf(2 * initial_results, 32));
+    attribute_counts_.clear();
+    attribute_counts_.reserve(
+        std::min<size_t>(max_results, kMaxNoReallocResults));
+  }
+
+  void set_crowding_attributes(ConstSpan<int64_t> crowding_attributes) {
+    crowding_attributes_ = crowding_attributes;
+  }
+
+  SCANN_INLINE DistT epsilon() const { return epsilon_; }
+
+  size_t max_results() const { return max_results_; }
+
+  size_t per_crowding_attribute_max_results() const {
+    return per_crowding_attribute_max_results_;
+  }
+
+  class Mutator;
+  void AcquireMutator(Mutator* mutator) {
+    DCHECK(!mutator_held_);
+    mutator_held_ = true;
+    mutator->parent_ = this;
+  }
+
+  pair<MutableSpan<DatapointIndexT>, MutableSpan<DistT>> FinishUnsorted() {
+    CHECK(!mutator_held_);
+    GarbageCollect();
+    return std::make_pair(MutableSpan<DatapointIndexT>(indices_.data(), sz_),
+                          MutableSpan<DistT>(distances_.data(), sz_));
+  }
+
+  void FinishUnsorted(std::vector<pair<DatapointIndexT, DistT>>* results) {
+    ConstSpan<DatapointIndexT> idxs;
+    ConstSpan<DistT> dists;
+    std::tie(idxs, dists) = FinishUnsorted();
+    results->resize(idxs.size());
+    for (size_t j : Seq(idxs.size())) {
+      (*results)[j] = std::make_pair(idxs[j], dists[j]);
+    }
+  }
+
+ private:
+  enum : size_t { kMaxNoReallocResults = 16384 };
+
+  void Reserve(size_t capacity) {
+    capacity_ = capacity;
+    indices_.resize(capacity);
+    distances_.resize(capacity);
+    attributes_.resize(capacity);
+  }
+
+  void GarbageCollect();
+
+  std::vector<DatapointIndexT> indices_;
+  std::vector<DistT> distances_;
+  std::vector<int64_t> attributes_;
+
+  std::vector<uint32_t> order_;
+  std::vector<DatapointIndexT> scratch_indices_;
+  std::vector<DistT> scratch_distances_;
+  std::vector<int64_t> scratch_attributes_;
+
+  absl::flat_hash_map<int64_t, uint32_t> attribute_counts_;
+
+  ConstSpan<int64_t> crowding_attributes_;
+
+  size_t sz_ = 0;
+  size_t capacity_ = 0;
+  size_t max_results_ = 0;
+  size_t per_crowding_attribute_max_results_ = 0;
+  DistT epsilon_ = MaxOrInfinity<DistT>();
+  bool mutator_held_ = false;
+
+  friend class Mutator;
+};
+
+template <typename DistT, typename DatapointIndexT>
+class FastTopNeighborsWithCrowding<DistT, DatapointIndexT>::Mutator {
+ public:
+  SCANN_DECLARE_MOVE_ONLY_CLASS(Mutator);
+
+  Mutator() {}
+
+  void Release() {
+    if (parent_) {
+      parent_->mutator_held_ = false;
+      parent_ = nullptr;
+    }
+  }
+
+  ~Mutator() { Release(); }
+
+  SCANN_INLINE bool Push(DatapointIndexT dp_idx, DistT distance) {
+    DCHECK_LT(dp_idx, parent_->crowding_attributes_.size());
+    return PushWithAttribute(dp_idx, distance,
+                             parent_->crowding_attributes_[dp_idx]);
+  }
+
+  SCANN_INLINE bool PushWithAttribute(DatapointIndexT dp_idx, DistT distance,
+                                      int64_t crowding_attribute) {
+    DCHECK_LT(parent_->sz_, parent_->capacity_);
+    const size_t i = parent_->sz_++;
+    parent_->indices_[i] = dp_idx;
+    parent_->distances_[i] = distance;
+    parent_->attributes_[i] = crowding_attribute;
+    return parent_->sz_ == parent_->capacity_;
+  }
+
+  SCANN_INLINE DistT epsilon() const { return parent_->epsilon_; }
+
+  void GarbageCollect() { parent_->GarbageCollect(); }
+
+ private:
+  FastTopNeighborsWithCrowding* parent_ = nullptr;
+
+  friend class FastTopNeighborsWithCrowding;
+};
+
+template <typename DistT, typename DatapointIndexT>
+void FastTopNeighborsWithCrowding<DistT, DatapointIndexT>::GarbageCollect() {
+  if (sz_ == 0) return;
+
+  // Greedily taking results in distance order while skipping saturated
+  // attributes yields exactly the crowded top-N of what was pushed so far.
+  order_.resize(sz_);
+  std::iota(order_.begin(), order_.end(), 0);
+  std::sort(order_.begin(), order_.end(), [this](uint32_t a, uint32_t b) {
+    return distances_[a] < distances_[b] ||
+           (distances_[a] == distances_[b] && indices_[a] < indices_[b]);
+  });
+  attribute_counts_.clear();
+  size_t num_kept = 0;
+  for (uint32_t i : order_) {
+    if (num_kept == max_results_) break;
+    uint32_t& count = attribute_counts_[attributes_[i]];
+    if (count >= per_crowding_attribute_max_results_) continue;
+    ++count;
+    order_[num_kept++] = i;
+  }
+
+  scratch_indices_.resize(capacity_);
+  scratch_distances_.resize(capacity_);
+  scratch_attributes_.resize(capacity_);
+  for (size_t j : Seq(num_kept)) {
+    scratch_indices_[j] = indices_[order_[j]];
+    scratch_distances_[j] = distances_[order_[j]];
+    scratch_attributes_[j] = attributes_[order_[j]];
+  }
+  indices_.swap(scratch_indices_);
+  distances_.swap(scratch_distances_);
+  attributes_.swap(scratch_attributes_);
+  sz_ = num_kept;
+
+  if (num_kept > 0 && num_kept == max_results_) {
+    epsilon_ = std::min(epsilon_, distances_[num_kept - 1]);
+  }
+  if (2 * num_kept >= capacity_) Reserve(2 * capacity_);
+}
+
+}  // namespace scann_ops
+}  // namespace tensorflow
+
+#endif
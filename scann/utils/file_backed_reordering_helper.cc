@@ -0,0 +1,373 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "scann/utils/file_backed_reordering_helper.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "scann/distance_measures/one_to_many/one_to_many.h"
+#include "scann/utils/common.h"
+#include "scann/utils/parallel_for.h"
+
+namespace tensorflow {
+namespace scann_ops {
+namespace {
+
+constexpr size_t kNumCacheShards = 64;
+
+constexpr size_t kMaxRowsPerRead = 64;
+
+constexpr size_t kMinReadsForParallelism = 8;
+
+Status IoError(const std::string& op, const std::string& filename) {
+  return InternalError(
+      absl::StrCat(op, " failed for ", filename, ": ", std::strerror(errno)));
+}
+
+Status PreadFully(int fd, const std::string& filename, char* buffer,
+                  size_t num_bytes, off_t offset) {
+  while (num_bytes > 0) {
+    const ssize_t bytes_read = pread(fd, buffer, num_bytes, offset);
+    if (bytes_read < 0) {
+      if (errno == EINTR) continue;
+      return IoError("pread", filename);
+    }
+    if (bytes_read == 0) {
+      return OutOfRangeError(
+          absl::StrCat("Unexpected end of reordering file ", filename, "."));
+    }
+    buffer += bytes_read;
+    num_bytes -= bytes_read;
+    offset += bytes_read;
+  }
+  return OkStatus();
+}
+
+Status PwriteFully(int fd, const std::string& filename, const char* buffer,
+                   size_t num_bytes, off_t offset) {
+  while (num_bytes > 0) {
+    const ssize_t bytes_written = pwrite(fd, buffer, num_bytes, offset);
+    if (bytes_written < 0) {
+      if (errno == EINTR) continue;
+      return IoError("pwrite", filename);
+    }
+    buffer += bytes_written;
+    num_bytes -= bytes_written;
+    offset += bytes_written;
+  }
+  return OkStatus();
+}
+
+}  // namespace
+
+class FileBackedFloatDenseReorderingHelper::Mutator
+    : public ReorderingInterface<float>::Mutator {
+ public:
+  explicit Mutator(FileBackedFloatDenseReorderingHelper* helper)
+      : helper_(helper) {}
+
+  StatusOr<DatapointIndex> AddDatapoint(
+      const DatapointPtr<float>& dptr) override {
+    SCANN_RETURN_IF_ERROR(CheckDimensionality(dptr));
+    const DatapointIndex result = helper_->size();
+    SCANN_RETURN_IF_ERROR(WriteRow(dptr, result));
+    helper_->size_.store(result + 1, std::memory_order_release);
+    return result;
+  }
+
+  StatusOr<DatapointIndex> RemoveDatapoint(DatapointIndex idx) override {
+    const DatapointIndex size = helper_->size();
+    if (idx >= size) {
+      return OutOfRangeError(absl::StrFormat(
+          "The datapoint index %d is >= the dataset size %d", idx, size));
+    }
+    const DatapointIndex last = size - 1;
+    if (idx != last) {
+      std::vector<float> row(helper_->dimensionality_);
+      SCANN_RETURN_IF_ERROR(helper_->Reconstruct(last, MakeMutableSpan(row)));
+      SCANN_RETURN_IF_ERROR(
+          WriteRow(MakeDatapointPtr(row.data(), row.size()), idx));
+    }
+    // Shrink size_ before truncating so concurrent searches never read the
+    // truncated row.
+    helper_->size_.store(last, std::memory_order_release);
+    helper_->InvalidateCache(last);
+    if (ftruncate(helper_->fd_, last * helper_->row_bytes()) != 0) {
+      return IoError("ftruncate", helper_->filename_);
+    }
+    return last;
+  }
+
+  Status UpdateDatapoint(const DatapointPtr<float>& dptr,
+                         DatapointIndex idx) override {
+    SCANN_RETURN_IF_ERROR(CheckDimensionality(dptr));
+    const DatapointIndex size = helper_->size();
+    if (idx >= size) {
+      return OutOfRangeError(absl::StrFormat(
+          "The datapoint index %d is >= the dataset size %d", idx, size));
+    }
+    return WriteRow(dptr, idx);
+  }
+
+ private:
+  Status CheckDimensionality(const DatapointPtr<float>& dptr) const {
+    if (!dptr.IsDense() || dptr.dimensionality() != helper_->dimensionality_) {
+      return InvalidArgumentError(absl::StrFormat(
+          "File-backed reordering requires dense datapoints of "
+          "dimensionality %d.",
+          helper_->dimensionality_));
+    }
+    return OkStatus();
+  }
+
+  Status WriteRow(const DatapointPtr<float>& dptr, DatapointIndex idx) {
+    SCANN_RETURN_IF_ERROR(PwriteFully(
+        helper_->fd_, helper_->filename_, reinterpret_cast<const char*>(dptr.values()),
+        helper_->row_bytes(), idx * helper_->row_bytes()));
+    helper_->InvalidateCache(idx);
+    return OkStatus();
+  }
+
+  FileBackedFloatDenseReorderingHelper* helper_;
+};
+
+StatusOr<unique_ptr<FileBackedFloatDenseReorderingHelper>>
+FileBackedFloatDenseReorderingHelper::Create(
+    shared_ptr<const DistanceMeasure> exact_reordering_distance,
+    const std::string& filename, DimensionIndex dimensionality,
+    DatapointIndex cache_size_rows, shared_ptr<thread::ThreadPool> pool) {
+  if (dimensionality == 0) {
+    return InvalidArgumentError(
+        "File-backed reordering requires a nonzero dimensionality.");
+  }
+  const int fd = open(filename.c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) return IoError("open", filename);
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    Status status = IoError("fstat", filename);
+    close(fd);
+    return status;
+  }
+  const size_t row_bytes = dimensionality * sizeof(float);
+  if (file_stat.st_size % row_bytes != 0) {
+    close(fd);
+    return InvalidArgumentError(absl::StrFormat(
+        "Reordering file %s has size %d, which is not a multiple of the row "
+        "size %d.",
+        filename, file_stat.st_size, row_bytes));
+  }
+  return absl::WrapUnique(new FileBackedFloatDenseReorderingHelper(
+      std::move(exact_reordering_distance), filename, fd, dimensionality,
+      file_stat.st_size / row_bytes, cache_size_rows, std::move(pool)));
+}
+
+Status FileBackedFloatDenseReorderingHelper::WriteDataset(
+    const DenseDataset<float>& dataset, const std::string& filename) {
+  const int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                      0644);
+  if (fd < 0) return IoError("open", filename);
+  ConstSpan<float> data = dataset.data();
+  Status status =
+      PwriteFully(fd, filename, reinterpret_cast<const char*>(data.data()),
+                  data.size() * sizeof(float), 0);
+  if (close(fd) != 0 && status.ok()) status = IoError("close", filename);
+  return status;
+}
+
+FileBackedFloatDenseReorderingHelper::FileBackedFloatDenseReorderingHelper(
+    shared_ptr<const DistanceMeasure> exact_reordering_distance,
+    std::string filename, int fd, DimensionIndex dimensionality,
+    DatapointIndex size, DatapointIndex cache_size_rows,
+    shared_ptr<thread::ThreadPool> pool)
+    : exact_reordering_distance_(std::move(exact_reordering_distance)),
+      filename_(std::move(filename)),
+      fd_(fd),
+      dimensionality_(dimensionality),
+      size_(size),
+      cache_size_rows_(cache_size_rows),
+      pool_(std::move(pool)) {
+  if (cache_size_rows_ > 0) {
+    cache_mutexes_.reset(new absl::Mutex[kNumCacheShards]);
+    cache_tags_.resize(cache_size_rows_, kInvalidDatapointIndex);
+    cache_versions_.resize(cache_size_rows_, 0);
+    cache_rows_.resize(cache_size_rows_ * dimensionality_);
+  }
+}
+
+FileBackedFloatDenseReorderingHelper::~FileBackedFloatDenseReorderingHelper() {
+  if (fd_ >= 0) close(fd_);
+}
+
+bool FileBackedFloatDenseReorderingHelper::LookupCache(DatapointIndex i,
+                                                       float* row) const {
+  if (cache_size_rows_ == 0) return false;
+  const size_t slot = i % cache_size_rows_;
+  absl::MutexLock lock(&cache_mutexes_[slot % kNumCacheShards]);
+  if (cache_tags_[slot] != i) return false;
+  std::copy_n(cache_rows_.data() + slot * dimensionality_, dimensionality_,
+              row);
+  return true;
+}
+
+uint64_t FileBackedFloatDenseReorderingHelper::CacheVersion(
+    DatapointIndex i) const {
+  if (cache_size_rows_ == 0) return 0;
+  const size_t slot = i % cache_size_rows_;
+  absl::MutexLock lock(&cache_mutexes_[slot % kNumCacheShards]);
+  return cache_versions_[slot];
+}
+
+void FileBackedFloatDenseReorderingHelper::InsertCache(
+    DatapointIndex i, const float* row, uint64_t version) const {
+  if (cache_size_rows_ == 0) return;
+  const size_t slot = i % cache_size_rows_;
+  absl::MutexLock lock(&cache_mutexes_[slot % kNumCacheShards]);
+  if (cache_versions_[slot] != version) return;
+  cache_tags_[slot] = i;
+  std::copy_n(row, dimensionality_, cache_rows_.data() + slot * dimensionality_);
+}
+
+void FileBackedFloatDenseReorderingHelper::InvalidateCache(
+    DatapointIndex i) const {
+  if (cache_size_rows_ == 0) return;
+  const size_t slot = i % cache_size_rows_;
+  absl::MutexLock lock(&cache_mutexes_[slot % kNumCacheShards]);
+  ++cache_versions_[slot];
+  if (cache_tags_[slot] == i) cache_tags_[slot] = kInvalidDatapointIndex;
+}
+
+Status FileBackedFloatDenseReorderingHelper::ReadRows(
+    MutableSpan<std::pair<DatapointIndex, float*>> sorted_requests) const {
+  std::vector<std::pair<size_t, size_t>> reads;
+  for (size_t begin = 0; begin < sorted_requests.size();) {
+    size_t end = begin + 1;
+    while (end < sorted_requests.size() && end - begin < kMaxRowsPerRead &&
+           sorted_requests[end].first == sorted_requests[end - 1].first + 1) {
+      ++end;
+    }
+    reads.emplace_back(begin, end);
+    begin = end;
+  }
+  std::vector<uint64_t> versions(sorted_requests.size());
+  for (size_t j : IndicesOf(sorted_requests)) {
+    versions[j] = CacheVersion(sorted_requests[j].first);
+  }
+
+  auto do_read = [&](size_t read_idx) -> Status {
+    const size_t begin = reads[read_idx].first;
+    const size_t num_rows = reads[read_idx].second - begin;
+    const DatapointIndex first_row = sorted_requests[begin].first;
+    if (num_rows == 1) {
+      SCANN_RETURN_IF_ERROR(PreadFully(
+          fd_, filename_, reinterpret_cast<char*>(sorted_requests[begin].second),
+          row_bytes(), first_row * row_bytes()));
+    } else {
+      std::vector<float> buffer(num_rows * dimensionality_);
+      SCANN_RETURN_IF_ERROR(PreadFully(
+          fd_, filename_, reinterpret_cast<char*>(buffer.data()),
+          num_rows * row_bytes(), first_row * row_bytes()));
+      for (size_t j = 0; j < num_rows; ++j) {
+        std::copy_n(buffer.data() + j * dimensionality_, dimensionality_,
+                    sorted_requests[begin + j].second);
+      }
+    }
+    for (size_t j = begin; j < reads[read_idx].second; ++j) {
+      InsertCache(sorted_requests[j].first, sorted_requests[j].second,
+                  versions[j]);
+    }
+    return OkStatus();
+  };
+
+  if (pool_ && reads.size() >= kMinReadsForParallelism) {
+    return ParallelForWithStatus<1>(Seq(reads.size()), pool_.get(), do_read);
+  }
+  for (size_t read_idx : IndicesOf(reads)) {
+    SCANN_RETURN_IF_ERROR(do_read(read_idx));
+  }
+  return OkStatus();
+}
+
+Status FileBackedFloatDenseReorderingHelper::ComputeDistancesForReordering(
+    const DatapointPtr<float>& query, NNResultsVector* result) const {
+  if (!query.IsDense() || query.dimensionality() != dimensionality_) {
+    return InvalidArgumentError(absl::StrFormat(
+        "File-backed reordering requires dense queries of dimensionality %d.",
+        dimensionality_));
+  }
+  std::vector<float> rows(result->size() * dimensionality_);
+  std::vector<std::pair<DatapointIndex, float*>> misses;
+  const DatapointIndex size = this->size();
+  for (size_t i : IndicesOf(*result)) {
+    const DatapointIndex dp_idx = (*result)[i].first;
+    if (dp_idx >= size) {
+      return OutOfRangeError(absl::StrFormat(
+          "The datapoint index %d is >= the dataset size %d", dp_idx, size));
+    }
+    float* row = rows.data() + i * dimensionality_;
+    if (!LookupCache(dp_idx, row)) misses.emplace_back(dp_idx, row);
+  }
+  std::sort(misses.begin(), misses.end());
+  SCANN_RETURN_IF_ERROR(ReadRows(MakeMutableSpan(misses)));
+
+  DefaultDenseDatasetView<float> candidates(MakeConstSpan(rows),
+                                            dimensionality_);
+  std::vector<float> distances(result->size());
+  DenseDistanceOneToMany<float, float>(*exact_reordering_distance_, query,
+                                       &candidates, MakeMutableSpan(distances));
+  for (size_t i : IndicesOf(*result)) {
+    (*result)[i].second = distances[i];
+  }
+  return OkStatus();
+}
+
+StatusOr<typename ReorderingInterface<float>::Mutator*>
+FileBackedFloatDenseReorderingHelper::GetMutator() const {
+  if (!mutator_) {
+    mutator_ = make_unique<Mutator>(
+        const_cast<FileBackedFloatDenseReorderingHelper*>(this));
+  }
+  return static_cast<typename ReorderingInterface<float>::Mutator*>(
+      mutator_.get());
+}
+
+Status FileBackedFloatDenseReorderingHelper::Reconstruct(
+    DatapointIndex i, MutableSpan<float> output) const {
+  const DatapointIndex size = this->size();
+  if (i >= size)
+    return InvalidArgumentError(absl::StrFormat(
+        "The datapoint index %d is >= the dataset size %d", i, size));
+  if (output.size() != dimensionality_)
+    return InvalidArgumentError(absl::StrFormat(
+        "The output span size %d != the dataset dimensionality %d",
+        output.size(), dimensionality_));
+  if (LookupCache(i, output.data())) return OkStatus();
+  return PreadFully(fd_, filename_, reinterpret_cast<char*>(output.data()),
+                    row_bytes(), i * row_bytes());
+}
+
+Status FileBackedFloatDenseReorderingHelper::Sync() const {
+  if (fdatasync(fd_) != 0) return IoError("fdatasync", filename_);
+  return OkStatus();
+}
+
+}  // namespace scann_ops
+}  // namespace tensorflow
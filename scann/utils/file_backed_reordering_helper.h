@@ -0,0 +1,120 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCANN__UTILS_FILE_BACKED_REORDERING_HELPER_H_
+#define SCANN__UTILS_FILE_BACKED_REORDERING_HELPER_H_
+
+#include <atomic>
+#include <string>
+
+#include "absl/synchronization/mutex.h"
+#include "scann/data_format/datapoint.h"
+#include "scann/data_format/dataset.h"
+#include "scann/distance_measures/distance_measures.h"
+#include "scann/oss_wrappers/scann_status.h"
+#include "scann/utils/reordering_helper.h"
+#include "scann/utils/types.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+
+namespace tensorflow {
+namespace scann_ops {
+
+class FileBackedFloatDenseReorderingHelper : public ReorderingHelper<float> {
+ public:
+  static StatusOr<unique_ptr<FileBackedFloatDenseReorderingHelper>> Create(
+      shared_ptr<const DistanceMeasure> exact_reordering_distance,
+      const std::string& filename, DimensionIndex dimensionality,
+      DatapointIndex cache_size_rows,
+      shared_ptr<thread::ThreadPool> pool = nullptr);
+
+  static Status WriteDataset(const DenseDataset<float>& dataset,
+                             const std::string& filename);
+
+  ~FileBackedFloatDenseReorderingHelper() override;
+
+  std::string name() const override { return "FileBackedReordering"; }
+
+  bool needs_dataset() const override { return false; }
+
+  Status ComputeDistancesForReordering(const DatapointPtr<float>& query,
+                                       NNResultsVector* result) const override;
+
+  StatusOr<typename ReorderingInterface<float>::Mutator*> GetMutator()
+      const override;
+
+  bool owns_mutation_data_structures() const override { return true; }
+
+  DimensionIndex dimensionality() const { return dimensionality_; }
+
+  DatapointIndex size() const { return size_.load(std::memory_order_acquire); }
+
+  Status Reconstruct(DatapointIndex i, MutableSpan<float> output) const;
+
+  // Flushes writes made by the mutator to the backing file.
+  Status Sync() const;
+
+ private:
+  class Mutator;
+
+  FileBackedFloatDenseReorderingHelper(
+      shared_ptr<const DistanceMeasure> exact_reordering_distance,
+      std::string filename, int fd, DimensionIndex dimensionality,
+      DatapointIndex size,
+      DatapointIndex cache_size_rows, shared_ptr<thread::ThreadPool> pool);
+
+  Status ReadRows(
+      MutableSpan<std::pair<DatapointIndex, float*>> sorted_requests) const;
+
+  bool LookupCache(DatapointIndex i, float* row) const;
+
+  // Version of the cache slot of row i, taken before the row is read so that
+  // InsertCache can drop a read that raced with a write of the same slot.
+  uint64_t CacheVersion(DatapointIndex i) const;
+
+  void InsertCache(DatapointIndex i, const float* row, uint64_t version) const;
+
+  void InvalidateCache(DatapointIndex i) const;
+
+  size_t row_bytes() const { return dimensionality_ * sizeof(float); }
+
+  shared_ptr<const DistanceMeasure> exact_reordering_distance_;
+
+  std::string filename_;
+
+  int fd_ = -1;
+
+  DimensionIndex dimensionality_ = 0;
+
+  // Written by the mutator while searches read it.
+  std::atomic<DatapointIndex> size_{0};
+
+  DatapointIndex cache_size_rows_ = 0;
+
+  shared_ptr<thread::ThreadPool> pool_;
+
+  mutable unique_ptr<absl::Mutex[]> cache_mutexes_;
+
+  mutable std::vector<DatapointIndex> cache_tags_;
+
+  mutable std::vector<uint64_t> cache_versions_;
+
+  mutable std::vector<float> cache_rows_;
+
+  mutable unique_ptr<Mutator> mutator_;
+};
+
+}  // namespace scann_ops
+}  // namespace tensorflow
+
+#endif
@@ -0,0 +1,253 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "scann/utils/half_precision.h"
+
+#include "scann/utils/intrinsics/attributes.h"
+#include "scann/utils/intrinsics/flags.h"
+
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
+
+namespace tensorflow {
+namespace scann_ops {
+
+uint16_t FloatToFloat16(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+  const uint32_t abs_bits = bits & 0x7fffffff;
+
+  if (abs_bits >= 0x7f800000) {
+    return sign | 0x7c00 | (abs_bits > 0x7f800000 ? 0x0200 : 0);
+  }
+
+  if (abs_bits >= 0x477ff000) return sign | 0x7c00;
+
+  if (abs_bits < 0x38800000) {
+    if (abs_bits < 0x33000000) return sign;
+    const uint32_t exponent = abs_bits >> 23;
+    const uint32_t mantissa = (abs_bits & 0x7fffff) | 0x800000;
+    const uint32_t shift = 126 - exponent;
+    uint32_t result = mantissa >> shift;
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (result & 1))) {
+      ++result;
+    }
+    return sign | static_cast<uint16_t>(result);
+  }
+
+  uint32_t result = (abs_bits >> 13) - (112 << 10);
+  const uint32_t remainder = abs_bits & 0x1fff;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (result & 1))) ++result;
+  return sign | static_cast<uint16_t>(result);
+}
+
+float Float16ToFloat(uint16_t value) {
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  const uint32_t exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x3ff;
+  uint32_t bits;
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else if (exponent != 0) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  } else if (mantissa == 0) {
+    bits = sign;
+  } else {
+    uint32_t normalized_exponent = 113;
+    while (!(mantissa & 0x400)) {
+      mantissa <<= 1;
+      --normalized_exponent;
+    }
+    bits = sign | (normalized_exponent << 23) | ((mantissa & 0x3ff) << 13);
+  }
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+void FloatToHalf(HalfPrecisionFormat format, ConstSpan<float> input,
+                 MutableSpan<uint16_t> output) {
+  DCHECK_EQ(input.size(), output.size());
+  for (size_t i : IndicesOf(input)) {
+    output[i] = FloatToHalf(format, input[i]);
+  }
+}
+
+void HalfToFloat(HalfPrecisionFormat format, ConstSpan<uint16_t> input,
+                 MutableSpan<float> output) {
+  DCHECK_EQ(input.size(), output.size());
+  for (size_t i : IndicesOf(input)) {
+    output[i] = HalfToFloat(format, input[i]);
+  }
+}
+
+namespace {
+
+template <HalfPrecisionFormat kFormat, bool kSquaredL2>
+float AccumulateFloatHalfScalar(const float* query, const uint16_t* datapoint,
+                                size_t dims) {
+  float result = 0.0f;
+  for (size_t j = 0; j < dims; ++j) {
+    const float x = HalfToFloat(kFormat, datapoint[j]);
+    if (kSquaredL2) {
+      const float diff = query[j] - x;
+      result += diff * diff;
+    } else {
+      result += query[j] * x;
+    }
+  }
+  return result;
+}
+
+#ifdef __x86_64__
+
+template <HalfPrecisionFormat kFormat>
+SCANN_F16C_ATTRIBUTE SCANN_INLINE __m256 LoadHalfAvx2(const uint16_t* ptr) {
+  const __m128i raw = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+  if (kFormat == kBfloat16) {
+    return _mm256_castsi256_ps(
+        _mm256_slli_epi32(_mm256_cvtepu16_epi32(raw), 16));
+  }
+  return _mm256_cvtph_ps(raw);
+}
+
+template <bool kSquaredL2>
+SCANN_F16C_ATTRIBUTE SCANN_INLINE __m256 AccumulateAvx2(__m256 query,
+                                                        __m256 datapoint,
+                                                        __m256 acc) {
+  if (kSquaredL2) {
+    const __m256 diff = _mm256_sub_ps(query, datapoint);
+    return _mm256_fmadd_ps(diff, diff, acc);
+  }
+  return _mm256_fmadd_ps(query, datapoint, acc);
+}
+
+template <HalfPrecisionFormat kFormat, bool kSquaredL2>
+SCANN_F16C_ATTRIBUTE float AccumulateFloatHalfAvx2(const float* query,
+                                                   const uint16_t* datapoint,
+                                                   size_t dims) {
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  size_t j = 0;
+  for (; j + 16 <= dims; j += 16) {
+    acc0 = AccumulateAvx2<kSquaredL2>(_mm256_loadu_ps(query + j),
+                                      LoadHalfAvx2<kFormat>(datapoint + j),
+                                      acc0);
+    acc1 = AccumulateAvx2<kSquaredL2>(_mm256_loadu_ps(query + j + 8),
+                                      LoadHalfAvx2<kFormat>(datapoint + j + 8),
+                                      acc1);
+  }
+  if (j + 8 <= dims) {
+    acc0 = AccumulateAvx2<kSquaredL2>(_mm256_loadu_ps(query + j),
+                                      LoadHalfAvx2<kFormat>(datapoint + j),
+                                      acc0);
+    j += 8;
+  }
+  const __m256 acc = _mm256_add_ps(acc0, acc1);
+  __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc),
+                          _mm256_extractf128_ps(acc, 1));
+  sum = _mm_hadd_ps(sum, sum);
+  sum = _mm_hadd_ps(sum, sum);
+  return _mm_cvtss_f32(sum) + AccumulateFloatHalfScalar<kFormat, kSquaredL2>(
+                                  query + j, datapoint + j, dims - j);
+}
+
+template <HalfPrecisionFormat kFormat>
+SCANN_AVX512_INLINE __m512 LoadHalfAvx512(const uint16_t* ptr) {
+  const __m256i raw =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+  if (kFormat == kBfloat16) {
+    return _mm512_castsi512_ps(
+        _mm512_slli_epi32(_mm512_cvtepu16_epi32(raw), 16));
+  }
+  return _mm512_cvtph_ps(raw);
+}
+
+template <bool kSquaredL2>
+SCANN_AVX512_INLINE __m512 AccumulateAvx512(__m512 query, __m512 datapoint,
+                                            __m512 acc) {
+  if (kSquaredL2) {
+    const __m512 diff = _mm512_sub_ps(query, datapoint);
+    return _mm512_fmadd_ps(diff, diff, acc);
+  }
+  return _mm512_fmadd_ps(query, datapoint, acc);
+}
+
+template <HalfPrecisionFormat kFormat, bool kSquaredL2>
+SCANN_AVX512_OUTLINE float AccumulateFloatHalfAvx512(const float* query,
+                                                     const uint16_t* datapoint,
+                                                     size_t dims) {
+  __m512 acc0 = _mm512_setzero_ps();
+  __m512 acc1 = _mm512_setzero_ps();
+  size_t j = 0;
+  for (; j + 32 <= dims; j += 32) {
+    acc0 = AccumulateAvx512<kSquaredL2>(_mm512_loadu_ps(query + j),
+                                        LoadHalfAvx512<kFormat>(datapoint + j),
+                                        acc0);
+    acc1 = AccumulateAvx512<kSquaredL2>(
+        _mm512_loadu_ps(query + j + 16),
+        LoadHalfAvx512<kFormat>(datapoint + j + 16), acc1);
+  }
+  if (j + 16 <= dims) {
+    acc0 = AccumulateAvx512<kSquaredL2>(_mm512_loadu_ps(query + j),
+                                        LoadHalfAvx512<kFormat>(datapoint + j),
+                                        acc0);
+    j += 16;
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1)) +
+         AccumulateFloatHalfScalar<kFormat, kSquaredL2>(
+             query + j, datapoint + j, dims - j);
+}
+
+#endif
+
+template <HalfPrecisionFormat kFormat, bool kSquaredL2>
+float AccumulateFloatHalf(const float* query, const uint16_t* datapoint,
+                          size_t dims) {
+#ifdef __x86_64__
+  if (RuntimeSupportsAvx512()) {
+    return AccumulateFloatHalfAvx512<kFormat, kSquaredL2>(query, datapoint,
+                                                          dims);
+  }
+  if (RuntimeSupportsAvx2() && RuntimeSupportsF16c()) {
+    return AccumulateFloatHalfAvx2<kFormat, kSquaredL2>(query, datapoint,
+                                                        dims);
+  }
+#endif
+  return AccumulateFloatHalfScalar<kFormat, kSquaredL2>(query, datapoint, dims);
+}
+
+}  // namespace
+
+float DenseDotProductFloatHalf(HalfPrecisionFormat format, const float* query,
+                               const uint16_t* datapoint, size_t dims) {
+  return format == kBfloat16
+             ? AccumulateFloatHalf<kBfloat16, false>(query, datapoint, dims)
+             : AccumulateFloatHalf<kFloat16, false>(query, datapoint, dims);
+}
+
+float DenseSquaredL2DistanceFloatHalf(HalfPrecisionFormat format,
+                                      const float* query,
+                                      const uint16_t* datapoint, size_t dims) {
+  return format == kBfloat16
+             ? AccumulateFloatHalf<kBfloat16, true>(query, datapoint, dims)
+             : AccumulateFloatHalf<kFloat16, true>(query, datapoint, dims);
+}
+
+}  // namespace scann_ops
+}  // namespace tensorflow
@@ -0,0 +1,77 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SCANN__UTILS_HALF_PRECISION_H_
+#define SCANN__UTILS_HALF_PRECISION_H_
+
+#include <cstdint>
+#include <cstring>
+
+#include "scann/utils/types.h"
+
+namespace tensorflow {
+namespace scann_ops {
+
+enum HalfPrecisionFormat {
+  kBfloat16 = 1,
+
+  kFloat16 = 2,
+};
+
+inline uint16_t FloatToBfloat16(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  if ((bits & 0x7fffffff) > 0x7f800000) {
+    return static_cast<uint16_t>((bits >> 16) | 0x0040);
+  }
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return static_cast<uint16_t>(bits >> 16);
+}
+
+inline float Bfloat16ToFloat(uint16_t value) {
+  const uint32_t bits = static_cast<uint32_t>(value) << 16;
+  float result;
+  std::memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+uint16_t FloatToFloat16(float value);
+
+float Float16ToFloat(uint16_t value);
+
+inline uint16_t FloatToHalf(HalfPrecisionFormat format, float value) {
+  return format == kBfloat16 ? FloatToBfloat16(value) : FloatToFloat16(value);
+}
+
+inline float HalfToFloat(HalfPrecisionFormat format, uint16_t value) {
+  return format == kBfloat16 ? Bfloat16ToFloat(value) : Float16ToFloat(value);
+}
+
+void FloatToHalf(HalfPrecisionFormat format, ConstSpan<float> input,
+                 MutableSpan<uint16_t> output);
+
+void HalfToFloat(HalfPrecisionFormat format, ConstSpan<uint16_t> input,
+                 MutableSpan<float> output);
+
+float DenseDotProductFloatHalf(HalfPrecisionFormat format, const float* query,
+                               const uint16_t* datapoint, size_t dims);
+
+float DenseSquaredL2DistanceFloatHalf(HalfPrecisionFormat format,
+                                      const float* query,
+                                      const uint16_t* datapoint, size_t dims);
+
+}  // namespace scann_ops
+}  // namespace tensorflow
+
+#endif
@@ -102,11 +102,15 @@ HashLeafHelpers<T>::TrainAsymmetricHashingModel(
   TF_ASSIGN_OR_RETURN(
       shared_ptr<const asymmetric_hashing2::Model<T>> model,
       asymmetric_hashing2::TrainSingleMachine<T>(*dataset, opts, pool));
+  shared_ptr<const ChunkingProjection<T>> projector = opts.projector();
+  if (model->projection_rotation()) {
+    TF_ASSIGN_OR_RETURN(projector, model->BuildProjection(config.projection()));
+  }
   internal::TrainedAsymmetricHashingResults<T> result;
   result.indexer = std::make_shared<asymmetric_hashing2::Indexer<T>>(
-      opts.projector(), quantization_distance, model);
+      projector, quantization_distance, model);
   result.queryer = std::make_shared<asymmetric_hashing2::AsymmetricQueryer<T>>(
-      opts.projector(), params.pre_reordering_dist, model);
+      projector, params.pre_reordering_dist, model);
   result.lookup_type = config.lookup_type();
   result.fixed_point_lut_conversion_options =
       config.fixed_point_lut_conversion_options();
@@ -176,7 +180,7 @@ HashLeafHelpers<T>::LoadAsymmetricHashingModel(
   }
 
   TF_ASSIGN_OR_RETURN(shared_ptr<const ChunkingProjection<T>> projector,
-                      ChunkingProjectionFactory<T>(config.projection()));
+                      model->BuildProjection(config.projection()));
   internal::TrainedAsymmetricHashingResults<T> result;
   result.indexer = std::make_shared<asymmetric_hashing2::Indexer<T>>(
       projector, quantization_distance, model);
@@ -19,14 +19,20 @@
 
 #define SCANN_AVX512_ATTRIBUTE \
   __attribute((target("avx,avx2,fma,avx512f,avx512dq,avx512bw")))
+#define SCANN_AVX512_VNNI_ATTRIBUTE \
+  __attribute((                     \
+      target("avx,avx2,fma,avx512f,avx512dq,avx512bw,avx512vl,avx512vnni")))
 #define SCANN_AVX2_ATTRIBUTE __attribute((target("avx,avx2,fma")))
+#define SCANN_F16C_ATTRIBUTE __attribute((target("avx,avx2,fma,f16c")))
 #define SCANN_AVX1_ATTRIBUTE __attribute((target("avx")))
 #define SCANN_SSE4_ATTRIBUTE
 
 #else
 
 #define SCANN_AVX512_ATTRIBUTE
+#define SCANN_AVX512_VNNI_ATTRIBUTE
 #define SCANN_AVX2_ATTRIBUTE
+#define SCANN_F16C_ATTRIBUTE
 #define SCANN_AVX1_ATTRIBUTE
 #define SCANN_SSE4_ATTRIBUTE
 
@@ -36,6 +42,11 @@
 #define SCANN_AVX512_INLINE_LAMBDA SCANN_AVX512_ATTRIBUTE SCANN_INLINE_LAMBDA
 #define SCANN_AVX512_OUTLINE SCANN_AVX512_ATTRIBUTE SCANN_OUTLINE
 
+#define SCANN_AVX512_VNNI_INLINE SCANN_AVX512_VNNI_ATTRIBUTE SCANN_INLINE
+#define SCANN_AVX512_VNNI_INLINE_LAMBDA \
+  SCANN_AVX512_VNNI_ATTRIBUTE SCANN_INLINE_LAMBDA
+#define SCANN_AVX512_VNNI_OUTLINE SCANN_AVX512_VNNI_ATTRIBUTE SCANN_OUTLINE
+
 #define SCANN_AVX2_INLINE SCANN_AVX2_ATTRIBUTE SCANN_INLINE
 #define SCANN_AVX2_INLINE_LAMBDA SCANN_AVX2_ATTRIBUTE SCANN_INLINE_LAMBDA
 #define SCANN_AVX2_OUTLINE SCANN_AVX2_ATTRIBUTE SCANN_OUTLINE
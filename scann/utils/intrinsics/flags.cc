@@ -44,6 +44,9 @@ bool should_use_avx2 = port::TestCPUFeature(port::AVX2);
 bool should_use_avx512 = port::TestCPUFeature(port::AVX512F) &&
                          port::TestCPUFeature(port::AVX512DQ) &&
                          port::TestCPUFeature(port::AVX512BW);
+bool should_use_f16c = port::TestCPUFeature(port::F16C);
+bool should_use_avx512_vnni = port::TestCPUFeature(port::AVX512VL) &&
+                              port::TestCPUFeature(port::AVX512_VNNI);
 
 }  // namespace flags_internal
 
@@ -52,10 +55,12 @@ ScopedPlatformOverride::ScopedPlatformOverride(PlatformGeneration generation) {
   original_avx2_ = flags_internal::should_use_avx2;
   original_avx512_ = flags_internal::should_use_avx512;
   original_sse4_ = flags_internal::should_use_sse4;
+  original_f16c_ = flags_internal::should_use_f16c;
   flags_internal::should_use_sse4 = false;
   flags_internal::should_use_avx1 = false;
   flags_internal::should_use_avx2 = false;
   flags_internal::should_use_avx512 = false;
+  flags_internal::should_use_f16c = false;
   switch (generation) {
     case kSkylakeAvx512:
       flags_internal::should_use_avx512 = true;
@@ -63,6 +68,7 @@ ScopedPlatformOverride::ScopedPlatformOverride(PlatformGeneration generation) {
 
     case kHaswellAvx2:
       flags_internal::should_use_avx2 = true;
+      flags_internal::should_use_f16c = true;
       ABSL_FALLTHROUGH_INTENDED;
 
     case kSandyBridgeAvx1:
@@ -86,6 +92,7 @@ ScopedPlatformOverride::~ScopedPlatformOverride() {
   flags_internal::should_use_avx2 = original_avx2_;
   flags_internal::should_use_avx512 = original_avx512_;
   flags_internal::should_use_sse4 = original_sse4_;
+  flags_internal::should_use_f16c = original_f16c_;
 }
 
 bool ScopedPlatformOverride::IsSupported() {
@@ -99,6 +106,10 @@ bool ScopedPlatformOverride::IsSupported() {
     LOG(WARNING) << "The CPU lacks AVX2 support! (skipping some tests)";
     return false;
   }
+  if (flags_internal::should_use_f16c && !port::TestCPUFeature(port::F16C)) {
+    LOG(WARNING) << "The CPU lacks F16C support! (skipping some tests)";
+    return false;
+  }
   if (flags_internal::should_use_avx1 && !port::TestCPUFeature(port::AVX)) {
     LOG(WARNING) << "The CPU lacks AVX1 support! (skipping some tests)";
     return false;
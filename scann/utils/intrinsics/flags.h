@@ -32,6 +32,8 @@ extern bool should_use_avx1;
 extern bool should_use_avx2;
 extern bool should_use_avx512;
 extern bool should_use_sse4;
+extern bool should_use_f16c;
+extern bool should_use_avx512_vnni;
 
 }  // namespace flags_internal
 
@@ -41,6 +43,11 @@ inline bool RuntimeSupportsAvx2() { return flags_internal::should_use_avx2; }
 inline bool RuntimeSupportsAvx512() {
   return flags_internal::should_use_avx512;
 }
+inline bool RuntimeSupportsF16c() { return flags_internal::should_use_f16c; }
+inline bool RuntimeSupportsAvx512Vnni() {
+  return flags_internal::should_use_avx512 &&
+         flags_internal::should_use_avx512_vnni;
+}
 
 enum PlatformGeneration {
   kFallbackForNonX86 = 99,
@@ -86,6 +93,7 @@ class ScopedPlatformOverride {
   bool original_avx2_;
   bool original_avx512_;
   bool original_sse4_;
+  bool original_f16c_;
 };
 
 ScopedPlatformOverride TestHookOverridePlatform(PlatformGeneration generation);
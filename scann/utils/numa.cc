@@ -0,0 +1,183 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#include "scann/utils/numa.h"
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include <fstream>
+#include <thread>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/synchronization/barrier.h"
+#include "absl/synchronization/blocking_counter.h"
+#include "absl/synchronization/mutex.h"
+#include "scann/utils/threads.h"
+
+namespace tensorflow {
+namespace scann_ops {
+namespace {
+
+thread_local int current_thread_numa_node = -1;
+
+// Parses a sysfs range list such as "0-3,8,10-11", as used for both CPU and
+// node lists.
+bool ParseCpuList(const std::string& cpu_list, std::vector<int>* cpus) {
+  for (absl::string_view range :
+       absl::StrSplit(cpu_list, ',', absl::SkipWhitespace())) {
+    range = absl::StripAsciiWhitespace(range);
+    if (range.empty()) continue;
+    std::vector<absl::string_view> bounds = absl::StrSplit(range, '-');
+    int first, last;
+    if (!absl::SimpleAtoi(bounds[0], &first)) return false;
+    last = first;
+    if (bounds.size() == 2 && !absl::SimpleAtoi(bounds[1], &last)) {
+      return false;
+    }
+    for (int cpu = first; cpu <= last; ++cpu) cpus->push_back(cpu);
+  }
+  return true;
+}
+
+bool ReadFirstLine(const std::string& path, std::string* line) {
+  std::ifstream in(path);
+  if (!in) return false;
+  std::getline(in, *line);
+  return true;
+}
+
+NumaTopology ReadNumaTopology() {
+  NumaTopology result;
+#ifdef __linux__
+  // Node ids may have gaps, so they are taken from the online list rather
+  // than probed in order.  Memory-only nodes (CXL, PMEM) have an empty
+  // cpulist; no thread can be bound to them, so they are skipped.
+  std::string online_list;
+  std::vector<int> online_nodes;
+  if (ReadFirstLine("/sys/devices/system/node/online", &online_list) &&
+      ParseCpuList(online_list, &online_nodes)) {
+    for (int node : online_nodes) {
+      std::string cpu_list;
+      std::vector<int> cpus;
+      if (!ReadFirstLine(
+              absl::StrCat("/sys/devices/system/node/node", node, "/cpulist"),
+              &cpu_list) ||
+          !ParseCpuList(cpu_list, &cpus) || cpus.empty()) {
+        continue;
+      }
+      result.cpus_by_node.push_back(std::move(cpus));
+    }
+  }
+#endif
+  if (result.cpus_by_node.empty()) {
+    std::vector<int> all_cpus(
+        std::max(1u, std::thread::hardware_concurrency()));
+    for (size_t cpu : IndicesOf(all_cpus)) all_cpus[cpu] = cpu;
+    result.cpus_by_node.push_back(std::move(all_cpus));
+  }
+  return result;
+}
+
+}  // namespace
+
+const NumaTopology& GetNumaTopology() {
+  static const NumaTopology* topology = new NumaTopology(ReadNumaTopology());
+  return *topology;
+}
+
+Status BindCurrentThreadToNumaNode(int node) {
+  const NumaTopology& topology = GetNumaTopology();
+  if (node < 0 || node >= topology.num_nodes()) {
+    return InvalidArgumentError("NUMA node %d out of range [0, %d).", node,
+                                topology.num_nodes());
+  }
+#ifdef __linux__
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  for (int cpu : topology.cpus_by_node[node]) CPU_SET(cpu, &cpu_set);
+  const int error =
+      pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+  if (error != 0) {
+    return InternalError("pthread_setaffinity_np failed for NUMA node %d: %d",
+                         node, error);
+  }
+#endif
+  current_thread_numa_node = node;
+  return OkStatus();
+}
+
+int CurrentThreadNumaNode() { return current_thread_numa_node; }
+
+StatusOr<unique_ptr<NumaThreadPools>> NumaThreadPools::Start(
+    const std::string& pool_name, ssize_t threads_per_node) {
+  if (threads_per_node <= 0) {
+    return InvalidArgumentError("threads_per_node must be positive, got %d.",
+                                threads_per_node);
+  }
+  const size_t num_nodes = GetNumaTopology().num_nodes();
+  unique_ptr<NumaThreadPools> result(new NumaThreadPools);
+  Status status = OkStatus();
+  absl::Mutex status_mutex;
+  for (int node : Seq(num_nodes)) {
+    result->pools_.push_back(StartThreadPool(
+        absl::StrCat(pool_name, "_node", node), threads_per_node));
+
+    // Every bind task blocks on the barrier until all of them have started,
+    // so each pool thread runs exactly one of them.
+    absl::BlockingCounter done(threads_per_node);
+    absl::Barrier* barrier = new absl::Barrier(threads_per_node);
+    for (ssize_t i = 0; i < threads_per_node; ++i) {
+      result->pools_.back()->Schedule([&, barrier, node] {
+        Status bind_status = BindCurrentThreadToNumaNode(node);
+        if (!bind_status.ok()) {
+          absl::MutexLock lock(&status_mutex);
+          if (status.ok()) status = bind_status;
+        }
+        if (barrier->Block()) delete barrier;
+        done.DecrementCount();
+      });
+    }
+    done.Wait();
+  }
+  SCANN_RETURN_IF_ERROR(status);
+  return result;
+}
+
+Status NumaThreadPools::RunOnEachNode(
+    std::function<Status(int node)> func) const {
+  vector<Status> statuses(num_nodes());
+  absl::BlockingCounter done(num_nodes());
+  for (int node : Seq(num_nodes())) {
+    pools_[node]->Schedule([&, node] {
+      statuses[node] = func(node);
+      done.DecrementCount();
+    });
+  }
+  done.Wait();
+  for (const Status& status : statuses) {
+    SCANN_RETURN_IF_ERROR(status);
+  }
+  return OkStatus();
+}
+
+}  // namespace scann_ops
+}  // namespace tensorflow
@@ -0,0 +1,71 @@
+// Copyright 2020 The Google Research Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+
+#ifndef SCANN__UTILS_NUMA_H_
+#define SCANN__UTILS_NUMA_H_
+
+#include <functional>
+
+#include "scann/utils/types.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+
+namespace tensorflow {
+namespace scann_ops {
+
+// CPUs of every online NUMA node that has any, read from sysfs.  Nodes are
+// numbered densely in this order, so they need not match the kernel's node
+// ids.  Hosts without NUMA information (including non-Linux ones) report a
+// single node holding every CPU.
+struct NumaTopology {
+  size_t num_nodes() const { return cpus_by_node.size(); }
+
+  vector<std::vector<int>> cpus_by_node;
+};
+
+const NumaTopology& GetNumaTopology();
+
+// Restricts the calling thread to the CPUs of the given node.  Memory the
+// thread touches first afterwards is then allocated on that node under the
+// default local allocation policy.
+Status BindCurrentThreadToNumaNode(int node);
+
+// Node the calling thread was bound to by BindCurrentThreadToNumaNode, or -1.
+int CurrentThreadNumaNode();
+
+// One thread pool per NUMA node, with every thread bound to its node.
+class NumaThreadPools {
+ public:
+  static StatusOr<unique_ptr<NumaThreadPools>> Start(
+      const std::string& pool_name, ssize_t threads_per_node);
+
+  size_t num_nodes() const { return pools_.size(); }
+
+  thread::ThreadPool* pool(int node) const { return pools_[node].get(); }
+
+  // Runs func(node) on a worker of every node concurrently and returns the
+  // first error.
+  Status RunOnEachNode(std::function<Status(int node)> func) const;
+
+ private:
+  NumaThreadPools() {}
+
+  vector<unique_ptr<thread::ThreadPool>> pools_;
+};
+
+}  // namespace scann_ops
+}  // namespace tensorflow
+
+#endif
@@ -19,7 +19,9 @@
 #include <atomic>
 #include <cstdlib>
 #include <limits>
+#include <memory>
 
+#include "absl/base/optimization.h"
 #include "absl/synchronization/mutex.h"
 #include "scann/utils/types.h"
 #include "tensorflow/core/lib/core/threadpool.h"
@@ -33,6 +35,11 @@ enum : size_t {
 
 struct ParallelForOptions {
   size_t max_parallelism = numeric_limits<size_t>::max();
+
+  // Optional relative cost of every item of the sequence, in sequence order.
+  // When set, items are split among workers by cost instead of by count and
+  // thieves take half of the victim's remaining cost.
+  ConstSpan<size_t> cost_hints;
 };
 
 template <size_t kItersPerBatch = kDynamicBatchSize, typename SeqT,
@@ -68,34 +75,55 @@ ParallelForWithStatus(SeqT seq, thread::ThreadPool* pool, Function Func,
 
 namespace parallel_for_internal {
 
+// Work-stealing executor behind ParallelFor.  The sequence is split up front
+// into one contiguous range per worker.  Each worker pops batches off the
+// front of its own range and, once that is empty, steals the back half of
+// another worker's range, so skewed items and late-starting pool threads only
+// cost a steal instead of a straggler.  Ranges of workers that never get to
+// run are simply stolen.  The calling thread is worker 0 and only waits for
+// workers that actually started, so ParallelFor may be nested inside a
+// ParallelFor on the same pool.
 template <size_t kItersPerBatch, typename SeqT, typename Function>
-class ParallelForClosure : public std::function<void()> {
+class ParallelForClosure {
  public:
   static constexpr bool kIsDynamicBatch = (kItersPerBatch == kDynamicBatchSize);
-  ParallelForClosure(SeqT seq, Function func)
-      : func_(func),
-        index_(*seq.begin()),
-        range_end_(*seq.end()),
-        reference_count_(1) {}
-
-  SCANN_INLINE void RunParallel(thread::ThreadPool* pool,
-                                size_t desired_threads) {
-    DCHECK(pool);
 
-    size_t n_threads =
-        std::min<size_t>(desired_threads - 1, pool->NumThreads());
-
-    if (kIsDynamicBatch) {
-      batch_size_ =
-          SeqT::Stride() * std::max(1ul, desired_threads / 4 / n_threads);
+  ParallelForClosure(SeqT seq, Function func, size_t num_workers,
+                     ConstSpan<size_t> cost_hints)
+      : func_(func),
+        first_(*seq.begin()),
+        num_items_(DivRoundUp(*seq.end() - *seq.begin(), SeqT::Stride())),
+        num_workers_(num_workers),
+        ranges_(new WorkerRange[num_workers]),
+        reference_count_(1) {
+    if (!cost_hints.empty()) {
+      DCHECK_EQ(cost_hints.size(), num_items_);
+      cost_prefix_.resize(num_items_ + 1);
+      cost_prefix_[0] = 0;
+      for (size_t i : Seq(num_items_)) {
+        cost_prefix_[i + 1] =
+            cost_prefix_[i] + std::max<size_t>(cost_hints[i], 1);
+      }
     }
+    size_t range_begin = 0;
+    for (size_t w : Seq(num_workers_)) {
+      const size_t range_end =
+          w + 1 == num_workers_ ? num_items_ : SplitPoint(0, num_items_, w + 1);
+      ranges_[w].begin = range_begin;
+      ranges_[w].end = std::max(range_begin, range_end);
+      range_begin = ranges_[w].end;
+    }
+  }
 
+  SCANN_INLINE void RunParallel(thread::ThreadPool* pool) {
+    DCHECK(pool);
+    size_t n_threads = num_workers_ - 1;
     reference_count_ += n_threads;
     while (n_threads--) {
       pool->Schedule([this]() { Run(); });
     }
 
-    DoWork();
+    DoWork(0);
 
     termination_mutex_.WriterLock();
     termination_mutex_.WriterUnlock();
@@ -105,43 +133,115 @@ class ParallelForClosure : public std::function<void()> {
 
   void Run() {
     termination_mutex_.ReaderLock();
-    DoWork();
+    DoWork(next_worker_.fetch_add(1, std::memory_order_relaxed));
     termination_mutex_.ReaderUnlock();
 
     if (--reference_count_ == 0) delete this;
   }
 
-  SCANN_INLINE void DoWork() {
-    const size_t range_end = range_end_;
+ private:
+  struct alignas(ABSL_CACHELINE_SIZE) WorkerRange {
+    absl::Mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  SCANN_INLINE void DoWork(size_t worker) {
+    DCHECK_LT(worker, num_workers_);
+    size_t batch_begin, batch_end;
+    for (;;) {
+      if (!PopFront(worker, &batch_begin, &batch_end)) {
+        if (!Steal(worker)) return;
+        continue;
+      }
+      for (size_t pos : Seq(batch_begin, batch_end)) {
+        func_(first_ + pos * SeqT::Stride());
+      }
+    }
+  }
 
-    constexpr size_t kStaticBatchSize = SeqT::Stride() * kItersPerBatch;
-    const size_t batch_size = kIsDynamicBatch ? batch_size_ : kStaticBatchSize;
-    DCHECK_NE(batch_size, kDynamicBatchSize);
-    DCHECK_EQ(batch_size % SeqT::Stride(), 0);
+  // Returns the position that splits [begin, end) so that the part before it
+  // holds num / num_workers_ of the work.
+  size_t SplitPoint(size_t begin, size_t end, size_t num) const {
+    if (cost_prefix_.empty()) {
+      return begin + (end - begin) * num / num_workers_;
+    }
+    const size_t target =
+        cost_prefix_[begin] +
+        (cost_prefix_[end] - cost_prefix_[begin]) * num / num_workers_;
+    return std::lower_bound(cost_prefix_.begin() + begin,
+                            cost_prefix_.begin() + end, target) -
+           cost_prefix_.begin();
+  }
 
-    for (;;) {
-      const size_t batch_begin = index_.fetch_add(batch_size);
+  SCANN_INLINE bool PopFront(size_t worker, size_t* batch_begin,
+                             size_t* batch_end) {
+    WorkerRange& range = ranges_[worker];
+    absl::MutexLock lock(&range.mutex);
+    if (range.begin == range.end) return false;
+    const size_t remaining = range.end - range.begin;
+    size_t batch_size = kItersPerBatch;
+    if (kIsDynamicBatch) {
+      batch_size = cost_prefix_.empty() ? std::max<size_t>(1, remaining / 8)
+                                        : 1;
+    }
+    *batch_begin = range.begin;
+    *batch_end = range.begin + std::min(batch_size, remaining);
+    range.begin = *batch_end;
+    return true;
+  }
 
-      const size_t batch_end = std::min(batch_begin + batch_size, range_end);
-      if (ABSL_PREDICT_FALSE(batch_begin >= range_end)) break;
-      for (size_t idx : SeqWithStride<SeqT::Stride()>(batch_begin, batch_end)) {
-        func_(idx);
+  bool Steal(size_t thief) {
+    for (size_t i : Seq(1, num_workers_)) {
+      WorkerRange& victim = ranges_[(thief + i) % num_workers_];
+      size_t stolen_begin, stolen_end;
+      {
+        absl::MutexLock lock(&victim.mutex);
+        const size_t remaining = victim.end - victim.begin;
+        if (remaining == 0) continue;
+        stolen_end = victim.end;
+        if (remaining == 1) {
+          stolen_begin = victim.begin;
+        } else if (cost_prefix_.empty()) {
+          stolen_begin = victim.begin + remaining / 2;
+        } else {
+          const size_t half_cost =
+              (cost_prefix_[victim.begin] + cost_prefix_[victim.end]) / 2;
+          stolen_begin = std::lower_bound(cost_prefix_.begin() + victim.begin,
+                                          cost_prefix_.begin() + victim.end,
+                                          half_cost) -
+                         cost_prefix_.begin();
+          stolen_begin =
+              std::clamp(stolen_begin, victim.begin + 1, victim.end - 1);
+        }
+        victim.end = stolen_begin;
       }
+      WorkerRange& own = ranges_[thief];
+      absl::MutexLock lock(&own.mutex);
+      own.begin = stolen_begin;
+      own.end = stolen_end;
+      return true;
     }
+    return false;
   }
 
- private:
   Function func_;
 
-  std::atomic<size_t> index_;
+  const size_t first_;
+
+  const size_t num_items_;
+
+  const size_t num_workers_;
 
-  const size_t range_end_;
+  std::unique_ptr<WorkerRange[]> ranges_;
+
+  vector<size_t> cost_prefix_;
+
+  std::atomic<size_t> next_worker_{1};
 
   absl::Mutex termination_mutex_;
 
   std::atomic<uint32_t> reference_count_;
-
-  size_t batch_size_ = kItersPerBatch;
 };
 
 }  // namespace parallel_for_internal
@@ -162,10 +262,12 @@ SCANN_INLINE void ParallelFor(SeqT seq, thread::ThreadPool* pool, Function func,
     return;
   }
 
+  const size_t num_workers =
+      std::min<size_t>(desired_threads - 1, pool->NumThreads()) + 1;
   using parallel_for_internal::ParallelForClosure;
-  auto closure =
-      new ParallelForClosure<kItersPerBatch, SeqT, Function>(seq, func);
-  closure->RunParallel(pool, desired_threads);
+  auto closure = new ParallelForClosure<kItersPerBatch, SeqT, Function>(
+      seq, func, num_workers, opts.cost_hints);
+  closure->RunParallel(pool);
 }
 
 }  // namespace scann_ops
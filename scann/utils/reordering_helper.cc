@@ -14,6 +14,7 @@
 
 #include "scann/utils/reordering_helper.h"
 
+#include <algorithm>
 #include <atomic>
 #include <limits>
 #include <memory>
@@ -21,6 +22,7 @@
 #include "absl/strings/str_format.h"
 #include "scann/data_format/datapoint.h"
 #include "scann/data_format/dataset.h"
+#include "scann/distance_measures/many_to_many/many_to_many.h"
 #include "scann/distance_measures/one_to_many/one_to_many.h"
 #include "scann/oss_wrappers/scann_down_cast.h"
 #include "scann/utils/common.h"
@@ -58,6 +60,10 @@ using AvxFuncs = ::tensorflow::scann_ops::AvxFunctionsAvx2Fma;
 #undef SCANN_SIMD_ATTRIBUTE
 }  // namespace avx2
 
+namespace avx512_vnni {
+#include "scann/distance_measures/one_to_many/one_to_many_vnni_impl.inc"
+}  // namespace avx512_vnni
+
 #endif
 
 template <typename ResultElemT, typename CallbackFunctor>
@@ -70,7 +76,13 @@ SCANN_INLINE void DenseDotProductDistanceOneToManyInt8FloatDispatch(
   constexpr size_t kUnrollFactor = 3;
   using DatasetView = DefaultDenseDatasetView<int8_t>;
   auto view = DatasetView(database);
-  if (RuntimeSupportsAvx2()) {
+  if (RuntimeSupportsAvx512Vnni() &&
+      database.dimensionality() <= avx512_vnni::kMaxDimensionality) {
+    avx512_vnni::DenseDotProductDistanceOneToManyInt8Float<false,
+                                                           DatapointIndex>(
+        query.values(), &view, nullptr, result, callback);
+    j = result.size();
+  } else if (RuntimeSupportsAvx2()) {
     avx2::DenseDotProductDistanceOneToManyInt8Float<DatasetView, false,
                                                     DatapointIndex>(
         query.values(), &view, nullptr, result, callback);
@@ -296,6 +308,8 @@ class SetLimitedInnerTop1Functor {
 
 }  // namespace one_to_many_low_level
 
+constexpr size_t kReorderingSortCandidatesMinSize = 256;
+
 template <typename T>
 Status ExactReorderingHelper<T>::ComputeDistancesForReordering(
     const DatapointPtr<T>& query, NNResultsVector* result) const {
@@ -304,9 +318,10 @@ Status ExactReorderingHelper<T>::ComputeDistancesForReordering(
   if (query.IsDense() && exact_reordering_dataset_->IsDense()) {
     const auto& dense_dataset =
         *down_cast<const DenseDataset<T>*>(exact_reordering_dataset_.get());
-    DenseDistanceOneToMany<T, pair<DatapointIndex, float>>(
+    DenseDistanceOneToManyGather<T, pair<DatapointIndex, float>>(
         *exact_reordering_distance_, query, dense_dataset,
-        MakeMutableSpan(*result));
+        MakeMutableSpan(*result),
+        result->size() >= kReorderingSortCandidatesMinSize);
   } else if (query.IsSparse() && exact_reordering_dataset_->IsSparse()) {
     const auto& sparse_dataset =
         *down_cast<const SparseDataset<T>*>(exact_reordering_dataset_.get());
@@ -324,6 +339,128 @@ Status ExactReorderingHelper<T>::ComputeDistancesForReordering(
   return OkStatus();
 }
 
+namespace {
+
+constexpr size_t kReorderingGatherTileRows = 256;
+
+constexpr size_t kReorderingGatherPrefetchDistance = 8;
+
+constexpr size_t kReorderingMaxDenseWorkRatio = 4;
+
+bool SupportsDenseBatchedReordering(const DistanceMeasure& dist) {
+  switch (dist.specially_optimized_distance_tag()) {
+    case DistanceMeasure::DOT_PRODUCT:
+    case DistanceMeasure::SQUARED_L2:
+    case DistanceMeasure::COSINE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool ComputeDenseDistancesForReorderingBatched(
+    const DistanceMeasure& dist, const DenseDataset<float>& queries,
+    const DenseDataset<float>& database, MutableSpan<NNResultsVector> results) {
+  if (queries.size() < 2) return false;
+
+  size_t num_candidates = 0;
+  for (const auto& result : results) num_candidates += result.size();
+  if (num_candidates == 0) return false;
+
+  vector<DatapointIndex> unique_ids;
+  unique_ids.reserve(num_candidates);
+  for (const auto& result : results) {
+    for (const auto& elem : result) unique_ids.push_back(elem.first);
+  }
+  std::sort(unique_ids.begin(), unique_ids.end());
+  unique_ids.erase(std::unique(unique_ids.begin(), unique_ids.end()),
+                   unique_ids.end());
+
+  if (queries.size() * unique_ids.size() >
+      kReorderingMaxDenseWorkRatio * num_candidates) {
+    return false;
+  }
+
+  const size_t num_unique = unique_ids.size();
+  const size_t dims = database.dimensionality();
+  constexpr size_t kFloatsPerCacheLine = 64 / sizeof(float);
+  auto prefetch_row = [&](DatapointIndex dp_idx) {
+    const float* row = database[dp_idx].values();
+    for (size_t d = 0; d < dims; d += kFloatsPerCacheLine) {
+      ::tensorflow::port::prefetch<::tensorflow::port::PREFETCH_HINT_T0>(
+          row + d);
+    }
+  };
+
+  vector<float> distance_matrix(queries.size() * num_unique);
+  for (size_t tile_begin = 0; tile_begin < num_unique;
+       tile_begin += kReorderingGatherTileRows) {
+    const size_t tile_end =
+        std::min(tile_begin + kReorderingGatherTileRows, num_unique);
+    for (size_t i = tile_begin;
+         i < std::min(tile_begin + kReorderingGatherPrefetchDistance, tile_end);
+         ++i) {
+      prefetch_row(unique_ids[i]);
+    }
+    vector<float> tile_storage((tile_end - tile_begin) * dims);
+    for (size_t i = tile_begin; i < tile_end; ++i) {
+      if (i + kReorderingGatherPrefetchDistance < tile_end) {
+        prefetch_row(unique_ids[i + kReorderingGatherPrefetchDistance]);
+      }
+      const float* row = database[unique_ids[i]].values();
+      std::copy(row, row + dims,
+                tile_storage.begin() + (i - tile_begin) * dims);
+    }
+    DenseDataset<float> tile(std::move(tile_storage), tile_end - tile_begin);
+    DenseDistanceManyToMany<float>(
+        dist, queries, tile,
+        [&](MutableSpan<float> dists, DatapointIndex base_dp_idx,
+            DatapointIndex query_idx) {
+          std::copy(dists.begin(), dists.end(),
+                    distance_matrix.begin() + query_idx * num_unique +
+                        tile_begin + base_dp_idx);
+        });
+  }
+
+  for (size_t query_idx = 0; query_idx < results.size(); ++query_idx) {
+    const float* query_distances =
+        distance_matrix.data() + query_idx * num_unique;
+    for (auto& elem : results[query_idx]) {
+      const size_t unique_idx =
+          std::lower_bound(unique_ids.begin(), unique_ids.end(), elem.first) -
+          unique_ids.begin();
+      elem.second = query_distances[unique_idx];
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+template <typename T>
+Status ExactReorderingHelper<T>::ComputeDistancesForReorderingBatched(
+    const TypedDataset<T>& queries,
+    MutableSpan<NNResultsVector> results) const {
+  DCHECK(exact_reordering_dataset_);
+  DCHECK_EQ(queries.size(), results.size());
+
+  if (std::is_same<T, float>::value && queries.IsDense() &&
+      exact_reordering_dataset_->IsDense() &&
+      SupportsDenseBatchedReordering(*exact_reordering_distance_)) {
+    const auto& dense_queries =
+        *reinterpret_cast<const DenseDataset<float>*>(&queries);
+    const auto& dense_dataset = *reinterpret_cast<const DenseDataset<float>*>(
+        exact_reordering_dataset_.get());
+    if (ComputeDenseDistancesForReorderingBatched(*exact_reordering_distance_,
+                                                  dense_queries, dense_dataset,
+                                                  results)) {
+      return OkStatus();
+    }
+  }
+  return ReorderingHelper<T>::ComputeDistancesForReorderingBatched(queries,
+                                                                   results);
+}
+
 template <typename T>
 StatusOr<std::pair<DatapointIndex, float>>
 ExactReorderingHelper<T>::ComputeTop1ReorderingDistance(
@@ -641,9 +778,340 @@ FixedPointFloatDenseLimitedInnerReorderingHelper::ComputeTop1ReorderingDistance(
   return top1_functor.Top1Pair();
 }
 
+namespace {
+
+template <typename DistanceFunctor>
+void ComputeHalfPrecisionDistances(const uint16_t* data,
+                                   DimensionIndex dimensionality,
+                                   MutableSpan<pair<DatapointIndex, float>> result,
+                                   DistanceFunctor distance) {
+  constexpr size_t kPrefetchDistance = 4;
+  for (size_t i : IndicesOf(result)) {
+    if (i + kPrefetchDistance < result.size()) {
+      ::tensorflow::port::prefetch<::tensorflow::port::PREFETCH_HINT_T0>(
+          data + result[i + kPrefetchDistance].first * dimensionality);
+    }
+    result[i].second = distance(data + result[i].first * dimensionality);
+  }
+}
+
+}  // namespace
+
+class HalfPrecisionFloatDenseReorderingHelper::Mutator
+    : public ReorderingInterface<float>::Mutator {
+ public:
+  explicit Mutator(HalfPrecisionFloatDenseReorderingHelper* helper)
+      : helper_(helper) {}
+
+  StatusOr<DatapointIndex> AddDatapoint(
+      const DatapointPtr<float>& dptr) override {
+    SCANN_RETURN_IF_ERROR(CheckDimensionality(dptr));
+    const DatapointIndex result = helper_->size();
+    auto& data = helper_->data_;
+    data.resize(data.size() + helper_->dimensionality_);
+    FloatToHalf(helper_->format_,
+                MakeConstSpan(dptr.values(), dptr.nonzero_entries()),
+                MakeMutableSpan(data.data() + result * helper_->dimensionality_,
+                                helper_->dimensionality_));
+    return result;
+  }
+
+  StatusOr<DatapointIndex> RemoveDatapoint(DatapointIndex idx) override {
+    const DatapointIndex last = helper_->size() - 1;
+    if (idx > last) {
+      return OutOfRangeError(absl::StrFormat(
+          "The datapoint index %d is >= the dataset size %d", idx, last + 1));
+    }
+    auto& data = helper_->data_;
+    const DimensionIndex dims = helper_->dimensionality_;
+    std::copy(data.begin() + last * dims, data.begin() + (last + 1) * dims,
+              data.begin() + idx * dims);
+    data.resize(last * dims);
+    return last;
+  }
+
+  Status UpdateDatapoint(const DatapointPtr<float>& dptr,
+                         DatapointIndex idx) override {
+    SCANN_RETURN_IF_ERROR(CheckDimensionality(dptr));
+    if (idx >= helper_->size()) {
+      return OutOfRangeError(absl::StrFormat(
+          "The datapoint index %d is >= the dataset size %d", idx,
+          helper_->size()));
+    }
+    FloatToHalf(helper_->format_,
+                MakeConstSpan(dptr.values(), dptr.nonzero_entries()),
+                MakeMutableSpan(
+                    helper_->data_.data() + idx * helper_->dimensionality_,
+                    helper_->dimensionality_));
+    return OkStatus();
+  }
+
+  void Reserve(DatapointIndex num_datapoints) override {
+    helper_->data_.reserve(num_datapoints * helper_->dimensionality_);
+  }
+
+ private:
+  Status CheckDimensionality(const DatapointPtr<float>& dptr) const {
+    if (!dptr.IsDense() || dptr.dimensionality() != helper_->dimensionality_) {
+      return InvalidArgumentError(absl::StrFormat(
+          "Half-precision reordering requires dense datapoints of "
+          "dimensionality %d.",
+          helper_->dimensionality_));
+    }
+    return OkStatus();
+  }
+
+  HalfPrecisionFloatDenseReorderingHelper* helper_;
+};
+
+HalfPrecisionFloatDenseReorderingHelper::HalfPrecisionFloatDenseReorderingHelper(
+    shared_ptr<const DistanceMeasure> exact_reordering_distance,
+    const DenseDataset<float>& exact_reordering_dataset,
+    HalfPrecisionFormat format)
+    : exact_reordering_distance_(std::move(exact_reordering_distance)),
+      format_(format),
+      dimensionality_(exact_reordering_dataset.dimensionality()) {
+  data_.resize(exact_reordering_dataset.size() * dimensionality_);
+  FloatToHalf(format_, exact_reordering_dataset.data(),
+              MakeMutableSpan(data_));
+}
+
+HalfPrecisionFloatDenseReorderingHelper::
+    ~HalfPrecisionFloatDenseReorderingHelper() {}
+
+Status HalfPrecisionFloatDenseReorderingHelper::ComputeDistancesForReordering(
+    const DatapointPtr<float>& query, NNResultsVector* result) const {
+  if (!query.IsDense() || query.dimensionality() != dimensionality_) {
+    return InvalidArgumentError(absl::StrFormat(
+        "Half-precision reordering requires dense queries of dimensionality "
+        "%d.",
+        dimensionality_));
+  }
+  const float* query_values = query.values();
+  const DimensionIndex dims = dimensionality_;
+  const HalfPrecisionFormat format = format_;
+  switch (exact_reordering_distance_->specially_optimized_distance_tag()) {
+    case DistanceMeasure::DOT_PRODUCT:
+      ComputeHalfPrecisionDistances(
+          data_.data(), dims, MakeMutableSpan(*result),
+          [&](const uint16_t* row) {
+            return -DenseDotProductFloatHalf(format, query_values, row, dims);
+          });
+      return OkStatus();
+    case DistanceMeasure::COSINE:
+      ComputeHalfPrecisionDistances(
+          data_.data(), dims, MakeMutableSpan(*result),
+          [&](const uint16_t* row) {
+            return 1.0f -
+                   DenseDotProductFloatHalf(format, query_values, row, dims);
+          });
+      return OkStatus();
+    case DistanceMeasure::SQUARED_L2:
+      ComputeHalfPrecisionDistances(
+          data_.data(), dims, MakeMutableSpan(*result),
+          [&](const uint16_t* row) {
+            return DenseSquaredL2DistanceFloatHalf(format, query_values, row,
+                                                   dims);
+          });
+      return OkStatus();
+    default:
+      return InvalidArgumentError(
+          "Half-precision reordering is supported only for dot product, "
+          "cosine and squared L2 distance.");
+  }
+}
+
+StatusOr<typename ReorderingInterface<float>::Mutator*>
+HalfPrecisionFloatDenseReorderingHelper::GetMutator() const {
+  if (!mutator_) {
+    mutator_ = make_unique<Mutator>(
+        const_cast<HalfPrecisionFloatDenseReorderingHelper*>(this));
+  }
+  return static_cast<typename ReorderingInterface<float>::Mutator*>(
+      mutator_.get());
+}
+
+Status HalfPrecisionFloatDenseReorderingHelper::Reconstruct(
+    DatapointIndex i, MutableSpan<float> output) const {
+  if (i >= size())
+    return InvalidArgumentError(absl::StrFormat(
+        "The datapoint index %d is >= the dataset size %d", i, size()));
+  if (output.size() != dimensionality_)
+    return InvalidArgumentError(absl::StrFormat(
+        "The output span size %d != the dataset dimensionality %d",
+        output.size(), dimensionality_));
+  HalfToFloat(format_, MakeConstSpan(GetRow(i), dimensionality_), output);
+  return OkStatus();
+}
+
+namespace {
+
+void KeepTopNeighbors(DatapointIndex num_neighbors, NNResultsVector* result) {
+  if (result->size() <= num_neighbors) return;
+  std::nth_element(result->begin(), result->begin() + num_neighbors,
+                   result->end(), DistanceComparatorBranchOptimized());
+  result->resize(num_neighbors);
+}
+
+}  // namespace
+
+template <typename T>
+class TieredReorderingHelper<T>::Mutator
+    : public ReorderingInterface<T>::Mutator {
+ public:
+  explicit Mutator(
+      std::vector<typename ReorderingInterface<T>::Mutator*> mutators)
+      : mutators_(std::move(mutators)) {}
+
+  StatusOr<DatapointIndex> AddDatapoint(const DatapointPtr<T>& dptr) final {
+    DatapointIndex result = kInvalidDatapointIndex;
+    for (auto* mutator : mutators_) {
+      TF_ASSIGN_OR_RETURN(result, mutator->AddDatapoint(dptr));
+    }
+    return result;
+  }
+
+  StatusOr<DatapointIndex> RemoveDatapoint(DatapointIndex idx) final {
+    DatapointIndex result = kInvalidDatapointIndex;
+    for (auto* mutator : mutators_) {
+      TF_ASSIGN_OR_RETURN(result, mutator->RemoveDatapoint(idx));
+    }
+    return result;
+  }
+
+  Status UpdateDatapoint(const DatapointPtr<T>& dptr,
+                         DatapointIndex idx) final {
+    for (auto* mutator : mutators_) {
+      SCANN_RETURN_IF_ERROR(mutator->UpdateDatapoint(dptr, idx));
+    }
+    return OkStatus();
+  }
+
+  void Reserve(DatapointIndex num_datapoints) final {
+    for (auto* mutator : mutators_) {
+      mutator->Reserve(num_datapoints);
+    }
+  }
+
+ private:
+  std::vector<typename ReorderingInterface<T>::Mutator*> mutators_;
+};
+
+template <typename T>
+TieredReorderingHelper<T>::TieredReorderingHelper(
+    std::vector<Stage> stages,
+    shared_ptr<const ReorderingInterface<T>> final_stage)
+    : stages_(std::move(stages)), final_stage_(std::move(final_stage)) {
+  DCHECK(final_stage_);
+}
+
+template <typename T>
+TieredReorderingHelper<T>::~TieredReorderingHelper() {}
+
+template <typename T>
+bool TieredReorderingHelper<T>::needs_dataset() const {
+  for (const Stage& stage : stages_) {
+    if (stage.helper->needs_dataset()) return true;
+  }
+  return final_stage_->needs_dataset();
+}
+
+template <typename T>
+Status TieredReorderingHelper<T>::NarrowCandidates(
+    const DatapointPtr<T>& query, NNResultsVector* result) const {
+  for (const Stage& stage : stages_) {
+    if (result->size() <= stage.num_neighbors) continue;
+    SCANN_RETURN_IF_ERROR(
+        stage.helper->ComputeDistancesForReordering(query, result));
+    KeepTopNeighbors(stage.num_neighbors, result);
+  }
+  return OkStatus();
+}
+
+template <typename T>
+Status TieredReorderingHelper<T>::ComputeDistancesForReordering(
+    const DatapointPtr<T>& query, NNResultsVector* result) const {
+  SCANN_RETURN_IF_ERROR(NarrowCandidates(query, result));
+  return final_stage_->ComputeDistancesForReordering(query, result);
+}
+
+template <typename T>
+Status TieredReorderingHelper<T>::ComputeDistancesForReorderingBatched(
+    const TypedDataset<T>& queries,
+    MutableSpan<NNResultsVector> results) const {
+  for (const Stage& stage : stages_) {
+    size_t num_to_narrow = 0;
+    for (const NNResultsVector& result : results) {
+      num_to_narrow += result.size() > stage.num_neighbors;
+    }
+    if (num_to_narrow == 0) continue;
+    if (num_to_narrow == results.size()) {
+      SCANN_RETURN_IF_ERROR(
+          stage.helper->ComputeDistancesForReorderingBatched(queries, results));
+    } else {
+      for (DatapointIndex i : IndicesOf(results)) {
+        if (results[i].size() <= stage.num_neighbors) continue;
+        SCANN_RETURN_IF_ERROR(stage.helper->ComputeDistancesForReordering(
+            queries[i], &results[i]));
+      }
+    }
+    for (NNResultsVector& result : results) {
+      KeepTopNeighbors(stage.num_neighbors, &result);
+    }
+  }
+  return final_stage_->ComputeDistancesForReorderingBatched(queries, results);
+}
+
+template <typename T>
+StatusOr<std::pair<DatapointIndex, float>>
+TieredReorderingHelper<T>::ComputeTop1ReorderingDistance(
+    const DatapointPtr<T>& query, NNResultsVector* result) const {
+  SCANN_RETURN_IF_ERROR(NarrowCandidates(query, result));
+  return final_stage_->ComputeTop1ReorderingDistance(query, result);
+}
+
+template <typename T>
+StatusOr<typename ReorderingInterface<T>::Mutator*>
+TieredReorderingHelper<T>::GetMutator() const {
+  if (!mutator_) {
+    std::vector<typename ReorderingInterface<T>::Mutator*> mutators;
+    // Every tier must take the new datapoints, otherwise the narrowing
+    // stages would score indices past the end of their data.
+    auto add_mutator =
+        [&mutators](const ReorderingInterface<T>& helper) -> Status {
+      if (!helper.owns_mutation_data_structures()) return OkStatus();
+      auto mutator_or = helper.GetMutator();
+      if (!mutator_or.ok()) {
+        return FailedPreconditionError(
+            "Tiered reordering cannot add datapoints: the %s stage is "
+            "immutable (%s).",
+            helper.name(), mutator_or.status().error_message());
+      }
+      mutators.push_back(mutator_or.ValueOrDie());
+      return OkStatus();
+    };
+    for (const Stage& stage : stages_) {
+      SCANN_RETURN_IF_ERROR(add_mutator(*stage.helper));
+    }
+    SCANN_RETURN_IF_ERROR(add_mutator(*final_stage_));
+    mutator_ = make_unique<Mutator>(std::move(mutators));
+  }
+  return static_cast<typename ReorderingInterface<T>::Mutator*>(
+      mutator_.get());
+}
+
+template <typename T>
+bool TieredReorderingHelper<T>::owns_mutation_data_structures() const {
+  for (const Stage& stage : stages_) {
+    if (stage.helper->owns_mutation_data_structures()) return true;
+  }
+  return final_stage_->owns_mutation_data_structures();
+}
+
 SCANN_INSTANTIATE_TYPED_CLASS(, ExactReorderingHelper);
 SCANN_INSTANTIATE_TYPED_CLASS(, CompressedReorderingHelper);
 SCANN_INSTANTIATE_TYPED_CLASS(, CompressedResidualReorderingHelper);
+SCANN_INSTANTIATE_TYPED_CLASS(, TieredReorderingHelper);
 
 }  // namespace scann_ops
 }  // namespace tensorflow
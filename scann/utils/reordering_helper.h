@@ -24,6 +24,7 @@
 #include "scann/hashes/asymmetric_hashing2/querying.h"
 #include "scann/oss_wrappers/scann_status.h"
 #include "scann/utils/common.h"
+#include "scann/utils/half_precision.h"
 #include "scann/utils/types.h"
 #include "scann/utils/util_functions.h"
 
@@ -39,6 +40,16 @@ class ReorderingInterface {
   virtual Status ComputeDistancesForReordering(
       const DatapointPtr<T>& query, NNResultsVector* result) const = 0;
 
+  virtual Status ComputeDistancesForReorderingBatched(
+      const TypedDataset<T>& queries,
+      MutableSpan<NNResultsVector> results) const {
+    for (DatapointIndex i = 0; i < queries.size(); ++i) {
+      SCANN_RETURN_IF_ERROR(
+          ComputeDistancesForReordering(queries[i], &results[i]));
+    }
+    return OkStatus();
+  }
+
   virtual StatusOr<std::pair<DatapointIndex, float>>
   ComputeTop1ReorderingDistance(const DatapointPtr<T>& query,
                                 NNResultsVector* result) const {
@@ -109,6 +120,10 @@ class ExactReorderingHelper : public ReorderingHelper<T> {
   Status ComputeDistancesForReordering(const DatapointPtr<T>& query,
                                        NNResultsVector* result) const override;
 
+  Status ComputeDistancesForReorderingBatched(
+      const TypedDataset<T>& queries,
+      MutableSpan<NNResultsVector> results) const override;
+
   StatusOr<std::pair<DatapointIndex, float>> ComputeTop1ReorderingDistance(
       const DatapointPtr<T>& query, NNResultsVector* result) const override;
 
@@ -317,9 +332,109 @@ class FixedPointFloatDenseLimitedInnerReorderingHelper
   std::vector<float> inverse_database_l2_norms_;
 };
 
+// The mutator resizes the row storage without a lock, so mutations must not
+// overlap searches.
+class HalfPrecisionFloatDenseReorderingHelper : public ReorderingHelper<float> {
+ public:
+  HalfPrecisionFloatDenseReorderingHelper(
+      shared_ptr<const DistanceMeasure> exact_reordering_distance,
+      const DenseDataset<float>& exact_reordering_dataset,
+      HalfPrecisionFormat format);
+
+  ~HalfPrecisionFloatDenseReorderingHelper() override;
+
+  std::string name() const override { return "HalfPrecisionReordering"; }
+
+  bool needs_dataset() const override { return false; }
+
+  Status ComputeDistancesForReordering(const DatapointPtr<float>& query,
+                                       NNResultsVector* result) const override;
+
+  StatusOr<typename ReorderingInterface<float>::Mutator*> GetMutator()
+      const override;
+
+  bool owns_mutation_data_structures() const override { return true; }
+
+  HalfPrecisionFormat format() const { return format_; }
+
+  DimensionIndex dimensionality() const { return dimensionality_; }
+
+  DatapointIndex size() const {
+    return dimensionality_ == 0 ? 0 : data_.size() / dimensionality_;
+  }
+
+  Status Reconstruct(DatapointIndex i, MutableSpan<float> output) const;
+
+ private:
+  class Mutator;
+
+  const uint16_t* GetRow(DatapointIndex i) const {
+    return data_.data() + i * dimensionality_;
+  }
+
+  shared_ptr<const DistanceMeasure> exact_reordering_distance_;
+
+  HalfPrecisionFormat format_;
+
+  DimensionIndex dimensionality_ = 0;
+
+  std::vector<uint16_t> data_;
+
+  mutable unique_ptr<Mutator> mutator_;
+};
+
+template <typename T>
+class TieredReorderingHelper final : public ReorderingHelper<T> {
+ public:
+  struct Stage {
+    shared_ptr<const ReorderingInterface<T>> helper;
+
+    DatapointIndex num_neighbors;
+  };
+
+  TieredReorderingHelper(std::vector<Stage> stages,
+                         shared_ptr<const ReorderingInterface<T>> final_stage);
+
+  ~TieredReorderingHelper() final;
+
+  std::string name() const final { return "TieredReordering"; }
+
+  bool needs_dataset() const final;
+
+  Status ComputeDistancesForReordering(const DatapointPtr<T>& query,
+                                       NNResultsVector* result) const final;
+
+  Status ComputeDistancesForReorderingBatched(
+      const TypedDataset<T>& queries,
+      MutableSpan<NNResultsVector> results) const final;
+
+  StatusOr<std::pair<DatapointIndex, float>> ComputeTop1ReorderingDistance(
+      const DatapointPtr<T>& query, NNResultsVector* result) const final;
+
+  StatusOr<typename ReorderingInterface<T>::Mutator*> GetMutator()
+      const final;
+
+  bool owns_mutation_data_structures() const final;
+
+  const ReorderingInterface<T>& final_stage() const { return *final_stage_; }
+
+ private:
+  class Mutator;
+
+  Status NarrowCandidates(const DatapointPtr<T>& query,
+                          NNResultsVector* result) const;
+
+  std::vector<Stage> stages_;
+
+  shared_ptr<const ReorderingInterface<T>> final_stage_;
+
+  mutable unique_ptr<Mutator> mutator_;
+};
+
 SCANN_INSTANTIATE_TYPED_CLASS(extern, ExactReorderingHelper);
 SCANN_INSTANTIATE_TYPED_CLASS(extern, CompressedReorderingHelper);
 SCANN_INSTANTIATE_TYPED_CLASS(extern, CompressedResidualReorderingHelper);
+SCANN_INSTANTIATE_TYPED_CLASS(extern, TieredReorderingHelper);
 
 }  // namespace scann_ops
 }  // namespace tensorflow
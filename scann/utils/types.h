@@ -54,6 +54,32 @@ inline std::string DimensionIndexToKey(DimensionIndex di) {
 
 using NNResultsVector = std::vector<std::pair<DatapointIndex, float>>;
 
+using ExternalIdNNResultsVector = std::vector<std::pair<int64_t, float>>;
+
+template <typename IdT>
+struct RangeSearchResultsT {
+  ConstSpan<std::pair<IdT, float>> ResultsForQuery(size_t query_index) const {
+    return ConstSpan<std::pair<IdT, float>>(
+        neighbors.data() + offsets[query_index],
+        offsets[query_index + 1] - offsets[query_index]);
+  }
+
+  size_t num_queries() const { return offsets.size() - 1; }
+
+  void Clear() {
+    offsets.assign(1, 0);
+    neighbors.clear();
+  }
+
+  std::vector<size_t> offsets = {0};
+
+  std::vector<std::pair<IdT, float>> neighbors;
+};
+
+using RangeSearchResults = RangeSearchResultsT<DatapointIndex>;
+
+using ExternalIdRangeSearchResults = RangeSearchResultsT<int64_t>;
+
 class NoValue {
  public:
   NoValue() {}